@@ -41,21 +41,62 @@
 // identical, so we've made the data size a parameter so that the code can
 // be re-used for both sensor types (as well as any future variations with
 // other resolutions).
+//
+// We can read the sensor in two ways.  The basic method is to "bit-bang"
+// the protocol, by toggling CLK and reading DO as plain GPIO pins.  That
+// works with any pins, but it keeps the CPU busy for the whole transfer,
+// including the microsecond waits at each clock edge, which add up to
+// a measurable slice of each main loop iteration.  Alternatively, if CLK
+// and DO are wired to the SCK and MISO pins of one of the KL25Z's SPI 
+// units, we can let the SPI hardware generate the clock and shift in the
+// data.  The SSI protocol is close enough to SPI that the hardware can 
+// handle it directly: CLK idles high (CPOL=1), and the sensor changes DO
+// on each rising edge, so we sample on the falling edges (CPHA=0).  That
+// means that the first falling edge samples before the sensor has output
+// anything, so the data bits are shifted over by one.  The KL25Z SPI only
+// supports 8-bit frames, so we read 16 bits as two bytes, which covers
+// the leading dummy bit plus the data bits for sensors up to 15 bits.  CS
+// stays on a GPIO pin, since we have to hold it low across both bytes.
+// At the sensor's maximum 1MHz clock, the SPI transfer takes about 20us.
+// The bit-banged version nominally takes 25us, but in practice it takes
+// several times that, since each wait_us(1) has considerable overhead
+// beyond its nominal microsecond.  (The read time is reported as the
+// plunger "scan time" in the status report, so the difference can be
+// measured on the live system.)
+// The SPI mode is selected in the configuration; we fall back on bit-
+// banging if the selected pins can't be used with SPI.
 
 template<int nBits> class AEAT601X
 {
 public:
-    AEAT601X(PinName csPin, PinName clkPin, PinName doPin) :
+    AEAT601X(PinName csPin, PinName clkPin, PinName doPin, bool useSPI = false) :
         cs(csPin), clk(clkPin), DO(doPin)
     {
         // hold CS and CLK high between readings
         cs = 1;
         clk = 1;
+        
+        // Set up the SPI interface if desired and possible.  This takes
+        // over the CLK and DO pins from the GPIO interfaces.
+        spi = 0;
+        if (useSPI && spiPins(clkPin, doPin))
+        {
+            spi = new SPI(NC, doPin, clkPin);
+            spi->format(8, 2);
+            spi->frequency(1000000);
+        }
     }
     
+    // are we using the SPI interface?
+    bool isSPI() const { return spi != 0; }
+    
     // take a reading, returning an unsigned integer result from 0 to 2^bits-1
     int readAngle()
     {
+        // use the SPI interface if available
+        if (spi != 0)
+            return readAngleSPI();
+            
         // Note on timings: the data sheet lists a number of minimum timing
         // parameters for the serial protocol.  The parameters of interest
         // here are all sub-microsecond, from 100ns to 500ns.  The mbed 
@@ -99,13 +140,71 @@ public:
         
         // The orientation in our mounting design reads the angle in the
         // reverse of the direction we want, so flip it.
-        result = 4095 - result;
+        result = ((1 << nBits) - 1) - result;
         
         // return the result
         return result;
     }
     
 protected:
+    // Take a reading via the SPI interface
+    int readAngleSPI()
+    {
+        // take CS low, and wait t[CLKFE] before starting the clock
+        cs = 0;
+        wait_us(1);
+        
+        // clock in 16 bits, MSb first
+        int hi = spi->write(0xFF);
+        int lo = spi->write(0xFF);
+        
+        // leave CS high between readings
+        cs = 1;
+        
+        // The first bit is the dummy bit clocked in before the sensor 
+        // started sending, so the data bits follow that.
+        int result = (((hi << 8) | lo) >> (15 - nBits)) & ((1 << nBits) - 1);
+        
+        // flip the orientation, as in the bit-banged version
+        return ((1 << nBits) - 1) - result;
+    }
+    
+    // Determine if the given pins can serve as the SCK and MISO pins of
+    // the same KL25Z SPI unit
+    static bool spiPins(PinName sck, PinName miso)
+    {
+        struct PinUnit { PinName pin; int unit; };
+        static const PinUnit sckPins[] = {
+            { PTA15, 0 }, { PTC5, 0 }, { PTD1, 0 },
+            { PTB11, 1 }, { PTD5, 1 }, { PTE2, 1 }
+        };
+        static const PinUnit misoPins[] = {
+            { PTA16, 0 }, { PTA17, 0 }, { PTC6, 0 }, { PTC7, 0 }, { PTD2, 0 }, { PTD3, 0 },
+            { PTB16, 1 }, { PTB17, 1 }, { PTD6, 1 }, { PTD7, 1 }, { PTE1, 1 }, { PTE3, 1 }
+        };
+        
+        // find the SCK pin's SPI unit
+        int unit = -1;
+        for (size_t i = 0 ; i < sizeof(sckPins)/sizeof(sckPins[0]) ; ++i)
+        {
+            if (sckPins[i].pin == sck)
+                unit = sckPins[i].unit;
+        }
+            
+        // make sure the MISO pin is on the same unit
+        for (size_t i = 0 ; i < sizeof(misoPins)/sizeof(misoPins[0]) ; ++i)
+        {
+            if (misoPins[i].pin == miso && misoPins[i].unit == unit)
+                return true;
+        }
+        
+        // no match
+        return false;
+    }
+    
+    // SPI interface, if we're using it
+    SPI *spi;
+    
     // CS (chip select) pin
     DigitalOut cs;
     
@@ -0,0 +1,229 @@
+// Alpha-beta motion estimator test
+//
+// Checks the fixed-point alpha-beta filter in Plunger/alphaBeta.h: that 
+// its gains follow dt/(dt + tau) and the critically damped beta, that it
+// matches a floating-point version of the same filter, that it tracks a
+// constant speed exactly, and that it settles after a sudden stop without
+// ringing.  For comparison, it also runs a float filter with the 
+// Benedict-Bordner gain over the same stop.  Then it compares the filter
+// against the three-point slope speed calculation over the recorded 
+// plunger traces in traces/: the speed noise with the plunger at rest,
+// the peak forward speed, and how much later the filter reports a 
+// forward speed of 500 units/cs during a release.  The timing counts 
+// each estimate as of the sample where it's available, so it includes 
+// the three-point slope's one-sample delay.
+
+#include "testUtil.h"
+#include "plunger.h"
+#include "traceReplay.h"
+#include "alphaBeta.h"
+
+static const char *traceFiles[] = {
+    "traces/releaseFull.ptrc", "traces/releaseHalf.ptrc", "traces/releaseFast.ptrc",
+    "traces/slowReturn.ptrc", "traces/pushForward.ptrc"
+};
+
+// Test subclass, to expose the gain calculation
+class AlphaBetaTest: public AlphaBetaFilter
+{
+public:
+    static void gains(uint32_t dt, uint32_t tau, int32_t &alpha, int32_t &beta)
+        { figureGains(dt, tau, alpha, beta); }
+};
+
+// Floating-point reference filter, with a choice of beta relation
+struct FloatAlphaBeta
+{
+    FloatAlphaBeta(double tau, bool critical) : 
+        tau(tau), critical(critical), valid(false), x(0), v(0), t(0) { }
+    
+    void update(int z, uint32_t tNew)
+    {
+        double dt = double(tNew - t);
+        if (!valid)
+        {
+            x = z;
+            v = 0;
+            t = tNew;
+            valid = true;
+            return;
+        }
+        double alpha = dt/(dt + tau);
+        double beta = critical ? 2.0 - alpha - 2.0*sqrt(1.0 - alpha) : alpha*alpha/(2.0 - alpha);
+        double xPred = x + v*dt;
+        double r = z - xPred;
+        x = xPred + alpha*r;
+        v += beta*r/dt;
+        t = tNew;
+    }
+    
+    // speed in joystick units per centisecond
+    double getSpeed() const { return v * 10000.0; }
+    
+    double tau;
+    bool critical;
+    bool valid;
+    double x, v;
+    uint32_t t;
+};
+
+// Count the times the speed estimate swings across zero, outside of a 
+// small dead band, after a constant-speed ramp comes to a sudden stop.
+// A critically damped filter undershoots once and then settles; an
+// underdamped one swings back and forth.
+template<class Filter> static int countSwings(Filter &f, double &minSpeed)
+{
+    const int deadBand = 5;
+    uint32_t t = 1000;
+    int z = 0, sign = 0, swings = 0;
+    minSpeed = 0;
+    for (int i = 0 ; i < 40 ; ++i, t += 2500, z += 50)
+        f.update(z, t);
+    for (int i = 0 ; i < 200 ; ++i, t += 2500)
+    {
+        f.update(z, t);
+        double s = f.getSpeed();
+        if (s < minSpeed)
+            minSpeed = s;
+        int sNew = s > deadBand ? 1 : s < -deadBand ? -1 : 0;
+        if (sNew != 0 && sNew != sign)
+        {
+            if (sign != 0)
+                ++swings;
+            sign = sNew;
+        }
+    }
+    return swings;
+}
+
+int main()
+{
+    // gains
+    static const uint32_t dts[] = { 100, 1000, 2500, 10000, 50000 };
+    static const uint32_t taus[] = { 500, 2000, 10000, 25500 };
+    for (int i = 0 ; i < 5 ; ++i)
+    {
+        for (int j = 0 ; j < 4 ; ++j)
+        {
+            int32_t alpha, beta;
+            AlphaBetaTest::gains(dts[i], taus[j], alpha, beta);
+            double a = double(dts[i])/(dts[i] + taus[j]);
+            double b = 2.0 - a - 2.0*sqrt(1.0 - a);
+            check(fabs(alpha - a*65536.0) <= 1.0, "dt %u tau %u: alpha %d, expected %.1f", 
+                dts[i], taus[j], alpha, a*65536.0);
+            check(fabs(beta - b*65536.0) <= 1.0 + b*65536.0*0.002, "dt %u tau %u: beta %d, expected %.1f", 
+                dts[i], taus[j], beta, b*65536.0);
+        }
+    }
+    
+    // against the float version of the same filter, with noisy readings
+    // of a plunger moving in a sine wave
+    {
+        TestRand rng(0xAB01);
+        AlphaBetaFilter f;
+        FloatAlphaBeta ref(AlphaBetaFilter::defaultTau, true);
+        double maxPosErr = 0, maxSpeedErr = 0;
+        uint32_t t = 5000;
+        for (int i = 0 ; i < 2000 ; ++i)
+        {
+            t += 2500 + rng.range(-50, 50);
+            int z = int(2000.0 + 1800.0*sin(t/100000.0) + rng.gauss(2.0));
+            f.update(z, t);
+            ref.update(z, t);
+            maxPosErr = fmax(maxPosErr, fabs(f.getPosition() - ref.x));
+            maxSpeedErr = fmax(maxSpeedErr, fabs(f.getSpeed() - ref.getSpeed()));
+        }
+        check(maxPosErr <= 1.0 && maxSpeedErr <= 2.0, "against float: position error %.2f, speed error %.2f",
+            maxPosErr, maxSpeedErr);
+        printf("against float filter: position error %.2f, speed error %.2f\n", maxPosErr, maxSpeedErr);
+    }
+    
+    // constant speed: 1000 units/cs = 250 units per 2.5ms sample
+    {
+        AlphaBetaFilter f;
+        uint32_t t = 1000;
+        for (int i = 0 ; i < 100 ; ++i, t += 2500)
+            f.update(i*250, t);
+        check(abs(f.getSpeed() - 1000) <= 1 && abs(f.getPosition() - 99*250) <= 1,
+            "constant speed: speed %d, position %d", f.getSpeed(), f.getPosition());
+    }
+    
+    // sudden stop, against float filters with each beta relation
+    {
+        AlphaBetaFilter f;
+        FloatAlphaBeta crit(AlphaBetaFilter::defaultTau, true), bb(AlphaBetaFilter::defaultTau, false);
+        double minF, minCrit, minBB;
+        int nF = countSwings(f, minF), nCrit = countSwings(crit, minCrit), nBB = countSwings(bb, minBB);
+        check(nF <= 1, "critically damped filter rang after a stop: %d swings", nF);
+        printf("stop from 2000/cs: undershoot %.0f/cs, %d swing(s); float critical %.0f/cs, %d; "
+            "Benedict-Bordner %.0f/cs, %d\n", minF, nF, minCrit, nCrit, minBB, nBB);
+    }
+    
+    // compare against the three-point slope over the traces
+    printf("trace              rest RMS     peak speed     alpha-beta delay\n");
+    printf("                   3pt    ab    3pt    ab      at -500/cs\n");
+    for (size_t i = 0 ; i < sizeof(traceFiles)/sizeof(traceFiles[0]) ; ++i)
+    {
+        FILE *fp = fopen(traceFiles[i], "rb");
+        if (!check(fp != 0, "can't open %s", traceFiles[i]))
+            continue;
+        PlungerSensorTraceReplay replay(fp);
+        check(replay.ok(), "%s: not a trace file", traceFiles[i]);
+        int zero = replay.getCalZero(), range = replay.getCalMax() - zero;
+        
+        // gather the positions and both speed estimates
+        static PlungerReading z[2000];
+        static double s3[2000], sab[2000];
+        int n = 0;
+        AlphaBetaFilter f;
+        for (PlungerReading r ; n < 2000 && replay.readRaw(r) ; ++n)
+        {
+            z[n].t = r.t;
+            z[n].pos = (r.pos - zero)*4096/range;
+            f.update(z[n].pos, z[n].t);
+            sab[n] = f.getSpeed();
+            
+            // the three-point slope across the last three samples becomes
+            // available with the newest one
+            s3[n] = 0;
+            if (n >= 2)
+                s3[n] = (z[n].pos - z[n-2].pos) * 10000.0 / int32_t(z[n].t - z[n-2].t);
+        }
+        fclose(fp);
+        
+        // rest noise over the first 250ms, after the filter settles, the
+        // peak forward speed, and the first sample past -500/cs
+        double rms3 = 0, rmsab = 0;
+        int nRest = 0, iPeak3 = 0, iPeakab = 0, i3 = -1, iab = -1;
+        for (int j = 0 ; j < n ; ++j)
+        {
+            if (z[j].t - z[0].t > 20000 && z[j].t - z[0].t < 250000)
+            {
+                rms3 += s3[j]*s3[j];
+                rmsab += sab[j]*sab[j];
+                ++nRest;
+            }
+            if (s3[j] < s3[iPeak3])
+                iPeak3 = j;
+            if (sab[j] < sab[iPeakab])
+                iPeakab = j;
+            if (i3 < 0 && s3[j] < -500)
+                i3 = j;
+            if (iab < 0 && sab[j] < -500)
+                iab = j;
+        }
+        rms3 = sqrt(rms3/nRest);
+        rmsab = sqrt(rmsab/nRest);
+        check(rmsab < rms3, "%s: alpha-beta rest noise %.1f, three-point %.1f", 
+            traceFiles[i], rmsab, rms3);
+        
+        printf("%-18s %5.1f %5.1f  %5.0f %5.0f", traceFiles[i] + 7, 
+            rms3, rmsab, s3[iPeak3], sab[iPeakab]);
+        if (i3 >= 0 && iab >= 0)
+            printf("   %6.1f ms\n", int32_t(z[iab].t - z[i3].t)/1000.0);
+        else
+            printf("        -\n");
+    }
+    
+    return testSummary("alphaBetaTest");
+}
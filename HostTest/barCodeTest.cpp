@@ -0,0 +1,223 @@
+// Bar code reader test
+//
+// Checks that the compile-time unrolled bar code bit reader in 
+// Plunger/barCodeSensor.h gives exactly the same raw bits, success mask,
+// and decoded position as the general looping reader, for every 7-bit 
+// code value, at every starting offset where the code fits the image,
+// over a range of contrast, blur, and noise levels.  It also checks the
+// temporal filter's handling of a misread, with the filter enabled and
+// disabled, and that the sensor simply fails to read if there wasn't 
+// enough memory for the prefix sums at startup.  Then it times the two
+// readers against each other.
+
+#include "testUtil.h"
+#include "testFrameSource.h"
+#include "barCodeSensor.h"
+
+extern size_t hostMallocBytesFree;
+
+// Bar code geometry, matching the TSL1401CL sensor
+static const int nBits = 7, bitWidth = 16, npix = 128;
+
+// Test subclass, to expose the bit readers
+class BarCodeTest: public PlungerSensorBarCode<nBits, 0, 1, bitWidth>
+{
+public:
+    BarCodeTest(PlungerSensorImageInterface &sensor) : PlungerSensorBarCode(sensor, npix) { }
+    
+    void unrolled(const PixelPrefixSum &ps, int barStart, int &barcode, int &mask)
+    {
+        barcode = mask = 0;
+        readBits(ps, barStart, barcode, mask, BitIndex<0>());
+    }
+    
+    void clipped(const PixelPrefixSum &ps, int barStart, int &barcode, int &mask)
+    {
+        barcode = mask = 0;
+        readBitsClipped(ps, npix, barStart, barcode, mask);
+    }
+    
+    bool decodeFull(const PixelPrefixSum &ps, int barStart, int &pos, int &barcode, int &mask)
+    {
+        return decode(ps, npix, barStart, pos, barcode, mask);
+    }
+};
+
+// Draw a bar code frame: white margins, and each bit as a white/black 
+// (1) or black/white (0) pair of half-bits, most significant bit first.
+// 'blur' averages each pixel with its neighbors over that radius.
+static void synthBarCode(uint8_t *pix, int code, int start, int white, int black, 
+    int blur, int noise, TestRand &rng)
+{
+    int v[npix];
+    for (int i = 0 ; i < npix ; ++i)
+    {
+        int x = i - start;
+        int bit = x / bitWidth;
+        if (x < 0 || bit >= nBits)
+            v[i] = white;
+        else
+        {
+            bool one = ((code >> (nBits - 1 - bit)) & 1) != 0;
+            bool left = (x % bitWidth) < bitWidth/2;
+            v[i] = (left == one) ? white : black;
+        }
+    }
+    for (int i = 0 ; i < npix ; ++i)
+    {
+        int a = 0, n = 0;
+        for (int j = i - blur ; j <= i + blur ; ++j)
+        {
+            if (j >= 0 && j < npix)
+                a += v[j], ++n;
+        }
+        a = a/n + (noise != 0 ? rng.range(-noise, noise) : 0);
+        pix[i] = uint8_t(a < 0 ? 0 : a > 255 ? 255 : a);
+    }
+}
+
+int main()
+{
+    TestRand rng(0x0BADCAFE);
+    TestFrameSource src(npix);
+    BarCodeTest sensor(src);
+    PixelPrefixSum ps;
+    ps.allocate(npix);
+    uint8_t pix[npix];
+    
+    // every code, at every start offset where the whole code fits
+    static const struct { int white, black, blur, noise; } cond[] = {
+        { 200, 40, 0, 0 },      // clean
+        { 200, 40, 2, 8 },      // typical
+        { 128, 124, 3, 10 },    // low contrast, noisy - many unreadable bits
+        { 255, 0, 7, 60 },      // saturated, badly blurred, very noisy
+    };
+    const int nCond = sizeof(cond)/sizeof(cond[0]);
+    const int maxStart = npix - nBits*bitWidth;
+    int nExact = 0;
+    for (int c = 0 ; c < nCond ; ++c)
+    {
+        for (int code = 0 ; code < (1 << nBits) ; ++code)
+        {
+            for (int start = 0 ; start <= maxStart ; ++start)
+            {
+                synthBarCode(pix, code, start, cond[c].white, cond[c].black, 
+                    cond[c].blur, cond[c].noise, rng);
+                ps.build(pix, npix);
+                
+                // compare the raw readers
+                int rawU, maskU, rawC, maskC;
+                sensor.unrolled(ps, start, rawU, maskU);
+                sensor.clipped(ps, start, rawC, maskC);
+                check(rawU == rawC && maskU == maskC,
+                    "cond %d code %d start %d: unrolled %02x/%02x, clipped %02x/%02x",
+                    c, code, start, rawU, maskU, rawC, maskC);
+                    
+                // decode() uses the unrolled reader when the code fits, so
+                // it must agree with the clipped reader's decoding
+                int pos, raw, mask;
+                bool ok = sensor.decodeFull(ps, start, pos, raw, mask);
+                int posC = grayToBin[rawC];
+                bool okC = posC != grayToBinInvalid && maskC == (1 << nBits) - 1;
+                check(ok == okC && pos == posC && raw == rawC && mask == maskC,
+                    "cond %d code %d start %d: decode %d/%d, clipped %d/%d",
+                    c, code, start, ok, pos, okC, posC);
+                    
+                // a clean image must read back exactly
+                if (c == 0)
+                    check(raw == code && mask == (1 << nBits) - 1,
+                        "clean code %d start %d read as %02x/%02x", code, start, raw, mask);
+                if (raw == code && mask == (1 << nBits) - 1)
+                    ++nExact;
+            }
+        }
+    }
+    printf("%d of %d synthetic codes read exactly\n", nExact, nCond*(1 << nBits)*(maxStart + 1));
+    
+    // Codes that run off the end of the image must go to the clipped 
+    // reader.  Just make sure that decode() agrees with it there.
+    for (int code = 0 ; code < (1 << nBits) ; ++code)
+    {
+        for (int start = maxStart + 1 ; start < npix ; ++start)
+        {
+            synthBarCode(pix, code, start, 200, 40, 1, 4, rng);
+            ps.build(pix, npix);
+            int pos, raw, mask, rawC, maskC;
+            sensor.decodeFull(ps, start, pos, raw, mask);
+            sensor.clipped(ps, start, rawC, maskC);
+            check(raw == rawC && mask == maskC, "clipped code %d start %d", code, start);
+        }
+    }
+    
+    // Temporal filter: run a steady pull through the full sensor, with one
+    // misread spike in the middle.  The filter should reject the spike 
+    // when enabled (config variable 20, flag 0x01), and pass it when not.
+    int binToGray[1 << nBits];
+    for (int g = 0 ; g < (1 << nBits) ; ++g)
+    {
+        if (grayToBin[g] != grayToBinInvalid)
+            binToGray[grayToBin[g]] = g;
+    }
+    for (int filter = 0 ; filter <= 1 ; ++filter)
+    {
+        Config cfg;
+        cfg.setFactoryDefaults();
+        cfg.plunger.barCode.startPix = 8;
+        cfg.plunger.barCode.flags = filter;
+        TestFrameSource fsrc(npix);
+        BarCodeTest fsensor(fsrc);
+        fsensor.onConfigChange(20, cfg);
+        fsensor.init();
+        for (int i = 0 ; i < 30 ; ++i)
+        {
+            int truePos = 40 + i;
+            int pos = (i == 15 ? 100 : truePos);
+            synthBarCode(fsrc.frame(), binToGray[pos], 8, 200, 40, 1, 4, rng);
+            fsrc.setTime(i*2500);
+            PlungerReading r;
+            bool ok = fsensor.readRaw(r);
+            if (i == 15 && filter)
+                check(!ok, "filter passed the misread spike");
+            else
+                check(ok && r.pos == pos, "filter %d frame %d: read %d/%d, expected %d", 
+                    filter, i, ok, ok ? r.pos : -1, pos);
+        }
+    }
+    
+    // Not enough memory for the prefix sums at startup: every read fails
+    {
+        hostMallocBytesFree = 300;
+        TestFrameSource fsrc(npix);
+        BarCodeTest fsensor(fsrc);
+        fsensor.init();
+        hostMallocBytesFree = 8*1024;
+        synthBarCode(fsrc.frame(), binToGray[40], 8, 200, 40, 1, 4, rng);
+        PlungerReading r;
+        check(!fsensor.readRaw(r), "read a code without the prefix sums");
+    }
+    
+    // time the readers on a typical image
+    synthBarCode(pix, 0x5A, 8, 200, 40, 2, 8, rng);
+    ps.build(pix, npix);
+    const int nReps = 2000000;
+    int sink = 0;
+    double t0 = testClock();
+    for (int i = 0 ; i < nReps ; ++i)
+    {
+        int raw, mask;
+        sensor.unrolled(ps, 8 + (i & 7), raw, mask);
+        sink += raw ^ mask;
+    }
+    double t1 = testClock();
+    for (int i = 0 ; i < nReps ; ++i)
+    {
+        int raw, mask;
+        sensor.clipped(ps, 8 + (i & 7), raw, mask);
+        sink += raw ^ mask;
+    }
+    double t2 = testClock();
+    printf("host time per code: unrolled %.1f ns, looping %.1f ns (%d)\n",
+        (t1 - t0)/nReps*1.0e9, (t2 - t1)/nReps*1.0e9, sink & 1);
+    
+    return testSummary("barCodeTest");
+}
@@ -0,0 +1,341 @@
+// Edge scan kernel equivalence test
+//
+// Checks that the packed (four pixels per word) slope-across-gap kernel,
+// scan mode 4, gives exactly the same results as the scalar kernel used
+// by scan mode 2.  The packed kernel reads the pixels through aligned
+// word loads, so its bookkeeping depends on the alignment of the pixel
+// buffer, the scan direction, and the window offsets, all of which we
+// vary here.
+//
+// There are two parts.  The first runs both kernels directly over random
+// stretches of random and synthetic frames, at every buffer alignment.
+// The second runs a corpus of synthetic plunger motion sequences (pulls,
+// releases with motion blur, noise, both sensor orientations, and both
+// TSL1410R and TSL1412S frame sizes) through the full process() path in
+// each mode and compares the reported positions frame by frame.  This
+// includes mode 5 without enough memory for its prefix sums, which must
+// fall back on mode 2 and give exactly the same results.  Finally, it
+// runs the same corpus through readRaw() in every mode, checking each
+// reading against the known edge position in the synthetic frame, and 
+// reports the host time per frame and the throughput in pixels per ns.
+// The host timings only show the relative costs of the modes; the 
+// absolute times on the KL25Z are much longer.
+
+#include "testUtil.h"
+#include "testFrameSource.h"
+#include "edgeSensor.h"
+
+extern size_t hostMallocBytesFree;
+
+// Edge sensor with the scan kernels exposed for testing
+class EdgeSensorTest: public PlungerSensorEdgePos
+{
+public:
+    EdgeSensorTest(PlungerSensorImageInterface &sensor, int npix, int scanMode)
+        : PlungerSensorEdgePos(sensor, npix, scanMode) { }
+        
+    bool hasPixSums() const { return pixSums.isAllocated(); }
+        
+    int kernel(const uint8_t *pix, int iPix1, int nIter, int dir, int gapSize, int &slope)
+        { return gapScanKernel(pix, iPix1, nIter, dir, gapSize, slope); }
+    int kernelPacked(const uint8_t *pix, int iPix1, int nIter, int dir, int gapSize, int &slope)
+        { return gapScanKernelPacked(pix, iPix1, nIter, dir, gapSize, slope); }
+    
+    static const int windowSize = gapWindowSize;
+};
+
+// Run the kernels directly over random stretches of a frame
+static void testKernels(TestRand &rng)
+{
+    const int n = 1536;
+    for (int align = 0 ; align < 4 ; ++align)
+    {
+        TestFrameSource src(n, align);
+        EdgeSensorTest s(src, n, 2);
+        uint8_t *pix = src.frame();
+        
+        for (int frame = 0 ; frame < 200 ; ++frame)
+        {
+            // alternate between random pixels and edge images
+            if (frame % 2 == 0)
+            {
+                for (int i = 0 ; i < n ; ++i)
+                    pix[i] = uint8_t(rng.next());
+            }
+            else
+            {
+                synthEdgeFrame(pix, n, rng.range(0, n), rng.range(1, 200),
+                    rng.range(100, 255), rng.range(0, 60), rng.range(0, 20), 
+                    (frame & 2) ? 1 : -1, rng);
+            }
+            
+            for (int trial = 0 ; trial < 50 ; ++trial)
+            {
+                // pick a gap, direction, and a scan range that stays in
+                // bounds: the scan reads 2*window + gap + nIter - 1 pixels
+                // past the start
+                int dir = (rng.next() & 1) ? 1 : -1;
+                int gap = rng.range(3, 175);
+                int span = 2*EdgeSensorTest::windowSize + gap;
+                int nIter = rng.range(1, n - span);
+                int iStart = rng.range(0, n - span - nIter);
+                if (dir < 0)
+                    iStart = n - 1 - iStart;
+                    
+                int slopeA, slopeB;
+                int idxA = s.kernel(pix, iStart, nIter, dir, gap, slopeA);
+                int idxB = s.kernelPacked(pix, iStart, nIter, dir, gap, slopeB);
+                check(idxA == idxB && slopeA == slopeB,
+                    "kernel mismatch: align %d dir %d gap %d start %d iter %d: "
+                    "scalar %d/%d, packed %d/%d",
+                    align, dir, gap, iStart, nIter, idxA, slopeA, idxB, slopeB);
+            }
+        }
+    }
+}
+
+// Generate a synthetic plunger motion sequence: the edge position for
+// each frame.  The plunger rests, is pulled back slowly, held, released,
+// and bounces off the barrel spring before settling.
+static int motionSequence(int *edge, int maxFrames, int n, TestRand &rng)
+{
+    int park = n/6 + rng.range(-20, 20);
+    int pulled = n - rng.range(40, 200);
+    int nf = 0;
+    
+    // at rest
+    for (int i = 0 ; i < 20 && nf < maxFrames ; ++i)
+        edge[nf++] = park;
+        
+    // slow pull, over about half a second at 2.5ms per frame
+    for (int i = 0 ; i < 200 && nf < maxFrames ; ++i)
+        edge[nf++] = park + (pulled - park)*i/200;
+    
+    // hold
+    for (int i = 0 ; i < 20 && nf < maxFrames ; ++i)
+        edge[nf++] = pulled;
+        
+    // release: constant acceleration to the park position over 20 frames
+    for (int i = 0 ; i <= 20 && nf < maxFrames ; ++i)
+        edge[nf++] = pulled - (pulled - park)*i*i/400;
+        
+    // bounce and settle
+    for (int i = 0 ; i < 60 && nf < maxFrames ; ++i)
+    {
+        double a = (park/3.0) * exp(-i/12.0) * sin(i*0.5);
+        edge[nf++] = park - int(a);
+    }
+    return nf;
+}
+
+// Frame corpus for the process() comparisons and the timing
+struct Corpus
+{
+    int n;
+    int dir;
+    int noise;
+    int nFrames;
+    int *edge;
+    int *blur;
+};
+
+static const int maxCorpusFrames = 400;
+
+static void makeCorpus(Corpus &c, int n, int dir, int noise, TestRand &rng)
+{
+    c.n = n;
+    c.dir = dir;
+    c.noise = noise;
+    c.edge = new int[maxCorpusFrames];
+    c.blur = new int[maxCorpusFrames];
+    c.nFrames = motionSequence(c.edge, maxCorpusFrames, n, rng);
+    
+    // the blur is the distance moved during the exposure, plus the
+    // penumbra of the stationary shadow
+    for (int i = 0 ; i < c.nFrames ; ++i)
+        c.blur[i] = abs(c.edge[i] - (i > 0 ? c.edge[i-1] : c.edge[i])) + 4;
+}
+
+// Run the corpus through two scan modes, and compare the results
+static void compareModes(const Corpus &c, int modeA, int modeB, bool subPixel, TestRand &rng)
+{
+    for (int align = 0 ; align < 4 ; ++align)
+    {
+        TestFrameSource src(c.n, align);
+        EdgeSensorTest a(src, c.n, modeA), b(src, c.n, modeB);
+        a.init();
+        b.init();
+        if (subPixel)
+        {
+            Config cfg;
+            cfg.setFactoryDefaults();
+            cfg.plunger.image.flags = 0x01;
+            a.onConfigChange(24, cfg);
+            b.onConfigChange(24, cfg);
+        }
+        
+        for (int i = 0 ; i < c.nFrames ; ++i)
+        {
+            synthEdgeFrame(src.frame(), c.n, c.edge[i], c.blur[i], 220, 30, c.noise, c.dir, rng);
+            int posA = -1, posB = -1, resA = 0, resB = 0;
+            bool okA = a.process(src.frame(), c.n, posA, resA);
+            bool okB = b.process(src.frame(), c.n, posB, resB);
+            check(okA == okB && (!okA || posA == posB),
+                "mode %d/%d mismatch: n %d dir %d noise %d align %d frame %d: %d/%d vs %d/%d",
+                modeA, modeB, c.n, c.dir, c.noise, align, i, okA, posA, okB, posB);
+        }
+    }
+}
+
+// Time each scan mode over the corpus, and check the readings against
+// the known edge positions.  The frames go through readRaw(), as they
+// would on the device, so each frame gets the full per-frame handling,
+// including the prefix sum invalidation for mode 5.
+static void timeModes(Corpus *corpus, int nCorpus, TestRand &rng)
+{
+    // Allowed error, in pixels, for each mode: the mean error, and the
+    // maximum error beyond the blurred part of the edge.  A motion-blurred
+    // edge is a uniform ramp, so any point on it is as good a reading as 
+    // any other, and we only count the distance past the end of the ramp
+    // as error for the maximum.  The gap scans measure the slope 
+    // across a gap sized to the motion between the last two readings, 
+    // which makes any point within the gap look equally steep on a sharp
+    // edge, so for those modes we allow for the larger of the blur and
+    // the gap.  That matters on the first few frames (the history starts
+    // at pixel 0) and when the plunger stops suddenly at the end of the
+    // release.  The steady slope scan finds the crossing of an 8-pixel
+    // rolling average, which lags the edge by a few pixels.
+    static const struct { bool gap; double mean; int max; } tol[] = {
+        { false, 6.0, 6 },     // 0 = steady slope
+        { false, 2.0, 2 },     // 1 = steepest slope
+        { true,  2.0, 2 },     // 2 = slope across gap
+        { true,  2.0, 2 },     // 3 = tracking slope across gap
+        { true,  2.0, 2 },     // 4 = slope across gap, packed
+        { true,  2.0, 2 },     // 5 = coarse-to-fine
+    };
+    
+    // pre-render the frames, so that we only time the processing
+    int total = 0;
+    double totalPix = 0;
+    for (int i = 0 ; i < nCorpus ; ++i)
+    {
+        total += corpus[i].nFrames;
+        totalPix += double(corpus[i].nFrames) * corpus[i].n;
+    }
+        
+    printf("host time per frame, by scan mode (%d frames):\n", total);
+    for (int mode = 0 ; mode <= 5 ; ++mode)
+    {
+        double t = 0;
+        double sumErr = 0;
+        int maxErr = 0, nMissed = 0;
+        for (int ci = 0 ; ci < nCorpus ; ++ci)
+        {
+            Corpus &c = corpus[ci];
+            TestFrameSource src(c.n);
+            EdgeSensorTest s(src, c.n, mode);
+            s.init();
+            uint8_t *frames = new uint8_t[c.nFrames * c.n];
+            for (int i = 0 ; i < c.nFrames ; ++i)
+                synthEdgeFrame(frames + i*c.n, c.n, c.edge[i], c.blur[i], 220, 30, c.noise, c.dir, rng);
+            
+            // the last two readings, for the gap size, starting at raw 
+            // pixel 0 as the sensor does
+            int prv0 = c.dir < 0 ? c.n : 0, prv1 = prv0;
+            
+            double t0 = testClock();
+            for (int rep = 0 ; rep < 5 ; ++rep)
+            {
+                for (int i = 0 ; i < c.nFrames ; ++i)
+                {
+                    memcpy(src.frame(), frames + i*c.n, c.n);
+                    src.setTime((rep*c.nFrames + i)*2500);
+                    PlungerReading r;
+                    bool ok = s.readRaw(r);
+                    
+                    // Check the first pass.  synthEdgeFrame() centers the
+                    // shadow edge on pixel edge[i] in the logical 
+                    // orientation, so that's where the reading belongs.
+                    if (rep == 0)
+                    {
+                        if (ok)
+                        {
+                            int err = abs(r.pos - c.edge[i]);
+                            sumErr += err;
+                            int gap = abs(prv0 - prv1);
+                            gap = gap < 3 ? 3 : gap > 175 ? 175 : gap;
+                            int slack = tol[mode].gap && gap > c.blur[i] ? gap : c.blur[i];
+                            err -= slack/2;
+                            if (err > maxErr)
+                                maxErr = err;
+                            prv1 = prv0;
+                            prv0 = r.pos;
+                        }
+                        else
+                            ++nMissed;
+                    }
+                }
+            }
+            t += testClock() - t0;
+            delete [] frames;
+        }
+        
+        double ns = t / (5.0 * total) * 1.0e9;
+        double meanErr = sumErr / (total - nMissed);
+        printf("  mode %d: %8.0f ns, %6.2f pixels/ns, error mean %.2f, max past blur %d, %d missed\n", 
+            mode, ns, totalPix / (t / 5.0 * 1.0e9), meanErr, maxErr, nMissed);
+        check(meanErr <= tol[mode].mean && maxErr <= tol[mode].max && nMissed <= total/100,
+            "mode %d accuracy: mean error %.2f, max past blur %d, %d of %d frames missed",
+            mode, meanErr, maxErr, nMissed, total);
+    }
+}
+
+int main()
+{
+    TestRand rng(0x1234567);
+    
+    // direct kernel comparisons
+    testKernels(rng);
+    
+    // build the motion corpus: TSL1410R and TSL1412S frame sizes, both
+    // orientations, and a range of noise levels
+    static const int sizes[] = { 1280, 1536 };
+    static const int noise[] = { 0, 4, 16 };
+    Corpus corpus[12];
+    int nCorpus = 0;
+    for (int si = 0 ; si < 2 ; ++si)
+        for (int dir = -1 ; dir <= 1 ; dir += 2)
+            for (int ni = 0 ; ni < 3 ; ++ni)
+                makeCorpus(corpus[nCorpus++], sizes[si], dir, noise[ni], rng);
+    
+    // compare the packed and scalar modes, with and without sub-pixel
+    // interpolation
+    for (int i = 0 ; i < nCorpus ; ++i)
+    {
+        compareModes(corpus[i], 2, 4, false, rng);
+        compareModes(corpus[i], 2, 4, true, rng);
+    }
+    
+    // mode 5 without enough memory for the prefix sums runs as mode 2
+    hostMallocBytesFree = 1000;
+    {
+        TestFrameSource src(1536);
+        EdgeSensorTest s(src, 1536, 5);
+        s.init();
+        check(!s.hasPixSums(), "mode 5 allocated the prefix sums without enough memory");
+    }
+    for (int i = 0 ; i < nCorpus ; ++i)
+        compareModes(corpus[i], 2, 5, true, rng);
+    hostMallocBytesFree = 8*1024;
+    
+    // show the relative costs of the scan modes
+    timeModes(corpus, nCorpus, rng);
+    
+    for (int i = 0 ; i < nCorpus ; ++i)
+    {
+        delete [] corpus[i].edge;
+        delete [] corpus[i].blur;
+    }
+    
+    return testSummary("edgeKernelTest");
+}
@@ -0,0 +1,127 @@
+// Multi-frame averaging test
+//
+// Checks the image sensor frame averager (Plunger/frameAverage.h): that it
+// reduces the noise in a parked image, that it passes frames through 
+// untouched as soon as the plunger starts moving, that slow creep doesn't
+// leave the averaged edge trailing behind the real one, and that it stays
+// off when there isn't enough memory for its buffers.
+
+#include "testUtil.h"
+#include "frameAverage.h"
+
+extern size_t hostMallocBytesFree;
+
+static const int npix = 1280;
+
+// Draw a frame with the shadow edge at a fractional pixel position, given
+// in 1/16 pixel units, with an 8-pixel ramp between the bright and dark
+// levels.
+static void synthFrame(uint8_t *pix, int edge16, int noise, TestRand &rng)
+{
+    const int bright = 200, dark = 30, ramp16 = 8*16;
+    for (int i = 0 ; i < npix ; ++i)
+    {
+        int d = i*16 + 8 - (edge16 - ramp16/2);
+        int v = d <= 0 ? bright : d >= ramp16 ? dark : bright + (dark - bright)*d/ramp16;
+        if (noise != 0)
+            v += rng.range(-noise, noise);
+        pix[i] = uint8_t(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+}
+
+// Find the edge in a frame, in 1/16 pixel units, as the point where the
+// brightness crosses the midpoint between the bright and dark levels,
+// interpolating between pixels
+static int findEdge(const uint8_t *pix)
+{
+    const int mid = (200 + 30)/2;
+    for (int i = 1 ; i < npix ; ++i)
+    {
+        if (pix[i] < mid && pix[i-1] >= mid)
+            return (i - 1)*16 + 8 + (pix[i-1] - mid)*16/(pix[i-1] - pix[i]);
+    }
+    return -1;
+}
+
+int main()
+{
+    TestRand rng(0x5EED1234);
+    uint8_t pix[npix];
+    
+    // not enough memory - averaging should stay off
+    {
+        hostMallocBytesFree = 1000;
+        FrameAverager fa;
+        fa.enable(3);
+        check(!fa.allocate(npix) && !fa.isEnabled(), "allocated without enough memory");
+        synthFrame(pix, 600*16, 4, rng);
+        check(!fa.apply(pix, npix), "averaged without buffers");
+        hostMallocBytesFree = 8*1024;
+    }
+    
+    // not enabled - no allocation
+    {
+        FrameAverager fa;
+        check(!fa.allocate(npix), "allocated while disabled");
+    }
+    
+    // parked plunger: the noise should drop after a few frames
+    FrameAverager fa;
+    fa.enable(3);
+    check(fa.allocate(npix) && fa.isEnabled(), "allocation failed");
+    uint8_t clean[npix];
+    synthFrame(clean, 600*16, 0, rng);
+    double errRaw = 0, errAvg = 0;
+    int nAvg = 0;
+    for (int f = 0 ; f < 40 ; ++f)
+    {
+        synthFrame(pix, 600*16, 6, rng);
+        double eRaw = 0;
+        for (int i = 0 ; i < npix ; ++i)
+            eRaw += (pix[i] - clean[i])*(pix[i] - clean[i]);
+        bool avg = fa.apply(pix, npix);
+        check(avg == (f != 0) && avg == fa.isActive(), "parked frame %d: averaged %d", f, avg);
+        if (f >= 16)
+        {
+            double eAvg = 0;
+            for (int i = 0 ; i < npix ; ++i)
+                eAvg += (pix[i] - clean[i])*(pix[i] - clean[i]);
+            errRaw += eRaw;
+            errAvg += eAvg;
+            ++nAvg;
+        }
+    }
+    printf("parked RMS noise: raw %.2f, averaged %.2f\n", 
+        sqrt(errRaw/nAvg/npix), sqrt(errAvg/nAvg/npix));
+    check(errAvg < errRaw/4, "averaging didn't reduce the noise enough");
+    
+    // a release: the first moving frame must come through untouched
+    synthFrame(pix, 560*16, 6, rng);
+    uint8_t copy[npix];
+    memcpy(copy, pix, npix);
+    check(!fa.apply(pix, npix) && memcmp(pix, copy, npix) == 0, 
+        "moving frame was averaged");
+    
+    // Slow creep, from a quarter pixel per frame down to 1/16 pixel per
+    // frame.  The averaged edge shouldn't trail the real edge by more 
+    // than a pixel at any point.
+    static const int speeds[] = { 4, 2, 1 };
+    for (int s = 0 ; s < 3 ; ++s)
+    {
+        int edge16 = 400*16, maxLag = 0;
+        for (int f = 0 ; f < 400 ; ++f, edge16 += speeds[s])
+        {
+            synthFrame(pix, edge16, 3, rng);
+            fa.apply(pix, npix);
+            int lag = edge16 - findEdge(pix);
+            if (lag > maxLag)
+                maxLag = lag;
+        }
+        printf("creep at %d/16 pixel per frame: maximum lag %.2f pixels\n", 
+            speeds[s], maxLag/16.0);
+        check(maxLag <= 16, "creep at %d/16 pixel per frame: averaged edge lags by %.2f pixels",
+            speeds[s], maxLag/16.0);
+    }
+    
+    return testSummary("frameAverageTest");
+}
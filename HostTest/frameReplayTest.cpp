@@ -0,0 +1,177 @@
+// Frame replay test and tool
+//
+// With a capture file argument, this replays the file (see 
+// Plunger/frameReplay.h for the format) through the edge sensor image 
+// processor in each scan mode, and shows the positions read in each mode
+// along with the host processing time.  That's the way to check a scan
+// algorithm change against real cabinet recordings:
+//
+//    frameReplayTest capture.pfrm            - summary for each scan mode
+//    frameReplayTest capture.pfrm -v         - positions frame by frame
+//
+// Without arguments, it runs a self-test of the replay interface: it
+// writes a synthetic capture file, replays it through each scan mode, and
+// checks that the replayed frames, timestamps, and positions exactly
+// match processing the same frames directly.
+
+#include "testUtil.h"
+#include "testFrameSource.h"
+#include "edgeSensor.h"
+#include "frameReplay.h"
+
+static const int nModes = 6;
+
+// write a synthetic capture file: a pull and release, with a gap in the
+// frame sequence numbers partway through
+static void writeCapture(FILE *fp, int npix, int nFrames, TestRand &rng)
+{
+    uint8_t hdr[8] = { 'P', 'F', 'R', 'M', uint8_t(npix & 0xFF), uint8_t(npix >> 8), 0, 0 };
+    fwrite(hdr, 1, 8, fp);
+    
+    uint8_t *pix = new uint8_t[npix];
+    uint32_t seq = 100;
+    for (int i = 0 ; i < nFrames ; ++i, ++seq)
+    {
+        if (i == nFrames/2)
+            seq += 3;
+        uint32_t t = 5000000 + i*2500;
+        int edge = i < nFrames/2 ? 200 + i*(npix - 400)/(nFrames/2) : npix - 200 - (i - nFrames/2)*40;
+        if (edge < 200)
+            edge = 200;
+        synthEdgeFrame(pix, npix, edge, 6, 220, 30, 4, 1, rng);
+        
+        uint8_t rec[8] = {
+            uint8_t(t), uint8_t(t >> 8), uint8_t(t >> 16), uint8_t(t >> 24),
+            uint8_t(seq), uint8_t(seq >> 8), uint8_t(seq >> 16), uint8_t(seq >> 24)
+        };
+        fwrite(rec, 1, 8, fp);
+        fwrite(pix, 1, npix, fp);
+    }
+    delete [] pix;
+}
+
+// self-test
+static int selfTest()
+{
+    // write the capture file, plus an identical copy that we read back
+    // directly as the reference
+    const int npix = 1280, nFrames = 120;
+    FILE *fp = tmpfile(), *fpRef = tmpfile();
+    TestRand rng(0x2468ACE), rngRef(0x2468ACE);
+    writeCapture(fp, npix, nFrames, rng);
+    writeCapture(fpRef, npix, nFrames, rngRef);
+    
+    // a bad signature must be rejected
+    {
+        FILE *bad = tmpfile();
+        fwrite("PFRX\0\5\0\0", 1, 8, bad);
+        rewind(bad);
+        PlungerSensorImageInterfaceReplay r(bad);
+        check(!r.ok(), "bad signature accepted");
+        fclose(bad);
+    }
+    
+    for (int mode = 0 ; mode < nModes ; ++mode)
+    {
+        // replay through one sensor, and feed a copy of each replayed
+        // frame directly to a second sensor as a reference
+        rewind(fp);
+        PlungerSensorImageInterfaceReplay replay(fp);
+        if (!check(replay.ok() && replay.getNPix() == npix && !replay.isNegativeImage(),
+            "header not read correctly"))
+            break;
+            
+        PlungerSensorEdgePos sensor(replay, replay.getNPix(), mode);
+        TestFrameSource src(npix);
+        PlungerSensorEdgePos ref(src, npix, mode);
+        
+        fseek(fpRef, 8, SEEK_SET);
+        int n = 0;
+        while (sensor.ready())
+        {
+            uint8_t rec[8];
+            if (!check(fread(rec, 1, 8, fpRef) == 8 && fread(src.frame(), 1, npix, fpRef) == size_t(npix),
+                "mode %d: replayed more frames than the file contains", mode))
+                break;
+            uint32_t t = rec[0] | (rec[1] << 8) | (rec[2] << 16) | (uint32_t(rec[3]) << 24);
+            src.setTime(t);
+            
+            PlungerReading a = { 0, 0 }, b = { 0, 0 };
+            bool okA = sensor.readRaw(a);
+            bool okB = ref.readRaw(b);
+            check(okA == okB && (!okA || (a.pos == b.pos && a.t == b.t)),
+                "mode %d frame %d: replay %d/%d/%u, direct %d/%d/%u",
+                mode, n, okA, a.pos, a.t, okB, b.pos, b.t);
+            ++n;
+        }
+        
+        check(n == nFrames, "mode %d: replayed %d frames, expected %d", mode, n, nFrames);
+        check(replay.getFrameCount() == nFrames, "frame count %d", replay.getFrameCount());
+        check(replay.getFrameSeq() == uint32_t(100 + nFrames - 1 + 3), 
+            "last sequence number %u", replay.getFrameSeq());
+        check(replay.getAvgScanTime() == 2500, "average scan time %u", replay.getAvgScanTime());
+    }
+    
+    fclose(fp);
+    fclose(fpRef);
+    return testSummary("frameReplayTest");
+}
+
+// replay a capture file through each scan mode
+static int replayFile(const char *fname, bool verbose)
+{
+    for (int mode = 0 ; mode < nModes ; ++mode)
+    {
+        FILE *fp = fopen(fname, "rb");
+        if (fp == 0)
+        {
+            printf("can't open %s\n", fname);
+            return 2;
+        }
+        
+        PlungerSensorImageInterfaceReplay replay(fp);
+        if (!replay.ok())
+        {
+            printf("%s: not a frame capture file\n", fname);
+            fclose(fp);
+            return 2;
+        }
+        
+        PlungerSensorEdgePos sensor(replay, replay.getNPix(), mode);
+        int nOk = 0, nFail = 0;
+        double t = 0;
+        while (sensor.ready())
+        {
+            PlungerReading r;
+            double t0 = testClock();
+            bool ok = sensor.readRaw(r);
+            t += testClock() - t0;
+            
+            if (ok)
+                ++nOk;
+            else
+                ++nFail;
+            if (verbose)
+            {
+                if (ok)
+                    printf("mode %d seq %u t %u pos %d\n", mode, replay.getFrameSeq(), r.t, r.pos);
+                else
+                    printf("mode %d seq %u no reading\n", mode, replay.getFrameSeq());
+            }
+        }
+        
+        int nFrames = nOk + nFail;
+        printf("mode %d: %d frames, %d read, %d not read, %.0f ns per frame\n",
+            mode, nFrames, nOk, nFail, nFrames != 0 ? t / nFrames * 1.0e9 : 0.0);
+        fclose(fp);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+        return replayFile(argv[1], argc >= 3 && strcmp(argv[2], "-v") == 0);
+    else
+        return selfTest();
+}
@@ -0,0 +1,138 @@
+// Adaptive jitter filter noise estimator test
+//
+// Checks the sensor noise estimator in Plunger/jitterNoise.h on synthetic
+// readings.  With the plunger parked, the estimate has to come within 25%
+// of the true noise level, and has to follow the noise level when it 
+// goes up or down.  Slow pulls, at startup and after an estimate is in
+// place, must not be taken for noise.  Then it checks that the adaptive
+// filter window in Plunger/plunger.h is always limited, including when
+// the configured window size is zero.
+
+#include "testUtil.h"
+#include "plunger.h"
+
+// Test sensor, for running readings through the jitter filter
+class NoiseTestSensor: public PlungerSensor
+{
+public:
+    NoiseTestSensor(int nativeScale) : PlungerSensor(nativeScale) { }
+    
+    virtual bool readRaw(PlungerReading &r) { return false; }
+    virtual uint32_t getAvgScanTime() { return 0; }
+    
+    int getWindow() const { return jfWindow; }
+};
+
+// Feed the estimator 'n' readings at 'pos' + 'speed'*i, with Gaussian
+// noise 'sigma', passing the filter window as a fixed 5 sigma band 
+// around the position.  Returns the largest standard deviation estimate,
+// in native units, seen along the way.
+static double feed(JitterNoiseEstimator &est, TestRand &rng, 
+    double &pos, double speed, double sigma, int n)
+{
+    int w = int(5*sigma + 0.5);
+    double maxSigma = 0;
+    for (int i = 0 ; i < n ; ++i, pos += speed)
+    {
+        int p = int(floor(pos + rng.gauss(sigma) + 0.5));
+        est.add(p, int(pos) - w/2, int(pos) + w/2, w);
+        if (est.isValid() && est.getSigma16()/16.0 > maxSigma)
+            maxSigma = est.getSigma16()/16.0;
+    }
+    return maxSigma;
+}
+
+static double estSigma(const JitterNoiseEstimator &est) { return est.getSigma16()/16.0; }
+
+int main()
+{
+    hostSetTicker(0);
+    TestRand rng(0x5EED2025);
+    
+    // parked, at a range of noise levels
+    static const double sigmas[] = { 1.0, 2.5, 6.0, 20.0 };
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+        JitterNoiseEstimator est;
+        double pos = 30000;
+        feed(est, rng, pos, 0, sigmas[i], 16*100);
+        double s = estSigma(est);
+        check(est.isValid() && fabs(s - sigmas[i]) <= 0.25*sigmas[i],
+            "parked, sigma %.1f: estimate %.2f", sigmas[i], s);
+        printf("parked, sigma %4.1f: estimate %5.2f\n", sigmas[i], s);
+    }
+    
+    // Slow pulls from power-on.  The first blocks see the plunger moving,
+    // so they must not set the estimate.
+    static const double speeds[] = { 0.5, 1.0, 2.0, 4.0 };
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+        JitterNoiseEstimator est;
+        double pos = 10000;
+        feed(est, rng, pos, speeds[i], 2.0, 16*60);
+        check(!est.isValid(), "pull at startup, speed %.2f: estimate %.2f",
+            speeds[i], estSigma(est));
+        
+        // once parked, the estimate comes from the parked readings
+        feed(est, rng, pos, 0, 2.0, 16*60);
+        double s = estSigma(est);
+        check(est.isValid() && fabs(s - 2.0) <= 0.5, 
+            "parked after pull at startup, speed %.2f: estimate %.2f", speeds[i], s);
+    }
+    
+    // Slow pulls with an estimate in place.  The estimate mustn't grow 
+    // during the pull.
+    for (int i = 0 ; i < 4 ; ++i)
+    {
+        JitterNoiseEstimator est;
+        double pos = 10000;
+        feed(est, rng, pos, 0, 2.0, 16*100);
+        double s = estSigma(est);
+        double maxSigma = feed(est, rng, pos, speeds[i], 2.0, 16*60);
+        check(maxSigma <= s + 0.125, "pull, speed %.2f: estimate rose from %.2f to %.2f", 
+            speeds[i], s, maxSigma);
+        printf("pull, speed %.2f: estimate %.2f before, highest %.2f during\n", 
+            speeds[i], s, maxSigma);
+    }
+    
+    // Noise level changes.  Higher noise rejects blocks until the estimate
+    // restarts; lower noise brings the average back down.
+    {
+        JitterNoiseEstimator est;
+        double pos = 30000;
+        feed(est, rng, pos, 0, 2.0, 16*100);
+        feed(est, rng, pos, 0, 8.0, 16*40);
+        double s = estSigma(est);
+        check(fabs(s - 8.0) <= 2.0, "noise increase 2 -> 8: estimate %.2f", s);
+        
+        feed(est, rng, pos, 0, 2.0, 16*16);
+        s = estSigma(est);
+        check(s <= 4.0, "noise decrease 8 -> 2, 16 blocks: estimate %.2f", s);
+        feed(est, rng, pos, 0, 2.0, 16*60);
+        s = estSigma(est);
+        check(fabs(s - 2.0) <= 0.5, "noise decrease 8 -> 2, 76 blocks: estimate %.2f", s);
+    }
+    
+    // Window limit.  Noise far beyond anything a working sensor produces
+    // has to be capped at the configured window, or at 1/64 of the range
+    // if the configured window is zero.
+    static const int winMax[] = { 0, 20 };
+    for (int i = 0 ; i < 2 ; ++i)
+    {
+        NoiseTestSensor sensor(4096);
+        sensor.setJitterWindow(winMax[i]);
+        sensor.setAdaptiveJitter(true);
+        int cap = winMax[i] != 0 ? winMax[i] : 4096/64;
+        int maxWin = 0;
+        for (int j = 0 ; j < 16*100 ; ++j)
+        {
+            int p = 2000 + int(floor(rng.gauss(100.0) + 0.5));
+            sensor.jitterFilter(p);
+            if (sensor.getWindow() > maxWin)
+                maxWin = sensor.getWindow();
+        }
+        check(maxWin > 0 && maxWin <= cap, "window limit %d: window reached %d", winMax[i], maxWin);
+    }
+    
+    return testSummary("jitterNoiseTest");
+}
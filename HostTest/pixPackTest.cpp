@@ -0,0 +1,181 @@
+// Compressed pixel packet test
+//
+// Round-trips images through the compressed exposure report encoder
+// (USBJoystick/pixPack.h), using a decoder written from the format 
+// description in USBProtocol.h, and checks that every pixel comes back
+// exactly.  It also shows the number of reports needed per frame, 
+// compressed and plain, which is what determines the frame rate in the
+// config tool's live sensor view.
+
+#include "testUtil.h"
+#include "USBJoystick/pixPack.h"
+
+// report size, matching USBJoystick::reportLen
+static const int reportLen = 22;
+
+// Send a frame the way the pixel dump does, and decode it the way the 
+// host would.  Returns the number of reports, or -1 on a decoding error.
+static int roundTrip(const uint8_t *pix, int npix, uint8_t *out)
+{
+    memset(out, 0xAA, npix);
+    int nReports = 0;
+    for (int idx = 0 ; idx < npix ; ++nReports)
+    {
+        // encode the next report, or send a plain one if that does better
+        uint8_t report[reportLen];
+        int start = idx;
+        PixelPacker::pack(report + 2, reportLen - 2, idx, npix, pix);
+        if (!PixelPacker::beatsPlain(idx - start, npix - start, reportLen - 2))
+        {
+            // plain report: copy the pixels
+            idx = start;
+            for (int i = 2 ; i < reportLen && idx < npix ; ++i, ++idx)
+                out[idx] = pix[idx];
+            continue;
+        }
+        
+        // decode the compressed report, per USBProtocol.h
+        int nibbles[(reportLen - 3)*2];
+        for (int i = 3 ; i < reportLen ; ++i)
+        {
+            nibbles[(i-3)*2] = report[i] >> 4;
+            nibbles[(i-3)*2 + 1] = report[i] & 0x0F;
+        }
+        const int nNibbles = (reportLen - 3)*2;
+        int o = start;
+        int prv = out[o++] = report[2];
+        for (int n = 0 ; n < nNibbles && o < npix ; )
+        {
+            int c = nibbles[n++];
+            if (c <= 0xD)
+                prv = out[o++] = prv + c - 7;
+            else if (c == 0xE)
+            {
+                if (n >= nNibbles)
+                    break;
+                for (int r = nibbles[n++] + 3 ; r > 0 ; --r)
+                {
+                    if (o >= npix)
+                        return -1;
+                    out[o++] = prv;
+                }
+            }
+            else
+            {
+                if (n + 2 > nNibbles)
+                    break;
+                prv = out[o++] = nibbles[n]*16 + nibbles[n+1];
+                n += 2;
+            }
+        }
+        
+        // the next report must start where this one left off
+        if (o != idx)
+            return -1;
+    }
+    
+    return nReports;
+}
+
+// check one frame
+static int checkFrame(const uint8_t *pix, int npix, const char *desc)
+{
+    uint8_t *out = new uint8_t[npix];
+    int n = roundTrip(pix, npix, out);
+    int bad = -1;
+    for (int i = 0 ; i < npix && bad < 0 ; ++i)
+    {
+        if (out[i] != pix[i])
+            bad = i;
+    }
+    check(n > 0 && bad < 0, "%s: round trip failed (reports %d, first bad pixel %d)", desc, n, bad);
+    check(n <= (npix + reportLen - 3)/(reportLen - 2), "%s: %d reports, more than plain", desc, n);
+    delete [] out;
+    return n;
+}
+
+int main()
+{
+    TestRand rng(0x13579BDF);
+    const int maxPix = 1546;
+    uint8_t *pix = new uint8_t[maxPix];
+    char desc[80];
+    
+    // Edge images at each noise level, in both directions.  Show the
+    // average reports per frame and the encoding time for each.
+    static const int sizes[] = { 1280, 1536, 1546 };
+    static const int noise[] = { 0, 2, 4, 8, 16, 64 };
+    printf("   npix  noise   plain  packed  ns/frame\n");
+    for (int si = 0 ; si < 3 ; ++si)
+    {
+        int npix = sizes[si];
+        for (int ni = 0 ; ni < 6 ; ++ni)
+        {
+            int total = 0, nFrames = 0;
+            double t = 0;
+            for (int f = 0 ; f < 40 ; ++f, ++nFrames)
+            {
+                int edge = rng.range(0, npix);
+                synthEdgeFrame(pix, npix, edge, rng.range(0, 8), rng.range(128, 255),
+                    rng.range(0, 60), noise[ni], (f & 1) ? 1 : -1, rng);
+                sprintf(desc, "npix %d noise %d frame %d", npix, noise[ni], f);
+                total += checkFrame(pix, npix, desc);
+                
+                double t0 = testClock();
+                for (int idx = 0 ; idx < npix ; )
+                {
+                    uint8_t report[reportLen];
+                    PixelPacker::pack(report + 2, reportLen - 2, idx, npix, pix);
+                }
+                t += testClock() - t0;
+            }
+            printf("  %5d  %5d  %6d  %6.1f  %8.0f\n", npix, noise[ni],
+                (npix + reportLen - 3)/(reportLen - 2), double(total)/nFrames, t/nFrames*1.0e9);
+        }
+    }
+    
+    // Boundary cases for the codes: deltas just inside and outside the
+    // delta range, runs around the maximum run length, and constant and
+    // random images.
+    static const int deltas[] = { -8, -7, 6, 7, 255, -255 };
+    for (int di = 0 ; di < 6 ; ++di)
+    {
+        int v = 128;
+        for (int i = 0 ; i < maxPix ; ++i, v = (v + deltas[di]) & 0xFF)
+            pix[i] = v;
+        sprintf(desc, "delta %d", deltas[di]);
+        checkFrame(pix, maxPix, desc);
+    }
+    for (int runLen = 1 ; runLen <= 40 ; ++runLen)
+    {
+        for (int i = 0 ; i < maxPix ; ++i)
+            pix[i] = (i / runLen) & 1 ? 200 : 10;
+        sprintf(desc, "runs of %d", runLen);
+        checkFrame(pix, maxPix, desc);
+        for (int i = 0 ; i < maxPix ; ++i)
+            pix[i] = 100 + ((i / runLen) & 1);
+        sprintf(desc, "small-step runs of %d", runLen);
+        checkFrame(pix, maxPix, desc);
+    }
+    for (int f = 0 ; f < 50 ; ++f)
+    {
+        for (int i = 0 ; i < maxPix ; ++i)
+            pix[i] = rng.range(0, 255);
+        sprintf(desc, "random frame %d", f);
+        checkFrame(pix, maxPix, desc);
+    }
+    memset(pix, 77, maxPix);
+    checkFrame(pix, maxPix, "constant");
+    
+    // every short image size, to exercise the end-of-image handling
+    for (int npix = 1 ; npix <= 64 ; ++npix)
+    {
+        for (int i = 0 ; i < npix ; ++i)
+            pix[i] = rng.range(0, 3) == 0 ? rng.range(0, 255) : 50;
+        sprintf(desc, "npix %d", npix);
+        checkFrame(pix, npix, desc);
+    }
+    
+    delete [] pix;
+    return testSummary("pixPackTest");
+}
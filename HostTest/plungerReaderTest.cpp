@@ -0,0 +1,477 @@
+// PlungerReader trace replay test
+//
+// Runs the main program's plunger reader (Plunger/plungerReader.h) over
+// the recorded plunger traces in traces/, through the trace replay sensor
+// (Plunger/traceReplay.h), in both speed modes (three-point slope and
+// alpha-beta).  For each trace and mode, it compares the sequence of
+// reported positions, pre-firing positions, and firing states, sample by
+// sample, against the known-good results in traces/<trace>-<mode>.txt,
+// so that any change in the firing event logic shows up as a difference.
+// It also checks the basic expectations independently of the recorded 
+// results: each release has to go through a complete firing event, and
+// the slow return and the push forward mustn't trigger one.  It also
+// runs a synthetic trace in sample batch mode and decodes the batch 
+// reports (0xA3; see USBProtocol.h), checking the bit fields, the 
+// sequence numbers when the buffer overflows, and the 16-bit 10us
+// timestamp across its wraparound.  The prediction tests replay each 
+// trace with latency compensation on, which mustn't change the firing
+// event detection, and run a synthetic steady pull with a processing 
+// delay and a jump in the sensor clock, checking the predicted report
+// positions.  Finally, it times the reader over all of the traces.
+//
+// The expected results weren't generated by this code.  The three-point
+// results come from the PlungerReader class in the original main.cpp, 
+// before the alpha-beta mode existed, and the alpha-beta results come 
+// from the version in main.cpp just before the class moved into its own
+// header.  Each was replayed from zero-filled storage, like the firmware's
+// global instance.  So a match shows that the current reader behaves 
+// like the main program's did.
+//
+// After an intentional change to the firing logic, run "plungerReaderTest
+// -u" to rewrite the expected results, and check the differences.
+
+#include "testUtil.h"
+#include "plunger.h"
+#include "traceReplay.h"
+
+// main program globals used by PlungerReader
+#define JOYMAX 4096
+static Config cfg;
+static PlungerSensor *plungerSensor;
+extern bool plungerCalMode;
+#include "plungerReader.h"
+
+static const struct
+{
+    const char *name;
+    bool fires;
+} traces[] = {
+    { "releaseFull", true }, 
+    { "releaseHalf", true }, 
+    { "releaseFast", true },
+    { "slowReturn", false }, 
+    { "pushForward", false }
+};
+static const int nTraces = sizeof(traces)/sizeof(traces[0]);
+static const char *modeName[] = { "3pt", "ab" };
+
+// Trace replay sensor, with access to the next sample's timestamp, so
+// that we can run the simulated clock in step with the trace
+class TraceSensor: public PlungerSensorTraceReplay
+{
+public:
+    TraceSensor(FILE *fp) : PlungerSensorTraceReplay(fp) { }
+    uint32_t nextTime() const { return next.t; }
+};
+
+// One step of the reader's output
+struct Step
+{
+    uint32_t t;
+    int z, z0, firing;
+};
+
+// Replay a trace through a new PlungerReader, recording the output after
+// each sample.  If 'predict' is set, latency compensation is enabled, 
+// with a 20ms lookahead.  Returns the number of steps.
+static int replay(FILE *fp, int mode, Step *steps, int maxSteps, bool predict = false)
+{
+    TraceSensor sensor(fp);
+    if (!sensor.ok())
+        return -1;
+    
+    cfg.setFactoryDefaults();
+    cfg.plunger.cal.calibrated = true;
+    cfg.plunger.cal.zero = sensor.getCalZero();
+    cfg.plunger.cal.max = sensor.getCalMax();
+    cfg.plunger.motion.mode = mode;
+    cfg.plunger.motion.flags = predict ? 0x01 : 0x00;
+    cfg.plunger.motion.lookahead = 20;
+    sensor.onConfigChange(19, cfg);
+    plungerSensor = &sensor;
+    
+    PlungerReader reader;
+    reader.onUpdateCal();
+    int n = 0;
+    while (sensor.ready() && n < maxSteps)
+    {
+        uint32_t t = sensor.nextTime();
+        hostSetTicker(t);
+        reader.read();
+        Step &s = steps[n++];
+        s.t = t;
+        s.z = reader.getPosition();
+        s.z0 = reader.getPosition0();
+        s.firing = reader.getFiringState();
+    }
+    
+    plungerSensor = 0;
+    return n;
+}
+
+// Build a trace file image in memory.  Returns the length.
+static size_t makeTrace(uint8_t *buf, uint16_t calZero, uint16_t calMax,
+    const uint32_t *t, const uint16_t *pos, int n)
+{
+    memcpy(buf, "PTRC", 4);
+    buf[4] = uint8_t(calZero & 0xFF);
+    buf[5] = uint8_t(calZero >> 8);
+    buf[6] = uint8_t(calMax & 0xFF);
+    buf[7] = uint8_t(calMax >> 8);
+    uint8_t *p = buf + 8;
+    for (int i = 0 ; i < n ; ++i, p += 6)
+    {
+        p[0] = uint8_t(t[i] & 0xFF);
+        p[1] = uint8_t((t[i] >> 8) & 0xFF);
+        p[2] = uint8_t((t[i] >> 16) & 0xFF);
+        p[3] = uint8_t((t[i] >> 24) & 0xFF);
+        p[4] = uint8_t(pos[i] & 0xFF);
+        p[5] = uint8_t(pos[i] >> 8);
+    }
+    return p - buf;
+}
+
+// Decoded batch report sample
+struct BatchSample
+{
+    int seq;
+    int pos, speed, dt;
+};
+
+// Decode the batch reports that the reader has pending, appending the
+// samples to 's'.  Also checks the report header, and the first sample
+// timestamp of each report against 't10'.  Returns the new sample count.
+static int drainBatch(PlungerReader &reader, BatchSample *s, int n, int maxSamples,
+    const uint16_t *t10)
+{
+    while (reader.IsBatchPending())
+    {
+        uint8_t buf[22];
+        reader.PopulateBatchReport(buf, sizeof(buf));
+        int cnt = buf[2];
+        check(buf[0] == 0x00 && buf[1] == 0xA3 && cnt >= 1 && cnt <= 4,
+            "batch report header %02x %02x, count %d", buf[0], buf[1], cnt);
+        
+        int seq = buf[3];
+        int tFirst = buf[4] | (buf[5] << 8);
+        check(tFirst == t10[seq], "batch seq %d: timestamp %d, expected %d", 
+            seq, tFirst, t10[seq]);
+        
+        for (int i = 0 ; i < cnt && i < 4 && n < maxSamples ; ++i, ++seq)
+        {
+            const uint8_t *p = buf + 6 + i*4;
+            uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+            BatchSample &b = s[n++];
+            b.seq = seq & 0xFF;
+            b.pos = int(v & 0x1FFF) - ((v & 0x1000) != 0 ? 0x2000 : 0);
+            b.speed = int((v >> 13) & 0x1FFF) - (((v >> 13) & 0x1000) != 0 ? 0x2000 : 0);
+            b.dt = int(v >> 26);
+        }
+    }
+    return n;
+}
+
+// Sample batch report test.  The trace is a slow, steady retraction,
+// sampled every 2048us, with the calibration range set so that each 
+// calibrated joystick unit is exactly 4 raw units, and the three-point
+// speed comes out exact before truncation.  The timestamps cross the 
+// 16-bit 10us wraparound (655360us) partway through.  It finishes with
+// two readings at the calibrated maximum, where the report has to clamp
+// the position (+4096) and the jump in speed to +4095.
+static void testBatch()
+{
+    const int nRamp = 40;
+    const int n = nRamp + 3;
+    static uint32_t t[n];
+    static uint16_t pos[n];
+    const uint16_t calZero = 10000, calMax = 10000 + 16384;
+    const uint32_t t0 = 655360 - 25*2048 + 700;
+    for (int i = 0 ; i < n ; ++i)
+    {
+        t[i] = t0 + i*2048;
+        pos[i] = i < nRamp ? calZero + 400 + 8*i : i < nRamp + 2 ? calMax : calMax - 8;
+    }
+    
+    static uint8_t buf[8 + n*6];
+    size_t len = makeTrace(buf, calZero, calMax, t, pos, n);
+    FILE *fp = fmemopen(buf, len, "rb");
+    TraceSensor sensor(fp);
+    
+    cfg.setFactoryDefaults();
+    cfg.plunger.cal.calibrated = true;
+    cfg.plunger.cal.zero = calZero;
+    cfg.plunger.cal.max = calMax;
+    cfg.plunger.motion.mode = 0;
+    plungerSensor = &sensor;
+    
+    PlungerReader reader;
+    reader.onUpdateCal();
+    
+    // Read two samples to fill the three-point history, then turn on
+    // batch mode.  In three-point mode, each processed sample is the 
+    // previous input sample, so batch sample number 'seq' comes from 
+    // input sample seq + 1.
+    static uint16_t t10[256];
+    for (int i = 0 ; i < n - 1 ; ++i)
+        t10[i] = uint16_t(t[i + 1]/10);
+    int i = 0;
+    for ( ; i < 2 ; ++i)
+    {
+        hostSetTicker(t[i]);
+        reader.read();
+    }
+    reader.SetBatchMode(true);
+    
+    // Now read 30 samples without sending any reports.  That overflows
+    // the 16-sample buffer, so the first 14 are dropped.
+    for ( ; i < 32 ; ++i)
+    {
+        hostSetTicker(t[i]);
+        reader.read();
+    }
+    static BatchSample bs[64];
+    int nb = drainBatch(reader, bs, 0, 64, t10);
+    check(nb == 16, "batch overflow: %d samples, expected 16", nb);
+    check(nb > 0 && bs[0].seq == 14, "batch overflow: first sequence number %d, expected 14",
+        nb > 0 ? bs[0].seq : -1);
+    
+    // read the rest, sending reports every other sample
+    for ( ; i < n ; ++i)
+    {
+        hostSetTicker(t[i]);
+        reader.read();
+        if ((i & 1) != 0)
+            nb = drainBatch(reader, bs, nb, 64, t10);
+    }
+    nb = drainBatch(reader, bs, nb, 64, t10);
+    check(nb == n - 2 - 14, "batch: %d samples, expected %d", nb, n - 2 - 14);
+    
+    // check each sample against the trace
+    bool wrapped = false;
+    for (int j = 0 ; j < nb ; ++j)
+    {
+        const BatchSample &b = bs[j];
+        int k = b.seq + 1;
+        check(b.seq == 14 + j, "batch sample %d: sequence number %d, expected %d", j, b.seq, 14 + j);
+        check(b.dt == 20, "batch seq %d: dt %d, expected 20", b.seq, b.dt);
+        int zPos = (pos[k] - calZero)/4;
+        int zSpeed = ((pos[k+1] - pos[k-1])/4) * 10000 / 4096;
+        zPos = zPos > 4095 ? 4095 : zPos;
+        zSpeed = zSpeed > 4095 ? 4095 : zSpeed;
+        check(b.pos == zPos && b.speed == zSpeed, "batch seq %d: pos %d speed %d, "
+            "expected pos %d speed %d", b.seq, b.pos, b.speed, zPos, zSpeed);
+        wrapped |= (j > 0 && t10[b.seq] < t10[b.seq - 1]);
+    }
+    check(wrapped, "batch test timestamps didn't cross the 16-bit wraparound");
+    
+    plungerSensor = 0;
+    fclose(fp);
+}
+
+// Prediction test.  The trace is a steady pull at 4 joystick units per
+// 2048us sample, with the calibration set so that joystick units equal
+// raw units.  Each sample reaches the reader 'delay' microseconds after
+// its timestamp, and halfway through, the sensor's clock jumps back by 
+// 20ms, as though its timer had been restarted.  After each sample, we
+// ask for the report position 1ms later, and compare it to the position
+// on the line at that time plus the lookahead, minus the processing
+// delay, which the prediction leaves out (see getReportPosition).  The
+// prediction has to be close before the jump, and again once the clock
+// offset estimate has had time to age out the old offset.
+static void testPrediction(int mode)
+{
+    const int n = 2000, nJump = 1000;
+    const uint32_t period = 2048, delay = 300, clockJump = 20000;
+    const uint32_t h0 = 1000000;
+    const int lookahead = 10;
+    static uint32_t t[n];
+    static uint16_t pos[n];
+    const uint16_t calZero = 30000, calMax = 30000 + 4096;
+    for (int i = 0 ; i < n ; ++i)
+    {
+        t[i] = h0 + i*period - (i >= nJump ? clockJump : 0);
+        pos[i] = calZero - 4000 + 4*i;
+    }
+    
+    static uint8_t buf[8 + n*6];
+    size_t len = makeTrace(buf, calZero, calMax, t, pos, n);
+    FILE *fp = fmemopen(buf, len, "rb");
+    TraceSensor sensor(fp);
+    
+    cfg.setFactoryDefaults();
+    cfg.plunger.cal.calibrated = true;
+    cfg.plunger.cal.zero = calZero;
+    cfg.plunger.cal.max = calMax;
+    cfg.plunger.motion.mode = mode;
+    cfg.plunger.motion.flags = 0x01;
+    cfg.plunger.motion.lookahead = lookahead;
+    plungerSensor = &sensor;
+    
+    hostSetTicker(0);
+    PlungerReader reader;
+    reader.onUpdateCal();
+    
+    // Check from 100 samples in, to let the speed settle, up to the jump;
+    // and again from 2 seconds after the jump, which is the longest the
+    // offset estimate can take to age out the old clock offset.
+    const int settle = 100, ageOut = 2000000/period + 1;
+    double maxErrBefore = 0, maxErrAfter = 0;
+    for (int i = 0 ; i < n ; ++i)
+    {
+        uint32_t h = h0 + i*period;
+        hostSetTicker(h + delay);
+        reader.read();
+        
+        uint32_t hReport = h + delay + 1000;
+        hostSetTicker(hReport);
+        int z = reader.getReportPosition();
+        
+        // position on the line at the report time, plus the lookahead, less
+        // the processing delay, in joystick units
+        double tPred = double(hReport + lookahead*1000 - delay) - h0;
+        double zExp = -4000 + tPred*4.0/period;
+        double err = fabs(z - zExp);
+        if (i >= settle && i < nJump && err > maxErrBefore)
+            maxErrBefore = err;
+        if (i >= nJump + ageOut && err > maxErrAfter)
+            maxErrAfter = err;
+    }
+    check(maxErrBefore <= 3, "prediction, %s mode: error %.1f before the clock jump",
+        modeName[mode], maxErrBefore);
+    check(maxErrAfter <= 3, "prediction, %s mode: error %.1f after the clock jump",
+        modeName[mode], maxErrAfter);
+    printf("prediction, %s mode: maximum error %.1f before clock jump, %.1f after\n",
+        modeName[mode], maxErrBefore, maxErrAfter);
+    
+    plungerSensor = 0;
+    fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    bool update = (argc > 1 && strcmp(argv[1], "-u") == 0);
+    static Step steps[4000];
+    
+    for (int i = 0 ; i < nTraces ; ++i)
+    {
+        for (int mode = 0 ; mode <= 1 ; ++mode)
+        {
+            char fname[128];
+            sprintf(fname, "traces/%s.ptrc", traces[i].name);
+            FILE *fp = fopen(fname, "rb");
+            if (!check(fp != 0, "can't open %s", fname))
+                continue;
+            int n = replay(fp, mode, steps, 4000);
+            fclose(fp);
+            if (!check(n > 0, "%s: not a trace file", fname))
+                continue;
+            
+            // check for a complete firing event, and only in the releases
+            bool fired = false;
+            for (int j = 0 ; j < n ; ++j)
+                fired |= (steps[j].firing == 3);
+            check(fired == traces[i].fires, "%s, %s: %s", traces[i].name, modeName[mode],
+                fired ? "unexpected firing event" : "no firing event");
+            
+            // the firing event detection has to be the same with latency
+            // compensation enabled
+            fp = fopen(fname, "rb");
+            if (fp != 0)
+            {
+                static Step pSteps[4000];
+                int np = replay(fp, mode, pSteps, 4000, true);
+                fclose(fp);
+                int j = 0;
+                while (j < n && j < np && pSteps[j].firing == steps[j].firing && pSteps[j].z0 == steps[j].z0)
+                    ++j;
+                check(np == n && j == n, "%s, %s: with prediction, firing state differs at step %d",
+                    traces[i].name, modeName[mode], j);
+            }
+            
+            // compare against the expected results, or write them
+            sprintf(fname, "traces/%s-%s.txt", traces[i].name, modeName[mode]);
+            if (update)
+            {
+                FILE *fp = fopen(fname, "w");
+                if (!check(fp != 0, "can't create %s", fname))
+                    continue;
+                fprintf(fp, "# t z z0 firing\n");
+                for (int j = 0 ; j < n ; ++j)
+                    fprintf(fp, "%u %d %d %d\n", steps[j].t, steps[j].z, steps[j].z0, steps[j].firing);
+                fclose(fp);
+                printf("wrote %s\n", fname);
+                continue;
+            }
+            
+            FILE *fe = fopen(fname, "r");
+            if (!check(fe != 0, "can't open %s", fname))
+                continue;
+            char line[128];
+            int j = 0;
+            bool match = true;
+            while (fgets(line, sizeof(line), fe) != 0)
+            {
+                if (line[0] == '#')
+                    continue;
+                Step e;
+                if (sscanf(line, "%u %d %d %d", &e.t, &e.z, &e.z0, &e.firing) != 4)
+                    continue;
+                if (j >= n)
+                {
+                    match = check(false, "%s: replay ended at step %d", fname, j);
+                    break;
+                }
+                const Step &s = steps[j++];
+                if (s.t != e.t || s.z != e.z || s.z0 != e.z0 || s.firing != e.firing)
+                {
+                    match = check(false, "%s: step %d: got t %u z %d z0 %d firing %d, "
+                        "expected t %u z %d z0 %d firing %d", fname, j - 1,
+                        s.t, s.z, s.z0, s.firing, e.t, e.z, e.z0, e.firing);
+                    break;
+                }
+            }
+            fclose(fe);
+            if (match)
+                check(j == n, "%s: %d steps expected, %d replayed", fname, j, n);
+        }
+    }
+    
+    // sample batch reports
+    testBatch();
+    
+    // latency compensation
+    testPrediction(0);
+    testPrediction(1);
+    
+    // time the reader over all of the traces, in both modes, replaying
+    // from memory so that the file reads don't count
+    for (int mode = 0 ; mode <= 1 ; ++mode)
+    {
+        int total = 0;
+        double t = 0;
+        for (int i = 0 ; i < nTraces ; ++i)
+        {
+            char fname[128];
+            sprintf(fname, "traces/%s.ptrc", traces[i].name);
+            FILE *fp = fopen(fname, "rb");
+            if (fp == 0)
+                continue;
+            static char buf[64*1024];
+            size_t len = fread(buf, 1, sizeof(buf), fp);
+            fclose(fp);
+            for (int pass = 0 ; pass < 20 ; ++pass)
+            {
+                FILE *mp = fmemopen(buf, len, "rb");
+                double t0 = testClock();
+                int n = replay(mp, mode, steps, 4000);
+                t += testClock() - t0;
+                fclose(mp);
+                total += n;
+            }
+        }
+        printf("host time per sample, %s mode: %.0f ns (%d samples)\n", 
+            modeName[mode], t / total * 1.0e9, total);
+    }
+    
+    return testSummary("plungerReaderTest");
+}
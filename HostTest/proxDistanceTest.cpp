@@ -0,0 +1,99 @@
+// VCNL4010 distance conversion test
+//
+// Checks the fixed-point proximity count to distance conversion in
+// VCNL4010/proxDistance.h.  The reciprocal square root has to match
+// 2^24/sqrt(x) to within 3 parts in 100,000 for every 16-bit input, and
+// the distances have to match the original floating-point conversion 
+// to within one unit, at every count, for a range of calibrations.  Then
+// it times the two conversions against each other.  Note that the host's
+// hardware floating point makes the float version look much better here
+// than on the KL25Z, where every float operation runs in software.
+
+#include "testUtil.h"
+#include "proxDistance.h"
+
+// Reference conversion, using the original floating-point formula
+struct FloatRef
+{
+    FloatRef(int parkCount, int minCount)
+    {
+        dcOffset = minCount > 50 ? minCount - 50 : 0;
+        float parkInv = 1.0f/sqrtf(static_cast<float>(parkCount - dcOffset));
+        scalingFactor = 54612.5f / (1.0f/sqrtf(static_cast<float>(minCount - dcOffset)) - parkInv);
+        scalingOffset = 10922.5f - (scalingFactor * parkInv);
+    }
+    
+    int toDistance(int count) const
+    {
+        count -= dcOffset;
+        if (count <= 0)
+            return 65535;
+        float d = scalingFactor/sqrtf(static_cast<float>(count)) + scalingOffset;
+        return d < 0.0f ? 0 : d > 65535.0f ? 65535 : static_cast<int>(d);
+    }
+    
+    int dcOffset;
+    float scalingFactor;
+    float scalingOffset;
+};
+
+int main()
+{
+    // reciprocal square root, over the whole input range
+    double maxRelErr = 0;
+    for (uint32_t x = 1 ; x <= 65535 ; ++x)
+    {
+        double exact = 16777216.0/sqrt(static_cast<double>(x));
+        double err = fabs(ProxDistance::invSqrt(x) - exact)/exact;
+        if (err > maxRelErr)
+            maxRelErr = err;
+    }
+    check(maxRelErr < 3.0e-5, "invSqrt relative error %.2g", maxRelErr);
+    printf("invSqrt maximum relative error %.2g\n", maxRelErr);
+    
+    // distances, against the float conversion, for calibrations covering
+    // the range of counts seen in practice, plus the power-on default
+    static const int cal[][2] = {
+        { 20000, 100 }, { 30000, 2000 }, { 45000, 5000 }, 
+        { 60000, 12000 }, { 65535, 20000 }, { 8000, 3000 }
+    };
+    const int nCal = sizeof(cal)/sizeof(cal[0]);
+    for (int c = 0 ; c < nCal ; ++c)
+    {
+        ProxDistance dist;
+        dist.calibrate(cal[c][0], cal[c][1]);
+        FloatRef ref(cal[c][0], cal[c][1]);
+        int maxErr = 0;
+        for (int count = 0 ; count <= 65535 ; ++count)
+        {
+            int err = abs(dist.toDistance(count) - ref.toDistance(count));
+            if (err > maxErr)
+                maxErr = err;
+        }
+        check(maxErr <= 1, "park %d, min %d: error %d", cal[c][0], cal[c][1], maxErr);
+        printf("park %d, min %d: maximum error %d\n", cal[c][0], cal[c][1], maxErr);
+    }
+    
+    // time the integer conversion against the float conversion
+    {
+        ProxDistance dist;
+        dist.calibrate(45000, 5000);
+        FloatRef ref(45000, 5000);
+        const int nPasses = 20;
+        volatile int sink = 0;
+        double t0 = testClock();
+        for (int p = 0 ; p < nPasses ; ++p)
+            for (int count = 5000 ; count <= 45000 ; ++count)
+                sink += dist.toDistance(count);
+        double t1 = testClock();
+        for (int p = 0 ; p < nPasses ; ++p)
+            for (int count = 5000 ; count <= 45000 ; ++count)
+                sink += ref.toDistance(count);
+        double t2 = testClock();
+        int n = nPasses * (45000 - 5000 + 1);
+        printf("host time per conversion: integer %.1f ns, float %.1f ns\n",
+            (t1 - t0) / n * 1.0e9, (t2 - t1) / n * 1.0e9);
+    }
+    
+    return testSummary("proxDistanceTest");
+}
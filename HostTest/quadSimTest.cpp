@@ -0,0 +1,432 @@
+// Quadrature sensor simulation test
+//
+// Drives the quadrature sensor's edge handler (Plunger/quadSensor.h) with
+// simulated encoder signals, through the host FastInterruptIn and SysTick
+// stand-ins in shim/.  The simulated encoder moves the plunger back and
+// forth over a grid of pulse rates, from slow motion up to the fastest 
+// edge rate observed on a real plunger (one edge every 19us), with random
+// jitter in the edge timing, and with contact bounce: extra back-and-forth
+// edges on the channel that just changed.  After each run, the position
+// count has to match the simulated encoder exactly, with no illegal 
+// transitions, and the speed read from the edge timestamps has to match
+// the simulated speed.  It also drops edges (as though the interrupt had
+// been missed) to check that each one is counted as an illegal transition,
+// and that the speed reader refuses to guess the direction right after
+// one.
+//
+// The speed reader gets its own checks: zero speed at rest, the slowdown
+// estimate and the timeout after the last edge, every position in the
+// edge timestamp ring, runs across the SysTick counter's reload, and the
+// conversion to joystick units in PlungerReader.  Finally, it times the
+// edge handler.  The host timing includes the pin shim, and only shows
+// the relative cost; on the KL25Z, the interrupt entry and dispatch 
+// (about 6.5us) comes on top of the handler itself.
+
+#include "testUtil.h"
+#include "plunger.h"
+#include "quadSensor.h"
+
+// main program globals used by PlungerReader
+#define JOYMAX 4096
+static Config cfg;
+static PlungerSensor *plungerSensor;
+extern bool plungerCalMode;
+#include "plungerReader.h"
+
+// encoder pins and resolution, for the sensor under test
+static const PinName pinA = PTE20, pinB = PTE21;
+static const int dpi = 300;
+
+// CPU clock cycles per microsecond
+static const int cyclesPerUs = 48;
+
+// Test subclass, to expose the edge statistics
+class QuadTest: public PlungerSensorQuad
+{
+public:
+    QuadTest() : PlungerSensorQuad(dpi, pinA, pinB) { }
+    
+    uint32_t nIllegal() { return getEdgeStats()->nIllegal; }
+    
+    // read the speed at the current time, after the main loop's position
+    // reading, as PlungerReader does
+    bool speedNow(int &v)
+    {
+        PlungerReading r;
+        readRaw(r);
+        v = 0;
+        return readRawSpeed(v);
+    }
+};
+
+// Simulated encoder.  This tracks the true position count and the channel
+// levels, and generates the edges on the sensor's interrupt pins.
+class QuadSim
+{
+public:
+    QuadSim(uint64_t t0) : count(0), t(t0), nEdges(0) { hostSetCycles(t0); }
+    
+    // Channel state (B:A) for a position count.  The states run 0, 1, 3, 2
+    // for increasing counts, which is the forward direction in the sensor's
+    // transition table.
+    static int state(int c)
+    {
+        static const int s[] = { 0, 1, 3, 2 };
+        return s[c & 3];
+    }
+    
+    // Move one count in direction 'd' at time 'tEdge', in CPU cycles.  If
+    // 'irq' is false, the level changes without calling the handler, as
+    // though the interrupt had been missed.
+    void step(int d, uint64_t tEdge, bool irq = true)
+    {
+        int prv = state(count);
+        count += d;
+        int cur = state(count);
+        t = tEdge;
+        hostSetCycles(t);
+        int changed = prv ^ cur;
+        FastInterruptIn::hostSetPin(changed == 1 ? pinA : pinB, (cur & changed) != 0, irq);
+        ++nEdges;
+    }
+    
+    // true position count, relative to the start
+    int count;
+    
+    // time of the latest edge, in CPU cycles
+    uint64_t t;
+    
+    // number of edges generated
+    int nEdges;
+};
+
+// Run the main loop's periodic position reading up to the given time.
+// The sensor relies on this to note the time of the latest edge.
+static uint64_t poll(QuadTest &s, uint64_t nextPoll, uint64_t t)
+{
+    for ( ; nextPoll <= t ; nextPoll += 1000*cyclesPerUs)
+    {
+        hostSetCycles(nextPoll);
+        PlungerReading r;
+        s.readRaw(r);
+    }
+    return nextPoll;
+}
+
+// Check the speed reading just after the latest edge, against the nominal
+// speed of the run.  The average period over the last few edges can be
+// off from the nominal period by up to the jitter, so the speed can be
+// off by the reciprocal of that.
+static void checkSpeed(QuadTest &s, QuadSim &sim, int d, int period, int jitter, const char *desc)
+{
+    hostSetCycles(sim.t + period*cyclesPerUs/4);
+    PlungerReading r;
+    s.readRaw(r);
+    int v = 0;
+    bool ok = s.readRawSpeed(v);
+    int lo = 1000000 * 100 / (period * (100 + jitter)) - 1;
+    int hi = 1000000 * 100 / (period * (100 - jitter)) + 1;
+    check(ok && v*d >= lo && v*d <= hi, "%s: speed %d/%d, expected %d to %d", 
+        desc, ok, v, lo*d, hi*d);
+}
+
+// Run the sensor through a motion sequence at one grid point: forward, 
+// back, and forward again, at a nominal edge period of 'period' us, with
+// up to 'jitter' percent random variation in each period, and with
+// contact bounce on 'bounce' percent of the edges.
+static void runGrid(int period, int jitter, int bounce, TestRand &rng)
+{
+    char desc[80];
+    sprintf(desc, "period %dus, jitter %d%%, bounce %d%%", period, jitter, bounce);
+    
+    QuadSim sim(uint64_t(rng.range(0, 1000000)) * cyclesPerUs);
+    QuadTest s;
+    uint64_t nextPoll = sim.t;
+    
+    static const struct { int d, n; } seg[] = { { 1, 400 }, { -1, 150 }, { 1, 50 } };
+    for (int si = 0 ; si < 3 ; ++si)
+    {
+        for (int i = 0 ; i < seg[si].n ; ++i)
+        {
+            // figure the next edge time, with jitter
+            int p = period*cyclesPerUs;
+            p += p * rng.range(-jitter, jitter) / 100;
+            uint64_t tEdge = sim.t + p;
+            nextPoll = poll(s, nextPoll, tEdge);
+            sim.step(seg[si].d, tEdge);
+            
+            // Add contact bounce: the channel that just changed flips back
+            // and forth a few times, 1us apart.  Leave the last few edges of
+            // each segment clean, so that we can check the speed.
+            if (bounce != 0 && i < seg[si].n - 10 && rng.range(1, 100) <= bounce)
+            {
+                for (int j = rng.range(1, 3) ; j > 0 ; --j)
+                {
+                    sim.step(-seg[si].d, sim.t + cyclesPerUs);
+                    sim.step(seg[si].d, sim.t + cyclesPerUs);
+                }
+            }
+        }
+        
+        checkSpeed(s, sim, seg[si].d, period, jitter, desc);
+    }
+    
+    // the count has to match exactly, with no illegal transitions
+    PlungerReading r;
+    s.readRaw(r);
+    check(r.pos == dpi + sim.count, "%s: position %d, expected %d", desc, r.pos, dpi + sim.count);
+    check(s.nIllegal() == 0, "%s: %d illegal transitions", desc, s.nIllegal());
+}
+
+// Drop edges, as though the interrupt had been missed.  Each missed edge
+// puts the handler's idea of the channel state out of step with the pins,
+// which shows up as an illegal transition at the next edge on the same
+// channel (which also puts it back in step).
+static void testMissed(TestRand &rng)
+{
+    QuadSim sim(0);
+    QuadTest s;
+    uint64_t nextPoll = 0;
+    int nMissed = 0;
+    bool pending = false;
+    for (int i = 0 ; i < 2000 ; ++i)
+    {
+        uint64_t tEdge = sim.t + 50*cyclesPerUs;
+        nextPoll = poll(s, nextPoll, tEdge);
+        
+        // miss an edge now and then, but not before the handler has caught
+        // up with the last one
+        bool miss = !pending && rng.range(1, 50) == 1;
+        uint32_t nIllegal = s.nIllegal();
+        sim.step(i % 500 < 300 ? 1 : -1, tEdge, !miss);
+        if (miss)
+        {
+            ++nMissed;
+            pending = true;
+        }
+        else if (s.nIllegal() != nIllegal)
+        {
+            // The handler caught the problem.  The latest edge's direction
+            // is unknown, so the speed reader should decline to answer.
+            pending = false;
+            int v = 0;
+            PlungerReading r;
+            s.readRaw(r);
+            check(!s.readRawSpeed(v), "speed read after an illegal transition at edge %d: %d", i, v);
+        }
+    }
+    check(int(s.nIllegal()) == nMissed - (pending ? 1 : 0), 
+        "missed edges: %d illegal transitions for %d misses", s.nIllegal(), nMissed);
+}
+
+// Speed at rest: before the first edge, and long after the last one.
+// The slowdown estimate: after the last edge, once the time since the 
+// edge exceeds the average period, the speed reads as the upper bound 
+// implied by the time since the edge, until it times out to zero.
+static void testRest()
+{
+    QuadSim sim(0);
+    QuadTest s;
+    int v;
+    check(s.speedNow(v) && v == 0, "speed before the first edge: %d", v);
+    hostSetCycles(2000000ULL*cyclesPerUs);
+    check(s.speedNow(v) && v == 0, "speed 2s before the first edge: %d", v);
+    
+    // move slowly, one edge per 20ms (50 counts per second)
+    uint64_t nextPoll = sim.t;
+    for (int i = 0 ; i < 20 ; ++i)
+    {
+        uint64_t tEdge = sim.t + 20000*cyclesPerUs;
+        nextPoll = poll(s, nextPoll, tEdge);
+        sim.step(1, tEdge);
+    }
+    uint64_t tLast = sim.t;
+    
+    // check the speed as the time since the last edge grows
+    static const struct { int ms, lo, hi; } pts[] = {
+        { 10, 49, 51 },       // within the average period
+        { 30, 33, 34 },       // 1/30ms
+        { 50, 19, 21 },       // 1/50ms
+        { 95, 10, 11 },       // 1/95ms, just before the timeout
+        { 102, 0, 0 },        // timed out
+        { 500, 0, 0 },        // still stopped, after a SysTick reload
+    };
+    for (int i = 0 ; i < int(sizeof(pts)/sizeof(pts[0])) ; ++i)
+    {
+        nextPoll = poll(s, nextPoll, tLast + pts[i].ms*1000*cyclesPerUs);
+        hostSetCycles(tLast + pts[i].ms*1000*cyclesPerUs);
+        bool ok = s.speedNow(v);
+        check(ok && v >= pts[i].lo && v <= pts[i].hi, 
+            "speed %dms after the last edge: %d/%d, expected %d to %d", 
+            pts[i].ms, ok, v, pts[i].lo, pts[i].hi);
+    }
+    
+    // the position is still right
+    PlungerReading r;
+    s.readRaw(r);
+    check(r.pos == dpi + 20, "position after slow motion: %d", r.pos);
+}
+
+// Read the speed after every edge over several laps of the timestamp
+// ring, at a steady speed, so that the newest edge lands in every ring
+// slot, and the averaging window straddles the end of the ring.
+static void testRing()
+{
+    QuadSim sim(0);
+    QuadTest s;
+    uint64_t nextPoll = sim.t;
+    for (int i = 0 ; i < 100 ; ++i)
+    {
+        uint64_t tEdge = sim.t + 100*cyclesPerUs;
+        nextPoll = poll(s, nextPoll, tEdge);
+        sim.step(-1, tEdge);
+        
+        int v;
+        bool ok = s.speedNow(v);
+        if (i >= 1)
+            check(ok && v == -10000, "ring: edge %d, speed %d/%d", i, ok, v);
+    }
+}
+
+// Run through the SysTick counter's reload.  The counter wraps every 2^24
+// CPU cycles (about 349ms), which the edge handler notes by flagging the
+// first edge after each wrap as having an unknown period.  The speed has 
+// to stay right across the wrap, except right at the flagged edge, where
+// the reader can't tell the period and has to say so.  The time since the
+// last edge also has to be right across the wrap.
+static void testSysTickWrap()
+{
+    const uint64_t wrap = 1ULL << 24;
+    
+    // steady motion through several reloads
+    {
+        QuadSim sim(0);
+        QuadTest s;
+        uint64_t nextPoll = sim.t;
+        int nUnknown = 0, nWraps = 0;
+        for (int i = 0 ; i < 8000 ; ++i)
+        {
+            uint64_t tEdge = sim.t + 200*cyclesPerUs;
+            nextPoll = poll(s, nextPoll, tEdge);
+            if (tEdge / wrap != sim.t / wrap)
+                ++nWraps;
+            sim.step(1, tEdge);
+            
+            int v;
+            if (!s.speedNow(v))
+                ++nUnknown;
+            else 
+                check(i == 0 || v == 5000, "SysTick wrap: edge %d, speed %d", i, v);
+        }
+        check(nWraps >= 4 && nUnknown == nWraps, 
+            "SysTick wrap: %d unknown speed readings for %d wraps", nUnknown, nWraps);
+    }
+    
+    // slow motion, with the last edge just before a reload, and the speed
+    // read just after it
+    {
+        QuadSim sim(0);
+        QuadTest s;
+        uint64_t nextPoll = sim.t;
+        uint64_t tEdge = wrap - 1000*cyclesPerUs - 10*5000*cyclesPerUs;
+        for (int i = 0 ; i < 10 ; ++i, tEdge += 5000*cyclesPerUs)
+        {
+            nextPoll = poll(s, nextPoll, tEdge);
+            sim.step(-1, tEdge);
+        }
+        nextPoll = poll(s, nextPoll, sim.t + 8000*cyclesPerUs);
+        hostSetCycles(sim.t + 8000*cyclesPerUs);
+        int v;
+        bool ok = s.speedNow(v);
+        check(ok && v == -125, "speed 8ms after the last edge, across a reload: %d/%d", ok, v);
+    }
+}
+
+// Check the speed conversion in PlungerReader.  The reader takes the 
+// sensor's speed in abstract units (0..65535 full scale) per second, and 
+// converts it to joystick units per centisecond, using the calibration
+// range.  A steady forward push (decreasing position) shows up as the 
+// peak forward speed.
+static void testReaderSpeed()
+{
+    static const int periods[] = { 19, 100, 1000 };
+    for (int pi = 0 ; pi < 3 ; ++pi)
+    {
+        int period = periods[pi];
+        QuadSim sim(0);
+        QuadTest s;
+        cfg.setFactoryDefaults();
+        cfg.plunger.cal.calibrated = true;
+        cfg.plunger.cal.zero = 10000;
+        cfg.plunger.cal.max = 50000;
+        cfg.plunger.motion.mode = 0;
+        plungerSensor = &s;
+        PlungerReader reader;
+        reader.onUpdateCal();
+        
+        // push forward steadily for 300ms, reading every millisecond
+        uint64_t tRead = sim.t;
+        while (sim.t < 300000ULL*cyclesPerUs)
+        {
+            uint64_t tEdge = sim.t + period*cyclesPerUs;
+            for ( ; tRead <= tEdge ; tRead += 1000*cyclesPerUs)
+            {
+                hostSetCycles(tRead);
+                reader.read();
+            }
+            sim.step(-1, tEdge);
+        }
+        
+        // figure the expected speed: counts per second, to abstract units
+        // per second, to joystick units per centisecond
+        double vCounts = -1.0e6 / period;
+        double vAbs = vCounts * 65535.0 / (dpi*4);
+        double expected = vAbs * JOYMAX / (cfg.plunger.cal.max - cfg.plunger.cal.zero) / 100.0;
+        int v = reader.getSpeed();
+        check(fabs(v - expected) <= 1.0 + fabs(expected)*0.005, 
+            "reader speed at %dus per edge: %d, expected %.1f", period, v, expected);
+        plungerSensor = 0;
+    }
+}
+
+// Time the edge handler, at the fastest observed edge rate
+static void timeHandler()
+{
+    QuadSim sim(0);
+    QuadTest s;
+    const int nEdges = 2000000;
+    double t0 = testClock();
+    for (int i = 0 ; i < nEdges ; ++i)
+        sim.step((i & 0x400) ? -1 : 1, sim.t + 19*cyclesPerUs);
+    double t = testClock() - t0;
+    printf("host time per edge: %.1f ns\n", t / nEdges * 1.0e9);
+    check(s.nIllegal() == 0, "timing run: %d illegal transitions", s.nIllegal());
+}
+
+int main()
+{
+    TestRand rng(0x0DDBA11);
+    
+    // rate, jitter, and bounce grid
+    static const int periods[] = { 19, 50, 200, 1000, 5000 };
+    static const int jitters[] = { 0, 10, 40 };
+    static const int bounces[] = { 0, 5 };
+    for (int pi = 0 ; pi < 5 ; ++pi)
+        for (int ji = 0 ; ji < 3 ; ++ji)
+            for (int bi = 0 ; bi < 2 ; ++bi)
+                runGrid(periods[pi], jitters[ji], bounces[bi], rng);
+    
+    // missed edges
+    testMissed(rng);
+    
+    // speed reader
+    testRest();
+    testRing();
+    testSysTickWrap();
+    testReaderSpeed();
+    
+    // handler timing
+    timeHandler();
+    
+    return testSummary("quadSimTest");
+}
@@ -0,0 +1,150 @@
+// Rotary sensor linearization test
+//
+// Checks the table-driven angle-to-position conversion in the rotary 
+// plunger sensor (Plunger/rotarySensor.h) against the direct tanf() 
+// formula that it replaces, over the range of angles the mechanism can
+// reach, for 10-bit and 12-bit sensors and a range of calibrations.  The
+// error has to stay below one joystick unit (16 units on the sensor's 
+// 0..65535 scale), and the readings have to increase steadily with the 
+// angle, including past the ends of the table.  Then it times the table
+// lookup against the float formula.
+
+#include "testUtil.h"
+#include "plunger.h"
+#include "rotarySensor.h"
+
+// Test subclass, taking its angle readings from the test instead of 
+// from a physical sensor
+class RotaryTest: public PlungerSensorRotary
+{
+public:
+    RotaryTest(int nBits) : 
+        PlungerSensorRotary((1 << nBits) - 1, 6.283185f/((1 << nBits) - 1)),
+        rawAngle(0) { }
+    
+    // read the linear position for a raw angle
+    int read(int raw)
+    {
+        rawAngle = raw;
+        PlungerReading r = { 0, 0 };
+        readRaw(r);
+        return r.pos;
+    }
+    
+    int rawAngle;
+    
+private:
+    virtual bool readSensor(int &angle) 
+    {
+        angle = rawAngle;
+        return true;
+    }
+};
+
+// Reference conversion, using the original floating-point formula
+struct FloatRef
+{
+    FloatRef(int maxRawAngle, int biasedMax)
+    {
+        radiansPerSensorUnit = 6.283185f/maxRawAngle;
+        const float C = 1.4848489f;
+        float T = tanf(static_cast<float>(biasedMax) * radiansPerSensorUnit);
+        alpha = atanf((sqrtf(4*T*T*C + C*C + 2*C + 1) - C - 1)/(2*T*C));
+        linearScaleFactor = static_cast<int>(60000.0f * .316327f / tanf(alpha));
+    }
+    
+    int toLinear(int angle) const
+    {
+        float theta = static_cast<float>(angle)*radiansPerSensorUnit - alpha;
+        return static_cast<int>(tanf(theta) * linearScaleFactor) + 32767;
+    }
+    
+    float radiansPerSensorUnit;
+    float alpha;
+    float linearScaleFactor;
+};
+
+int main()
+{
+    hostSetTicker(0);
+    
+    static const int sensorBits[] = { 10, 12 };
+    static const int maxDegrees[] = { 40, 50, 60, 70 };
+    for (int b = 0 ; b < 2 ; ++b)
+    {
+        int nBits = sensorBits[b];
+        int maxRaw = (1 << nBits) - 1;
+        int park = maxRaw/2;
+        for (int c = 0 ; c < 4 ; ++c)
+        {
+            // calibrate, with the park position mid-scale so that the 
+            // readings don't wrap
+            int biasedMax = maxDegrees[c] * maxRaw/360;
+            Config cfg;
+            cfg.setFactoryDefaults();
+            cfg.plunger.cal.calibrated = true;
+            cfg.plunger.cal.raw0 = park;
+            cfg.plunger.cal.raw1 = biasedMax;
+            RotaryTest sensor(nBits);
+            sensor.restoreCalibration(cfg);
+            FloatRef ref(maxRaw, biasedMax);
+            
+            // compare over the mechanism's range: from about 10 degrees
+            // forward of the park position to the maximum retraction
+            int maxErr = 0;
+            for (int a = -maxRaw/36 ; a <= biasedMax ; ++a)
+            {
+                int err = abs(sensor.read(park + a) - ref.toLinear(a));
+                if (err > maxErr)
+                    maxErr = err;
+            }
+            check(maxErr < 16, "%d-bit sensor, %d degree calibration: error %d", 
+                nBits, maxDegrees[c], maxErr);
+            printf("%d-bit sensor, %d degree calibration: maximum error %d\n",
+                nBits, maxDegrees[c], maxErr);
+            
+            // the readings must never decrease as the angle increases, 
+            // over the whole unwrapped range of the sensor
+            int prev = sensor.read(park - maxRaw/12);
+            for (int a = -maxRaw/12 + 1 ; a < maxRaw - maxRaw/12 ; ++a)
+            {
+                int raw = (park + a) % maxRaw;
+                int cur = sensor.read(raw);
+                if (!check(cur >= prev, "%d-bit sensor, %d degree calibration: "
+                    "reading decreased at angle %d", nBits, maxDegrees[c], a))
+                    break;
+                prev = cur;
+            }
+        }
+    }
+    
+    // time the table lookup against the float formula
+    {
+        int maxRaw = 4095, park = maxRaw/2, biasedMax = 60 * maxRaw/360;
+        Config cfg;
+        cfg.setFactoryDefaults();
+        cfg.plunger.cal.calibrated = true;
+        cfg.plunger.cal.raw0 = park;
+        cfg.plunger.cal.raw1 = biasedMax;
+        RotaryTest sensor(12);
+        sensor.restoreCalibration(cfg);
+        FloatRef ref(maxRaw, biasedMax);
+        
+        const int nPasses = 200;
+        int n = biasedMax + maxRaw/36 + 1;
+        volatile int sink = 0;
+        double t0 = testClock();
+        for (int p = 0 ; p < nPasses ; ++p)
+            for (int a = -maxRaw/36 ; a <= biasedMax ; ++a)
+                sink += sensor.read(park + a);
+        double t1 = testClock();
+        for (int p = 0 ; p < nPasses ; ++p)
+            for (int a = -maxRaw/36 ; a <= biasedMax ; ++a)
+                sink += ref.toLinear(a);
+        double t2 = testClock();
+        printf("host time per reading: table %.1f ns, tanf %.1f ns\n",
+            (t1 - t0) / (nPasses * n) * 1.0e9, (t2 - t1) / (nPasses * n) * 1.0e9);
+    }
+    
+    return testSummary("rotaryLinearTest");
+}
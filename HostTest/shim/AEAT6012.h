@@ -0,0 +1,20 @@
+// Host build stand-in for the AEAT-601X rotary encoder interface
+//
+// The rotary plunger sensor header includes the device interface for its
+// hardware-specific subclass.  The tests derive their own subclasses from
+// the generic rotary sensor instead, supplying the angle readings 
+// directly, so this only has to declare the interface.
+
+#ifndef _HOSTTEST_AEAT6012_H_
+#define _HOSTTEST_AEAT6012_H_
+
+#include "mbed.h"
+
+template<int nBits> class AEAT601X
+{
+public:
+    AEAT601X(PinName, PinName, PinName, bool) { }
+    int readAngle() { return 0; }
+};
+
+#endif /* _HOSTTEST_AEAT6012_H_ */
@@ -0,0 +1,82 @@
+// Host build stand-in for FastInterruptIn
+//
+// The real class is a bare-metal KL25Z GPIO interrupt handler.  This 
+// version lets a test play the part of the hardware: hostSetPin() sets
+// an input pin's level, and calls the rising or falling edge handler 
+// right away if the level changed, as the interrupt would on the device.
+// A test can also change the level without calling the handler, to 
+// simulate a missed interrupt.
+
+#ifndef _HOSTTEST_FASTINTERRUPTIN_H_
+#define _HOSTTEST_FASTINTERRUPTIN_H_
+
+#include "mbed.h"
+
+class FastInterruptIn
+{
+public:
+    FastInterruptIn(PinName pin) : pin(pin), value(0)
+    {
+        cbRise = cbFall = 0;
+        ctxRise = ctxFall = 0;
+        
+        // add it to the list of pins, for hostSetPin()
+        next = first;
+        first = this;
+    }
+    
+    ~FastInterruptIn()
+    {
+        for (FastInterruptIn **p = &first ; *p != 0 ; p = &(*p)->next)
+        {
+            if (*p == this)
+            {
+                *p = next;
+                break;
+            }
+        }
+    }
+    
+    // read the pin level
+    int read() const { return value; }
+    operator int() const { return value; }
+    
+    // set the rising and falling edge handlers
+    void rise(void (*func)(void *), void *context = 0) { cbRise = func; ctxRise = context; }
+    void fall(void (*func)(void *), void *context = 0) { cbFall = func; ctxFall = context; }
+    
+    // Set a pin's level.  If 'irq' is true, and the level changed, call
+    // the edge handler.
+    static void hostSetPin(PinName pin, int level, bool irq = true)
+    {
+        for (FastInterruptIn *p = first ; p != 0 ; p = p->next)
+        {
+            if (p->pin == pin)
+            {
+                int prv = p->value;
+                p->value = level ? 1 : 0;
+                if (irq && p->value != prv)
+                {
+                    if (p->value && p->cbRise != 0)
+                        p->cbRise(p->ctxRise);
+                    else if (!p->value && p->cbFall != 0)
+                        p->cbFall(p->ctxFall);
+                }
+            }
+        }
+    }
+    
+protected:
+    PinName pin;
+    int value;
+    void (*cbRise)(void *);
+    void (*cbFall)(void *);
+    void *ctxRise;
+    void *ctxFall;
+    
+    // list of pins
+    FastInterruptIn *next;
+    static FastInterruptIn *first;
+};
+
+#endif /* _HOSTTEST_FASTINTERRUPTIN_H_ */
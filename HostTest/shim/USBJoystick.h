@@ -0,0 +1,52 @@
+// Host build stand-in for the USB joystick interface
+//
+// The plunger sensor code sends its status reports through the joystick
+// interface.  The host tests don't have a USB connection, so this version
+// just accepts and discards the reports.  The pixel report functions
+// advance the caller's pixel index as the real ones do, so that the 
+// callers' send loops terminate.  The signatures must match the real
+// interface in USBJoystick/USBJoystick.h.
+
+#ifndef _HOSTTEST_USBJOYSTICK_H_
+#define _HOSTTEST_USBJOYSTICK_H_
+
+#include "mbed.h"
+
+class USBJoystick
+{
+public:
+    static const int AXIS_FORMAT_XYZ        = 0;
+    static const int AXIS_FORMAT_RXRYRZ     = 1;
+    static const int AXIS_FORMAT_XYZ_RXRYRZ = 2;
+    
+    bool sendPlungerStatus(int npix, int pos, int flags,
+        uint32_t avgScanTime, uint32_t processingTime, int16_t speed) 
+        { return true; }
+    bool sendPlungerStatus2(
+        int nativeScale, int jitterLo, int jitterHi, int rawPos, int axcTime,
+        int noise) 
+        { return true; }
+    bool sendPlungerStatusBarcode(
+        int nbits, int codetype, int startOfs, int pixPerBit, int raw, int mask,
+        int rejectRate, int filterFlags) 
+        { return true; }
+    bool sendPlungerStatusQuadrature(int chA, int chB, int nIllegal, int speed,
+        uint32_t nEdges, uint32_t minPeriod, uint32_t avgHandler, uint32_t maxHandler) 
+        { return true; }
+    bool sendPlungerStatusVCNL4010(int filteredProxCount, int rawProxCount) 
+        { return true; }
+    bool sendPlungerFrameHeader(uint32_t t, uint32_t seq, int flags) 
+        { return true; }
+    bool sendPlungerFrameStats(
+        uint32_t nCaptured, uint32_t nProcessed, uint32_t nOverwritten,
+        const uint32_t *ageHist, int nAgeBuckets)
+        { return true; }
+    bool sendPlungerPix(int &idx, int npix, const uint8_t *pix) 
+        { idx = npix; return true; }
+    bool sendPlungerPixPacked(int &idx, int npix, const uint8_t *pix) 
+        { idx = npix; return true; }
+    bool reportRawBytes(const uint8_t *data, size_t len) 
+        { return true; }
+};
+
+#endif /* _HOSTTEST_USBJOYSTICK_H_ */
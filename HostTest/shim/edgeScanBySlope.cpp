@@ -0,0 +1,51 @@
+// Host version of the "steepest slope" edge scan
+//
+// The firmware implements this scan in assembly language, for speed (see
+// Plunger/edgeSensorScan2.s).  This is a line-by-line C++ translation of
+// the assembly routine, for host builds of the edge sensor code.  It 
+// follows the register usage of the original: a running total of the
+// right window sum minus the left window sum, over 10-pixel windows.
+
+#include "mbed.h"
+
+extern "C" int edgeScanBySlope(const uint8_t *pix, int npix, const uint8_t **edgep, int dir)
+{
+    // R0 = current pixel, R1 = end pixel, R4 = running total, R5 = minmax
+    const uint8_t *cur = pix;
+    const uint8_t *end = pix + npix - 20;
+    int minmax = 0;
+    const uint8_t *minmaxp = 0;
+    *edgep = 0;
+    
+    // figure the right sum minus the left sum at the first position
+    int total = 0;
+    for (int i = 0 ; i < 10 ; ++i)
+        total += cur[i + 10] - cur[i];
+        
+    // Scan for the steepest negative slope going forward, or the steepest
+    // positive slope going backward.  The assembly version updates the
+    // window after the last comparison as well, reading one pixel past the
+    // end of the array; that update is never used, so we skip it.
+    for (;;)
+    {
+        if (dir >= 0 ? total < minmax : total > minmax)
+        {
+            minmax = total;
+            minmaxp = cur;
+        }
+        
+        if (cur >= end)
+            break;
+            
+        total += cur[0];
+        total -= 2*cur[10];
+        total += cur[20];
+        ++cur;
+    }
+    
+    // if we found an edge, adjust for the window offset
+    if (minmax == 0)
+        return 0;
+    *edgep = minmaxp + 10;
+    return 1;
+}
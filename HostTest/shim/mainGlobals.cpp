@@ -0,0 +1,17 @@
+// Host build stand-ins for main program globals
+//
+// Some of the plunger code refers directly to globals defined in the main
+// program (main.cpp), which the host tests don't build.  We define them
+// here with their startup values.  Tests can change them as needed.
+
+#include "mbed.h"
+
+// plunger calibration mode flag
+bool plungerCalMode = false;
+
+// Free memory reported by the custom allocator (NewMalloc).  The host
+// allocator is the standard one, so this is only for code that checks
+// the free space before allocating optional buffers.  Tests can set it
+// to simulate a device that's short on memory.
+size_t hostMallocBytesFree = 8*1024;
+size_t mallocBytesFree() { return hostMallocBytesFree; }
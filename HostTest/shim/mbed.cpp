@@ -0,0 +1,91 @@
+// Host build stand-ins for the mbed library - out-of-line parts.
+// See mbed.h.
+
+#include <time.h>
+#include "mbed.h"
+#include "FastInterruptIn.h"
+
+// simulated ticker state
+static bool simTicker = false;
+static uint32_t simTime = 0;
+
+uint32_t us_ticker_read()
+{
+    if (simTicker)
+        return simTime;
+        
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint32_t(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+void hostSetTicker(uint32_t us)
+{
+    simTicker = true;
+    simTime = us;
+}
+
+// simulated CPU clock
+uint32_t SystemCoreClock = 48000000;
+static uint64_t simCycles = 0;
+
+void hostSetCycles(uint64_t cycles)
+{
+    simCycles = cycles;
+    hostSetTicker(uint32_t(cycles / (SystemCoreClock / 1000000)));
+}
+
+// SysTick state: the cycle count when the counter was last cleared, the
+// control bits, and the number of times the counter had reached zero as
+// of the last CTRL read, for COUNTFLAG
+HostSysTick hostSysTick;
+static uint64_t sysTickZero = 0;
+static uint32_t sysTickCtrl = 0;
+static uint64_t sysTickWrapsSeen = 0;
+
+// Figure the number of times the counter has reached zero since it was
+// cleared.  The counter reloads on the first clock after it's cleared, 
+// so it reaches zero every LOAD+1 clocks from the clearing.
+static uint64_t sysTickWraps()
+{
+    return (simCycles - sysTickZero) / (uint64_t(hostSysTick.LOAD & 0xFFFFFF) + 1);
+}
+
+HostSysTick::Val::operator uint32_t() const
+{
+    uint64_t k = simCycles - sysTickZero;
+    uint32_t load = hostSysTick.LOAD & 0xFFFFFF;
+    return k == 0 ? 0 : uint32_t(load - (k - 1) % (uint64_t(load) + 1));
+}
+
+HostSysTick::Val &HostSysTick::Val::operator=(uint32_t)
+{
+    sysTickZero = simCycles;
+    sysTickWrapsSeen = 0;
+    return *this;
+}
+
+HostSysTick::Ctrl::operator uint32_t() const
+{
+    uint32_t r = sysTickCtrl;
+    uint64_t w = sysTickWraps();
+    if (w != sysTickWrapsSeen)
+        r |= SysTick_CTRL_COUNTFLAG_Msk;
+    sysTickWrapsSeen = w;
+    return r;
+}
+
+HostSysTick::Ctrl &HostSysTick::Ctrl::operator=(uint32_t v)
+{
+    sysTickCtrl = v & ~SysTick_CTRL_COUNTFLAG_Msk;
+    return *this;
+}
+
+// list of interrupt pins, for hostSetPin()
+FastInterruptIn *FastInterruptIn::first = 0;
+
+void wait_us(int us)
+{
+    if (simTicker)
+        simTime += us;
+}
@@ -0,0 +1,172 @@
+// Host build stand-ins for the mbed library
+//
+// The host tests compile the firmware's plunger and sensor processing code
+// natively on the development machine.  That code only uses a few pieces
+// of the mbed library - mostly the Timer class and the pin names - so 
+// rather than trying to build mbed itself for the host, we provide simple
+// stand-ins for the parts we need here.  This isn't meant to emulate the
+// hardware; anything that talks to a real peripheral has to be replaced
+// with a test double in the test program itself.
+//
+// Time is based on a microsecond ticker, as on the device.  The ticker
+// follows the real clock by default.  A test can switch it to simulated
+// time with hostSetTicker(), to run time-dependent code deterministically.
+// For code that uses the SysTick counter, a test can instead set the 
+// simulated time in CPU clock cycles with hostSetCycles().
+
+#ifndef _HOSTTEST_MBED_H_
+#define _HOSTTEST_MBED_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// KL25Z pin names, with the same encoding as the mbed target library
+#define PORT_SHIFT  12
+#define PORTPIN(port, pin)  (((port) << PORT_SHIFT) | ((pin) << 2))
+typedef enum
+{
+    PTA0 = PORTPIN(0, 0), PTA1 = PORTPIN(0, 1), PTA2 = PORTPIN(0, 2), PTA3 = PORTPIN(0, 3), PTA4 = PORTPIN(0, 4), PTA5 = PORTPIN(0, 5), PTA6 = PORTPIN(0, 6), PTA7 = PORTPIN(0, 7),
+    PTA8 = PORTPIN(0, 8), PTA9 = PORTPIN(0, 9), PTA10 = PORTPIN(0, 10), PTA11 = PORTPIN(0, 11), PTA12 = PORTPIN(0, 12), PTA13 = PORTPIN(0, 13), PTA14 = PORTPIN(0, 14), PTA15 = PORTPIN(0, 15),
+    PTA16 = PORTPIN(0, 16), PTA17 = PORTPIN(0, 17), PTA18 = PORTPIN(0, 18), PTA19 = PORTPIN(0, 19), PTA20 = PORTPIN(0, 20), PTA21 = PORTPIN(0, 21), PTA22 = PORTPIN(0, 22), PTA23 = PORTPIN(0, 23),
+    PTA24 = PORTPIN(0, 24), PTA25 = PORTPIN(0, 25), PTA26 = PORTPIN(0, 26), PTA27 = PORTPIN(0, 27), PTA28 = PORTPIN(0, 28), PTA29 = PORTPIN(0, 29), PTA30 = PORTPIN(0, 30), PTA31 = PORTPIN(0, 31),
+    PTB0 = PORTPIN(1, 0), PTB1 = PORTPIN(1, 1), PTB2 = PORTPIN(1, 2), PTB3 = PORTPIN(1, 3), PTB4 = PORTPIN(1, 4), PTB5 = PORTPIN(1, 5), PTB6 = PORTPIN(1, 6), PTB7 = PORTPIN(1, 7),
+    PTB8 = PORTPIN(1, 8), PTB9 = PORTPIN(1, 9), PTB10 = PORTPIN(1, 10), PTB11 = PORTPIN(1, 11), PTB12 = PORTPIN(1, 12), PTB13 = PORTPIN(1, 13), PTB14 = PORTPIN(1, 14), PTB15 = PORTPIN(1, 15),
+    PTB16 = PORTPIN(1, 16), PTB17 = PORTPIN(1, 17), PTB18 = PORTPIN(1, 18), PTB19 = PORTPIN(1, 19), PTB20 = PORTPIN(1, 20), PTB21 = PORTPIN(1, 21), PTB22 = PORTPIN(1, 22), PTB23 = PORTPIN(1, 23),
+    PTB24 = PORTPIN(1, 24), PTB25 = PORTPIN(1, 25), PTB26 = PORTPIN(1, 26), PTB27 = PORTPIN(1, 27), PTB28 = PORTPIN(1, 28), PTB29 = PORTPIN(1, 29), PTB30 = PORTPIN(1, 30), PTB31 = PORTPIN(1, 31),
+    PTC0 = PORTPIN(2, 0), PTC1 = PORTPIN(2, 1), PTC2 = PORTPIN(2, 2), PTC3 = PORTPIN(2, 3), PTC4 = PORTPIN(2, 4), PTC5 = PORTPIN(2, 5), PTC6 = PORTPIN(2, 6), PTC7 = PORTPIN(2, 7),
+    PTC8 = PORTPIN(2, 8), PTC9 = PORTPIN(2, 9), PTC10 = PORTPIN(2, 10), PTC11 = PORTPIN(2, 11), PTC12 = PORTPIN(2, 12), PTC13 = PORTPIN(2, 13), PTC14 = PORTPIN(2, 14), PTC15 = PORTPIN(2, 15),
+    PTC16 = PORTPIN(2, 16), PTC17 = PORTPIN(2, 17), PTC18 = PORTPIN(2, 18), PTC19 = PORTPIN(2, 19), PTC20 = PORTPIN(2, 20), PTC21 = PORTPIN(2, 21), PTC22 = PORTPIN(2, 22), PTC23 = PORTPIN(2, 23),
+    PTC24 = PORTPIN(2, 24), PTC25 = PORTPIN(2, 25), PTC26 = PORTPIN(2, 26), PTC27 = PORTPIN(2, 27), PTC28 = PORTPIN(2, 28), PTC29 = PORTPIN(2, 29), PTC30 = PORTPIN(2, 30), PTC31 = PORTPIN(2, 31),
+    PTD0 = PORTPIN(3, 0), PTD1 = PORTPIN(3, 1), PTD2 = PORTPIN(3, 2), PTD3 = PORTPIN(3, 3), PTD4 = PORTPIN(3, 4), PTD5 = PORTPIN(3, 5), PTD6 = PORTPIN(3, 6), PTD7 = PORTPIN(3, 7),
+    PTD8 = PORTPIN(3, 8), PTD9 = PORTPIN(3, 9), PTD10 = PORTPIN(3, 10), PTD11 = PORTPIN(3, 11), PTD12 = PORTPIN(3, 12), PTD13 = PORTPIN(3, 13), PTD14 = PORTPIN(3, 14), PTD15 = PORTPIN(3, 15),
+    PTD16 = PORTPIN(3, 16), PTD17 = PORTPIN(3, 17), PTD18 = PORTPIN(3, 18), PTD19 = PORTPIN(3, 19), PTD20 = PORTPIN(3, 20), PTD21 = PORTPIN(3, 21), PTD22 = PORTPIN(3, 22), PTD23 = PORTPIN(3, 23),
+    PTD24 = PORTPIN(3, 24), PTD25 = PORTPIN(3, 25), PTD26 = PORTPIN(3, 26), PTD27 = PORTPIN(3, 27), PTD28 = PORTPIN(3, 28), PTD29 = PORTPIN(3, 29), PTD30 = PORTPIN(3, 30), PTD31 = PORTPIN(3, 31),
+    PTE0 = PORTPIN(4, 0), PTE1 = PORTPIN(4, 1), PTE2 = PORTPIN(4, 2), PTE3 = PORTPIN(4, 3), PTE4 = PORTPIN(4, 4), PTE5 = PORTPIN(4, 5), PTE6 = PORTPIN(4, 6), PTE7 = PORTPIN(4, 7),
+    PTE8 = PORTPIN(4, 8), PTE9 = PORTPIN(4, 9), PTE10 = PORTPIN(4, 10), PTE11 = PORTPIN(4, 11), PTE12 = PORTPIN(4, 12), PTE13 = PORTPIN(4, 13), PTE14 = PORTPIN(4, 14), PTE15 = PORTPIN(4, 15),
+    PTE16 = PORTPIN(4, 16), PTE17 = PORTPIN(4, 17), PTE18 = PORTPIN(4, 18), PTE19 = PORTPIN(4, 19), PTE20 = PORTPIN(4, 20), PTE21 = PORTPIN(4, 21), PTE22 = PORTPIN(4, 22), PTE23 = PORTPIN(4, 23),
+    PTE24 = PORTPIN(4, 24), PTE25 = PORTPIN(4, 25), PTE26 = PORTPIN(4, 26), PTE27 = PORTPIN(4, 27), PTE28 = PORTPIN(4, 28), PTE29 = PORTPIN(4, 29), PTE30 = PORTPIN(4, 30), PTE31 = PORTPIN(4, 31),
+
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+// Microsecond ticker.  This reads the real clock unless the test has set
+// a simulated time with hostSetTicker().
+uint32_t us_ticker_read();
+
+// Switch the ticker to simulated time, and set the current time
+void hostSetTicker(uint32_t us);
+
+// Switch the ticker to simulated time, and set the current time in CPU
+// clock cycles.  This also drives the SysTick stand-in below.
+void hostSetCycles(uint64_t cycles);
+
+// CPU clock rate, as on the KL25Z
+extern uint32_t SystemCoreClock;
+
+// SysTick counter.  As on the hardware, the counter counts down from
+// LOAD at the CPU clock rate (in simulated time), writing VAL clears the
+// counter and COUNTFLAG, and reading CTRL returns COUNTFLAG and clears 
+// it.  COUNTFLAG is set each time the counter reaches zero.  VAL and CTRL
+// are proxies, so that reading them can have those side effects.
+#define SysTick_CTRL_ENABLE_Msk     (1UL << 0)
+#define SysTick_CTRL_CLKSOURCE_Msk  (1UL << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk  (1UL << 16)
+struct HostSysTick
+{
+    struct Val
+    {
+        operator uint32_t() const;
+        Val &operator=(uint32_t v);
+    };
+    struct Ctrl
+    {
+        operator uint32_t() const;
+        Ctrl &operator=(uint32_t v);
+    };
+    
+    Ctrl CTRL;
+    uint32_t LOAD;
+    Val VAL;
+};
+extern HostSysTick hostSysTick;
+#define SysTick (&hostSysTick)
+
+// Interrupt masking is a no-op on the host, since the tests are single-
+// threaded
+inline void __disable_irq() { }
+inline void __enable_irq() { }
+
+// Busy-wait delays - these just advance the simulated clock, if it's
+// in use
+void wait_us(int us);
+inline void wait_ms(int ms) { wait_us(ms * 1000); }
+inline void wait(float s) { wait_us(int(s * 1.0e6f)); }
+
+// Timer.  Like the mbed Timer, this only accumulates time while it's
+// running.
+class Timer
+{
+public:
+    Timer() : running(false), t0(0), acc(0) { }
+    
+    void start()
+    {
+        if (!running)
+        {
+            t0 = us_ticker_read();
+            running = true;
+        }
+    }
+    
+    void stop()
+    {
+        if (running)
+        {
+            acc += us_ticker_read() - t0;
+            running = false;
+        }
+    }
+    
+    void reset()
+    {
+        acc = 0;
+        t0 = us_ticker_read();
+    }
+    
+    uint32_t read_us() { return running ? acc + (us_ticker_read() - t0) : acc; }
+    int read_ms() { return read_us() / 1000; }
+    float read() { return read_us() / 1.0e6f; }
+    
+protected:
+    bool running;
+    uint32_t t0;
+    uint32_t acc;
+};
+
+// Digital pins.  Outputs remember the last value written; inputs read as
+// whatever the test sets in 'value'.
+class DigitalOut
+{
+public:
+    DigitalOut(PinName, int v = 0) : value(v) { }
+    void write(int v) { value = v; }
+    int read() { return value; }
+    DigitalOut &operator=(int v) { value = v; return *this; }
+    operator int() { return value; }
+    int value;
+};
+
+class DigitalIn
+{
+public:
+    DigitalIn(PinName) : value(0) { }
+    int read() { return value; }
+    operator int() { return value; }
+    int value;
+};
+
+#endif /* _HOSTTEST_MBED_H_ */
@@ -0,0 +1,53 @@
+// Image sensor test double
+//
+// A PlungerSensorImageInterface implementation for the host tests.  The
+// test draws each frame into the buffer returned by frame(), then lets
+// the sensor code read it as though the sensor had just captured it.
+// The buffer can be placed at any byte alignment, so that tests can
+// exercise code that reads pixels a word at a time.
+
+#ifndef _HOSTTEST_TESTFRAMESOURCE_H_
+#define _HOSTTEST_TESTFRAMESOURCE_H_
+
+#include "plunger.h"
+
+class TestFrameSource: public PlungerSensorImageInterface
+{
+public:
+    TestFrameSource(int npix, int align = 0) : PlungerSensorImageInterface(npix)
+    {
+        // allocate word-aligned storage with room to offset the frame
+        buf = new uint32_t[(npix + 16)/4 + 1];
+        memset(buf, 0, ((npix + 16)/4 + 1)*4);
+        pix = reinterpret_cast<uint8_t*>(buf) + (align & 3);
+        t = 0;
+        scanTime = 2500;
+    }
+    
+    ~TestFrameSource() { delete [] buf; }
+    
+    // get the buffer for the next frame
+    uint8_t *frame() { return pix; }
+    
+    // set the timestamp for the next frame
+    void setTime(uint32_t t) { this->t = t; }
+    
+    virtual void init() { }
+    virtual bool ready() { return true; }
+    virtual void readPix(uint8_t* &pix, uint32_t &t) { pix = this->pix; t = this->t; }
+    virtual void releasePix() { }
+    virtual uint32_t getAvgScanTime() { return scanTime; }
+    virtual void setMinIntTime(uint32_t us) { }
+    
+    // frame buffer
+    uint32_t *buf;
+    uint8_t *pix;
+    
+    // frame timestamp
+    uint32_t t;
+    
+    // average scan time to report
+    uint32_t scanTime;
+};
+
+#endif /* _HOSTTEST_TESTFRAMESOURCE_H_ */
@@ -0,0 +1,107 @@
+// Host test utilities
+//
+// Common helpers for the host test programs: a deterministic random
+// number generator, so that every run of a test sees the same data; a
+// wall clock for the benchmarks; synthetic image sensor frames; and
+// simple pass/fail bookkeeping.
+
+#ifndef _HOSTTEST_TESTUTIL_H_
+#define _HOSTTEST_TESTUTIL_H_
+
+#include <stdarg.h>
+#include <time.h>
+#include "mbed.h"
+
+// Deterministic pseudo-random numbers (xorshift32)
+class TestRand
+{
+public:
+    TestRand(uint32_t seed) : s(seed != 0 ? seed : 1) { }
+    
+    uint32_t next()
+    {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        return s;
+    }
+    
+    // random integer in lo..hi, inclusive
+    int range(int lo, int hi) { return lo + int(next() % uint32_t(hi - lo + 1)); }
+    
+    // approximately Gaussian noise, with standard deviation 'sigma'
+    double gauss(double sigma)
+    {
+        double a = 0;
+        for (int i = 0 ; i < 12 ; ++i)
+            a += (next() & 0xFFFF) / 65536.0;
+        return (a - 6.0) * sigma;
+    }
+    
+protected:
+    uint32_t s;
+};
+
+// Wall clock time in seconds, for benchmarks
+inline double testClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+// Draw a synthetic edge sensor frame.  The image is bright from the 
+// sensor's starting end up to the shadow edge at pixel 'edge', and dark
+// beyond it, with a linear ramp 'blur' pixels wide between the two
+// levels, centered on the edge, to simulate the penumbra and motion blur.
+// If 'dir' is negative, the image is reversed, as though the sensor were
+// installed the other way around.  'noise' adds random noise of up to
+// that many units per pixel.
+inline void synthEdgeFrame(uint8_t *pix, int n, int edge, int blur, 
+    int bright, int dark, int noise, int dir, TestRand &rng)
+{
+    if (blur < 1)
+        blur = 1;
+    for (int i = 0 ; i < n ; ++i)
+    {
+        int d = i - edge + blur/2;
+        int v = d < 0 ? bright : d >= blur ? dark : bright + (dark - bright)*d/blur;
+        if (noise != 0)
+            v += rng.range(-noise, noise);
+        v = v < 0 ? 0 : v > 255 ? 255 : v;
+        pix[dir < 0 ? n - 1 - i : i] = uint8_t(v);
+    }
+}
+
+// Test result bookkeeping.  check() counts a test case, and reports it
+// if it failed; we only show the first few failures in detail, to keep 
+// one systematic error from burying the rest of the output.
+static int testChecks = 0;
+static int testFailures = 0;
+
+inline bool check(bool ok, const char *fmt, ...)
+{
+    ++testChecks;
+    if (!ok)
+    {
+        if (++testFailures <= 20)
+        {
+            va_list va;
+            va_start(va, fmt);
+            printf("FAIL: ");
+            vprintf(fmt, va);
+            printf("\n");
+            va_end(va);
+        }
+    }
+    return ok;
+}
+
+// Print the summary for a test program, and return its exit status
+inline int testSummary(const char *name)
+{
+    printf("%s: %d checks, %d failures\n", name, testChecks, testFailures);
+    return testFailures == 0 ? 0 : 1;
+}
+
+#endif /* _HOSTTEST_TESTUTIL_H_ */
@@ -0,0 +1,178 @@
+// Plunger trace generator
+//
+// Writes the synthetic plunger position traces in traces/, in the trace
+// replay format (see Plunger/traceReplay.h).  The traces simulate the 
+// motions that the firing event logic has to tell apart: full and 
+// partial releases, with the plunger bouncing off the barrel spring
+// before it settles, a slow pull and return, and a push forward of the
+// park position.  A release is modeled as the main spring driving the
+// plunger forward as a harmonic oscillator, reaching the park position
+// 25ms after release at about 2600 joystick units per centisecond, 
+// followed by a damped oscillation around the park position as the 
+// barrel spring stops it.  Manual motions follow a smooth ease-in/out 
+// curve.  Each sample gets Gaussian sensor noise and a little timing
+// jitter, from a fixed random seed, so the output is the same on every
+// run.
+//
+// The traces are checked in, so this only has to be run to change them
+// ("make traces").  Note that the tests' expected results depend on the
+// trace contents, so they have to be updated to match.
+//
+// Usage: traceGen <output directory>
+
+#include "testUtil.h"
+
+// Calibration for the traces, on the raw 0..65535 scale
+static const int calZero = 10922, calMax = 60000;
+
+// Trace writer.  Positions are in joystick units, 0 = park, 4096 = 
+// maximum retraction.
+class TraceWriter
+{
+public:
+    TraceWriter(const char *dir, const char *name, uint32_t period, double noise, uint32_t seed) :
+        period(period), noise(noise), rng(seed), t(1000000), x(0)
+    {
+        char fname[256];
+        sprintf(fname, "%s/%s", dir, name);
+        fp = fopen(fname, "wb");
+        if (fp == 0)
+        {
+            printf("can't create %s\n", fname);
+            exit(2);
+        }
+        uint8_t hdr[8] = { 'P', 'T', 'R', 'C', 
+            uint8_t(calZero), uint8_t(calZero >> 8), uint8_t(calMax), uint8_t(calMax >> 8) };
+        fwrite(hdr, 1, 8, fp);
+    }
+    
+    ~TraceWriter() { fclose(fp); }
+    
+    // hold the current position for the given time
+    void hold(int ms)
+    {
+        for (double t0 = t ; t - t0 < ms*1000.0 ; )
+            sample(x);
+    }
+    
+    // move to a new position over the given time, easing in and out
+    void move(double to, int ms)
+    {
+        double from = x, t0 = t, dur = ms*1000.0;
+        while (t - t0 < dur)
+            sample(from + (to - from)*(1.0 - cos(M_PI*(t - t0)/dur))/2.0);
+        x = to;
+    }
+    
+    // release the plunger from the current position, and follow it for
+    // the given time
+    void release(int ms)
+    {
+        const double w1 = M_PI/2.0/25000.0;     // main spring, rad/us
+        const double w2 = M_PI/2.0/6000.0;      // barrel spring, rad/us
+        const double zeta = 0.3;                // barrel spring damping
+        const double wd = w2*sqrt(1.0 - zeta*zeta);
+        double x0 = x, t0 = t, tHit = 0, v0 = 0;
+        bool hit = false;
+        while (t - t0 < ms*1000.0)
+        {
+            double dt = t - t0;
+            if (!hit && dt < M_PI/2.0/w1)
+                x = x0*cos(w1*dt);
+            else
+            {
+                // past the park position: bounce off the barrel spring
+                if (!hit)
+                {
+                    hit = true;
+                    tHit = t0 + M_PI/2.0/w1;
+                    v0 = -x0*w1;
+                }
+                double th = t - tHit;
+                x = v0/wd*exp(-zeta*w2*th)*sin(wd*th);
+            }
+            sample(x);
+        }
+        x = 0;
+    }
+    
+protected:
+    // write a sample at the current time, and advance the time
+    void sample(double pos)
+    {
+        double raw = calZero + (pos + rng.gauss(noise))*(calMax - calZero)/4096.0;
+        int r = int(floor(raw + 0.5));
+        r = r < 0 ? 0 : r > 65535 ? 65535 : r;
+        uint32_t ts = uint32_t(t);
+        uint8_t rec[6] = { uint8_t(ts), uint8_t(ts >> 8), uint8_t(ts >> 16), uint8_t(ts >> 24),
+            uint8_t(r), uint8_t(r >> 8) };
+        fwrite(rec, 1, 6, fp);
+        t += period + rng.range(-int(period/50), int(period/50));
+    }
+    
+    FILE *fp;
+    uint32_t period;
+    double noise;
+    TestRand rng;
+    double t;
+    double x;
+};
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        printf("usage: traceGen <output directory>\n");
+        return 2;
+    }
+    const char *dir = argv[1];
+    
+    // full release, image sensor timing
+    {
+        TraceWriter w(dir, "releaseFull.ptrc", 2500, 1.5, 0x1001);
+        w.hold(300);
+        w.move(4096, 800);
+        w.hold(300);
+        w.release(500);
+    }
+    
+    // partial release
+    {
+        TraceWriter w(dir, "releaseHalf.ptrc", 2500, 1.5, 0x1002);
+        w.hold(300);
+        w.move(2000, 600);
+        w.hold(200);
+        w.release(500);
+    }
+    
+    // full release, with the faster, quieter timing of a quadrature sensor
+    {
+        TraceWriter w(dir, "releaseFast.ptrc", 1000, 0.5, 0x1003);
+        w.hold(300);
+        w.move(4096, 800);
+        w.hold(300);
+        w.release(500);
+    }
+    
+    // slow pull and slow return - not a firing event
+    {
+        TraceWriter w(dir, "slowReturn.ptrc", 2500, 1.5, 0x1004);
+        w.hold(300);
+        w.move(3500, 700);
+        w.hold(300);
+        w.move(0, 900);
+        w.hold(300);
+    }
+    
+    // push forward of the park position and let go
+    {
+        TraceWriter w(dir, "pushForward.ptrc", 2500, 1.5, 0x1005);
+        w.hold(300);
+        w.move(-600, 300);
+        w.hold(200);
+        w.move(0, 300);
+        w.hold(300);
+    }
+    
+    return 0;
+}
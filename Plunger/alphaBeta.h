@@ -0,0 +1,174 @@
+// Alpha-beta plunger motion estimator
+//
+// This is a simple two-state tracking filter (position and velocity)
+// for the calibrated plunger readings.  On each new sample, we project
+// the previous estimate forward to the sample time using the estimated
+// velocity, then correct the position and velocity by fixed fractions
+// (alpha and beta) of the difference between the prediction and the
+// new reading.  The prediction step uses the actual time between
+// samples, so the filter works at whatever rate the sensor produces
+// readings, and it produces a new position and velocity estimate on
+// every sample.
+//
+// Compared to the three-point slope that PlungerReader uses by default,
+// this gives steadier speed readings at low speeds, where the position
+// only changes by a unit or two between samples, and it doesn't have
+// the inherent one-sample delay of the centered slope, since the
+// estimate applies to the newest sample rather than the middle one.
+// The trade-off is some smoothing lag, controlled by the filter time
+// constant: shorter times track the raw readings more tightly, longer
+// times filter more heavily.  A conventional alpha-beta filter uses
+// fixed gains per sample, which makes its response depend on the
+// sample rate - and our sensors range from about 1ms to 15ms per
+// sample.  So instead, we figure alpha on each sample from the time
+// since the last one, as alpha = dt/(dt + tau).  That gives roughly
+// the same response in real time at any sample rate.  We then derive
+// beta from alpha using the critical damping relation, beta = 2 - alpha
+// - 2*sqrt(1 - alpha), which is the same as (1 - sqrt(1 - alpha))^2.
+// That puts both of the filter's poles at the same real value, so the
+// estimate settles after a sudden change in speed (such as the plunger
+// hitting the end of its travel) without ringing.  (The other common 
+// choice, the Benedict-Bordner relation beta = alpha^2/(2 - alpha), is
+// tuned for noise reduction instead, and is slightly underdamped, so it
+// overshoots and swings back.)
+//
+// All of the arithmetic is in fixed point, since the KL25Z has no FPU.
+// The position is in joystick units with 16 fraction bits, the velocity
+// is in joystick units per microsecond with 24 fraction bits, and the
+// gains have 16 fraction bits.
+
+#ifndef _ALPHABETA_H_
+#define _ALPHABETA_H_
+
+#include "mbed.h"
+
+class AlphaBetaFilter
+{
+public:
+    AlphaBetaFilter()
+    {
+        tau = defaultTau;
+        reset();
+    }
+    
+    // default time constant, in microseconds
+    static const uint32_t defaultTau = 2000;
+    
+    // Set the filter time constant, in microseconds.  0 selects the 
+    // default.
+    void setTimeConstant(uint32_t tau)
+    {
+        this->tau = (tau != 0 ? tau : defaultTau);
+    }
+    
+    // Reset the filter.  The next sample re-initializes the estimate.
+    void reset() 
+    { 
+        valid = false;
+        x = 0;
+        v = 0;
+        t = 0;
+    }
+    
+    // Add a new position sample, in joystick units, taken at time tNew
+    // (microseconds).
+    void update(int z, uint32_t tNew)
+    {
+        // If we don't have a prior estimate, or it's been too long since
+        // the last sample for the prediction to mean anything, start
+        // over at the new reading, at rest.
+        uint32_t dt = tNew - t;
+        if (!valid || dt == 0 || dt > maxDt)
+        {
+            x = int64_t(z) << 16;
+            v = 0;
+            t = tNew;
+            valid = true;
+            return;
+        }
+        
+        // project the prior estimate forward to the sample time
+        int64_t xPred = x + ((int64_t(v) * dt) >> 8);
+        
+        // figure the residual - the difference between the actual reading
+        // and the prediction
+        int64_t r = (int64_t(z) << 16) - xPred;
+        
+        // figure the gains for this time step
+        int32_t alpha, beta;
+        figureGains(dt, tau, alpha, beta);
+        
+        // correct the position and velocity by fractions of the residual
+        x = xPred + ((r * alpha) >> 16);
+        v += int32_t(((r * beta) >> 8) / int32_t(dt));
+        t = tNew;
+    }
+    
+    // Get the current position estimate, in joystick units
+    int getPosition() const { return int((x + 0x8000) >> 16); }
+    
+    // Get the current velocity estimate, in joystick units per 
+    // centisecond (the units PlungerReader uses for speed reports)
+    int getSpeed() const { return int((int64_t(v) * 10000) >> 24); }
+    
+protected:
+    // Figure the gains for a time step of dt microseconds, with time
+    // constant tau, in units of 2^-16.  alpha is dt/(dt + tau), and beta
+    // is the critically damped gain (1 - sqrt(1 - alpha))^2.
+    static void figureGains(uint32_t dt, uint32_t tau, int32_t &alpha, int32_t &beta)
+    {
+        alpha = int32_t((uint64_t(dt) << 16) / (dt + tau));
+        if (alpha < 1)
+            alpha = 1;
+        else if (alpha > 65535)
+            alpha = 65535;
+        
+        // sqrt(1 - alpha) in 2^-16 units is sqrt((1 - alpha) * 2^32)
+        uint32_t d = 65536 - isqrt(uint32_t(65536 - alpha) << 16);
+        beta = int32_t((d*d + 0x8000) >> 16);
+    }
+    
+    // Integer square root, rounded to the nearest integer
+    static uint32_t isqrt(uint32_t x)
+    {
+        // figure the root a bit at a time, from the highest bit down
+        uint32_t r = 0, bit = 1UL << 30;
+        while (bit > x)
+            bit >>= 2;
+        for ( ; bit != 0 ; bit >>= 2)
+        {
+            if (x >= r + bit)
+            {
+                x -= r + bit;
+                r = (r >> 1) + bit;
+            }
+            else
+                r >>= 1;
+        }
+        
+        // x is now the remainder from r^2, so round up if the root is
+        // past r + 1/2
+        return x > r ? r + 1 : r;
+    }
+    
+    // Maximum time between samples for the prediction.  If the gap 
+    // between samples is longer than this, we reset the filter.
+    static const uint32_t maxDt = 100000;
+    
+    // filter time constant, in microseconds
+    uint32_t tau;
+    
+    // is the estimate valid?
+    bool valid;
+
+    // estimated position, joystick units << 16
+    int64_t x;
+    
+    // estimated velocity, joystick units per microsecond << 24
+    int32_t v;
+    
+    // time of the last sample
+    uint32_t t;
+};
+
+#endif /* _ALPHABETA_H_ */
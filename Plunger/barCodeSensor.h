@@ -53,7 +53,9 @@
 // "island" size for a black or white bar horizontally.  Small features are
 // prone to light scattering that makes them appear gray on the sensor.
 // Larger features are less subject to scatter, making them easier to 
-// distinguish by brightness level.
+// distinguish by brightness level.  Unpopulated code points map to
+// grayToBinInvalid.
+static const int grayToBinInvalid = 128;
 static const uint8_t grayToBin[] = {
    0,   1,  83,   2,  71, 100,  84,   3,  69, 102,  82, 128,  70, 101,  57,   4,    // 0-15
   35,  50,  36,  37,  86,  87,  85, 128,  34, 103,  21, 104, 128, 128,  20,   5,    // 16-31
@@ -124,16 +126,31 @@ struct BarCodeProcessResult
     int pixofs;
     int raw;
     int mask;
+    int rejectRate;     // temporal filter rejection rate, in parts per 1000
+    int filterFlags;    // temporal filter flags for this frame (see USBProtocol.h)
 };
 
 template <int nBits, int leftBarWidth, int leftBarMaxOfs, int bitWidth>
 class PlungerSensorBarCode: public PlungerSensorImage<BarCodeProcessResult>
 {
+    // The Gray code table is for our custom 7-bit code, so make sure that
+    // the bit count matches it.  (This declares a negative-size array type,
+    // which is a compile error, if the sizes don't match.)
+    typedef char grayToBinSizeCheck[sizeof(grayToBin) == (1 << nBits) ? 1 : -1];
+    
 public:
     PlungerSensorBarCode(PlungerSensorImageInterface &sensor, int npix)
         : PlungerSensorImage(sensor, npix, (1 << nBits) - 1)
     {
         startOfs = 0;
+        useTemporalFilter = false;
+        
+        // clear the temporal filter history and statistics
+        nHist = 0;
+        nRejectRun = 0;
+        nMissed = 0;
+        nDecoded = 0;
+        nRejected = 0;
     }
 
     // process a configuration change
@@ -143,8 +160,9 @@ public:
         switch (varno)
         {
         case 20:
-            // bar code offset
+            // bar code offset and options
             startOfs = cfg.plunger.barCode.startPix;
+            useTemporalFilter = (cfg.plunger.barCode.flags & 0x01) != 0;
             break;
         }
         
@@ -153,9 +171,15 @@ public:
     }
 
 protected:
+    // the bit readers work on the prefix sums
+    virtual bool usesPixSums() const { return true; }
+    
     // process the image    
     virtual bool process(const uint8_t *pix, int npix, int &pos, BarCodeProcessResult &res)
     {
+        // this is a new frame, so any prefix sums are out of date
+        pixSums.invalidate();
+        
         // adjust auto-exposure
         adjustExposure(pix, npix);
         
@@ -163,6 +187,8 @@ protected:
         res.pixofs = 0;
         res.raw = 0;
         res.mask = 0;
+        res.filterFlags = 0;
+        res.rejectRate = 0;
         
 #if 0 // $$$
 
@@ -218,6 +244,13 @@ protected:
         return false;
 
 #else
+        // Get the prefix sums for the frame, for the window sums below.
+        // We can't read the code without them, so if there wasn't enough
+        // memory for the buffer at startup, we can't read the position.
+        if (!pixSums.isAllocated())
+            return false;
+        const PixelPrefixSum &ps = getPixSums(pix, npix);
+        
         int barStart = leftBarMaxOfs/2;
         if (leftBarWidth != 0) // $$$
         {
@@ -226,10 +259,7 @@ protected:
             // the average brightness over the left margin up to the maximum
             // allowable offset, then look for the bar by finding the first
             // bar-width run of pixels that are darker than the average.
-            int lsum = 0;
-            for (int x = 1 ; x <= leftBarMaxOfs ; ++x)
-                lsum += pix[x];
-            int lavg = lsum / leftBarMaxOfs;
+            int lavg = ps.sum(1, leftBarMaxOfs + 1) / leftBarMaxOfs;
     
             // now find the first dark edge
             for (int x = 0 ; x < leftBarMaxOfs ; ++x)
@@ -250,13 +280,254 @@ protected:
             barStart = startOfs;
         }
 
+        // decode the bar code
+        int barcode, mask;
+        bool ok = decode(ps, npix, barStart, pos, barcode, mask);
+        
+        // set the results descriptor structure
+        res.pixofs = barStart;
+        res.raw = barcode;
+        res.mask = mask;
+        
+        // If the temporal filter is enabled, check the reading against
+        // the recent history.  Skip this for status report frames, which 
+        // aren't part of the regular stream of readings, but still report
+        // the rejection rate including this frame.
+        if (useTemporalFilter)
+        {
+            if (!statusFrame)
+                ok = ok ? temporalFilter(ps, npix, barStart, pos, res) : noReading();
+            res.rejectRate = nDecoded != 0 ? nRejected * 1000 / nDecoded : 0;
+        }
+        
+        // return the decoding status
+        return ok;
+#endif
+    }
+    
+    // Decode the bar code starting at the given pixel.  Fills in the raw
+    // code bits, the mask of successfully read bits, and the decoded 
+    // position.  Returns true if we decoded all bits and the code is one
+    // of the populated code points.
+    bool decode(const PixelPrefixSum &ps, int npix, int barStart, int &pos, int &barcode, int &mask)
+    {
         // Start with zero in the barcode and success mask.  The mask
         // indicates which bits we were able to read successfully: a
         // '1' bit in the mask indicates that the corresponding bit
         // position in 'barcode' was successfully read, a '0' bit means
         // that the image was too fuzzy to read.
-        int barcode = 0, mask = 0;
+        barcode = 0;
+        mask = 0;
+
+        // If the whole code fits within the image, which is the normal
+        // case, read the bits with the unrolled reader.  Otherwise use
+        // the general loop, which clips the bits at the end of the image.
+        if (barStart + nBits*bitWidth <= npix)
+            readBits(ps, barStart, barcode, mask, BitIndex<0>());
+        else
+            readBitsClipped(ps, npix, barStart, barcode, mask);
+
+        // decode the Gray code value to binary
+        pos = grayToBin[barcode];
+    
+        // return success if we decoded all bits, and the Gray-to-binary
+        // mapping was populated
+        return pos != grayToBinInvalid && mask == ((1 << nBits) - 1);
+    }
+    
+    // Temporal consistency filter.  A bar code misread usually doesn't
+    // land anywhere near the true position, so it shows up as a spike in
+    // the position readings.  The spike is too big for the jitter filter
+    // to remove, and too brief to be real plunger motion.  So we check
+    // each good decode against the position predicted from the last two
+    // accepted readings, allowing for the change in speed that the 
+    // plunger could plausibly make in one frame.  If the new reading
+    // doesn't fit, we try decoding again with the bit phase shifted by a
+    // pixel or two, since the usual cause of a misread is locating the
+    // start of the code a little off.  If none of the shifted decodes
+    // fits either, we reject the frame.
+    //
+    // We only reject so many frames in a row, though.  If the readings
+    // consistently disagree with the history, the history must be what's
+    // wrong (e.g., the plunger moved while we weren't getting readings),
+    // so we accept the new reading and start over from there.
+    //
+    // Returns true if the reading is accepted, with 'pos' and 'res' 
+    // updated for the accepted reading.
+    bool temporalFilter(const PixelPrefixSum &ps, int npix, int barStart, int &pos, 
+        BarCodeProcessResult &res)
+    {
+        // count the decode
+        countDecode(false);
+        
+        // check the reading against the prediction
+        if (!plausible(pos))
+        {
+            // try the shifted phases
+            static const int shifts[] = { -1, 1, -2, 2 };
+            bool found = false;
+            for (size_t i = 0 ; i < sizeof(shifts)/sizeof(shifts[0]) && !found ; ++i)
+            {
+                int start = barStart + shifts[i];
+                int spos, sbarcode, smask;
+                if (start >= 0
+                    && decode(ps, npix, start, spos, sbarcode, smask)
+                    && plausible(spos))
+                {
+                    // this one fits - use it
+                    pos = spos;
+                    res.pixofs = start;
+                    res.raw = sbarcode;
+                    res.mask = smask;
+                    res.filterFlags |= 0x02;
+                    found = true;
+                }
+            }
+            
+            // if we didn't find a plausible decode, reject the frame,
+            // unless we've been rejecting frames for too long
+            if (!found)
+            {
+                if (++nRejectRun < maxRejectRun)
+                {
+                    countDecode(true);
+                    res.filterFlags |= 0x01;
+                    return false;
+                }
+                
+                // accept the reading, and restart the history from here
+                res.filterFlags |= 0x04;
+                nHist = 0;
+            }
+        }
+        
+        // add the reading to the history
+        hist[0] = hist[1];
+        hist[1] = pos;
+        if (nHist < 2)
+            ++nHist;
+        nRejectRun = 0;
+        nMissed = 0;
+        
+        // accepted
+        return true;
+    }
+    
+    // Note a frame with no valid decode.  The history goes stale if we
+    // go too long without a reading, since the plunger could have moved
+    // anywhere in the meantime.  Always returns false, for the caller's
+    // convenience.
+    bool noReading()
+    {
+        if (++nMissed > maxMissed)
+            nHist = 0;
+        return false;
+    }
+    
+    // Is a reading plausible, given the history?  We predict the new
+    // position by extrapolating the last two readings at constant speed,
+    // and allow a deviation from that of a fixed margin plus twice the
+    // current speed.  The speed allowance covers a full reversal, which
+    // the plunger does when it bounces off the barrel spring at the end
+    // of a release.  With fewer than two readings in the history, we 
+    // can't make a prediction, so we accept anything.
+    bool plausible(int pos) const
+    {
+        if (nHist < 2)
+            return true;
+        int v = hist[1] - hist[0];
+        int d = pos - (hist[1] + v);
+        if (d < 0) d = -d;
+        if (v < 0) v = -v;
+        return d <= maxDeviation + 2*v;
+    }
+    
+    // Count a decode in the rejection statistics.  We scale both counts
+    // down by half whenever the total reaches 64K, which keeps the rate
+    // weighted toward recent readings.
+    void countDecode(bool rejected)
+    {
+        if (rejected)
+            ++nRejected;
+        else if (++nDecoded >= 65536)
+        {
+            nDecoded >>= 1;
+            nRejected >>= 1;
+        }
+    }
+    
+    // Bit reader, unrolled at compile time.  We read the bits by template
+    // recursion on the bit index, so that the compiler generates straight-
+    // line code for the whole bar code, with each bit's half-bit window 
+    // offsets worked out from the template geometry parameters as 
+    // constants.  That eliminates the loop overhead, the per-bit window
+    // arithmetic, and the bounds checks, which process() does once for
+    // the whole code instead.  BitIndex<N> is just a type tag carrying the
+    // bit index for overload resolution; the non-template overload for
+    // BitIndex<nBits> ends the recursion.  (We can't use constexpr for
+    // this, since the mbed compiler only supports C++03.)
+    //
+    // This produces exactly the same results as readBitsClipped() for
+    // any code that lies entirely within the image.
+    template<int N> struct BitIndex { };
+    template<int bit> inline void readBits(
+        const PixelPrefixSum &ps, int barStart, int &barcode, int &mask, BitIndex<bit>)
+    {
+        // Figure the half-bit windows, relative to the start of the bar
+        // code.  As in readBitsClipped(), we skip the first and last pixel
+        // of each half-bit, and hew to the right if the width is odd.
+        enum
+        {
+            x0 = bit * bitWidth,
+            lStart = x0 + 1,
+            lEnd = x0 + bitWidth/2 - 1,
+            rStart = x0 + bitWidth - bitWidth/2 + 1,
+            rEnd = x0 + bitWidth - 1
+        };
+        readBit(ps.sum(barStart + lStart, barStart + lEnd),
+            ps.sum(barStart + rStart, barStart + rEnd), barcode, mask);
+            
+        // read the next bit
+        readBits(ps, barStart, barcode, mask, BitIndex<bit+1>());
+    }
+    inline void readBits(
+        const PixelPrefixSum &, int, int &, int &, BitIndex<nBits>) { }
+    
+    // Decode one bit from the pixel sums over its two half-bits, and
+    // shift it into the bar code and success mask.
+    static inline void readBit(int lsum, int rsum, int &barcode, int &mask)
+    {
+        // shift a zero bit into the code and success mask
+        barcode <<= 1;
+        mask <<= 1;
 
+        // Brightness difference required per pixel.  Higher values
+        // require greater contrast to make a reading, which reduces
+        // spurious readings at the cost of reducing the overall 
+        // success rate.  The right level depends on the quality of
+        // the optical system.  Setting this to zero makes us maximally
+        // tolerant of low-contrast images, allowing for the simplest
+        // optical system.  Our simple optical system suffers from
+        // poor focus, which in turn causes poor contrast in small
+        // features.
+        const int minDelta = 2;
+
+        // see if we could tell the difference in brightness
+        int delta = lsum - rsum;
+        if (delta < 0) delta = -delta;
+        if (delta > minDelta * bitWidth/2)
+        {
+            // got it - black/white = 0, white/black = 1
+            if (lsum > rsum) barcode |= 1;
+            mask |= 1;
+        }
+    }
+    
+    // General bit reader.  This reads the bits in a loop, clipping each
+    // bit's pixel window at the end of the image.  We only use this when
+    // the bar code runs past the end of the image.
+    void readBitsClipped(const PixelPrefixSum &ps, int npix, int barStart, int &barcode, int &mask)
+    {
         // Scan the bits
         for (int bit = 0, x0 = barStart; bit < nBits ; ++bit, x0 += bitWidth)
         {
@@ -300,51 +571,13 @@ protected:
             // could be contaminated with scattered light from the
             // adjacent half-bit.  On the right half, hew to the 
             // right side if the overall pixel width is odd. 
-            int lsum = 0, rsum = 0;
-            for (int x = x0 + 1 ; x < x1 - 1 ; ++x)
-                lsum += pix[x];
-            for (int x = x2 - halfBitWidth + 1 ; x < x2 - 1 ; ++x)
-                rsum += pix[x];
+            int lsum = ps.sum(x0 + 1, x1 - 1);
+            int rsum = ps.sum(x2 - halfBitWidth + 1, x2 - 1);
 #endif
                 
-            // shift a zero bit into the code and success mask
-            barcode <<= 1;
-            mask <<= 1;
-
-            // Brightness difference required per pixel.  Higher values
-            // require greater contrast to make a reading, which reduces
-            // spurious readings at the cost of reducing the overall 
-            // success rate.  The right level depends on the quality of
-            // the optical system.  Setting this to zero makes us maximally
-            // tolerant of low-contrast images, allowing for the simplest
-            // optical system.  Our simple optical system suffers from
-            // poor focus, which in turn causes poor contrast in small
-            // features.
-            const int minDelta = 2;
-
-            // see if we could tell the difference in brightness
-            int delta = lsum - rsum;
-            if (delta < 0) delta = -delta;
-            if (delta > minDelta * w/2)
-            {
-                // got it - black/white = 0, white/black = 1
-                if (lsum > rsum) barcode |= 1;
-                mask |= 1;
-            }
+            // decode the bit
+            readBit(lsum, rsum, barcode, mask);
         }
-
-        // decode the Gray code value to binary
-        pos = grayToBin[barcode];
-        
-        // set the results descriptor structure
-        res.pixofs = barStart;
-        res.raw = barcode;
-        res.mask = mask;
-    
-        // return success if we decoded all bits, and the Gray-to-binary
-        // mapping was populated
-        return pos != (1 << nBits) && mask == ((1 << nBits) - 1);
-#endif
     }
     
     // read a bar starting at the given pixel
@@ -419,7 +652,8 @@ protected:
     {
         // Send the bar code status report.  We use coding type 1 (Gray code,
         // Manchester pixel coding).
-        js.sendPlungerStatusBarcode(nBits, 1, res.pixofs, bitWidth, res.raw, res.mask);
+        js.sendPlungerStatusBarcode(nBits, 1, res.pixofs, bitWidth, res.raw, res.mask,
+            res.rejectRate, res.filterFlags);
     }
     
     // adjust the exposure
@@ -581,6 +815,33 @@ protected:
 
     // bar code starting pixel offset
     int startOfs;
+    
+    // is the temporal filter enabled?
+    bool useTemporalFilter;
+    
+    // Temporal filter limits.  maxDeviation is the basic allowance, in 
+    // code positions, for the difference between the predicted and 
+    // actual readings.  maxRejectRun is the number of consecutive frames
+    // we'll reject before deciding the history is wrong, and maxMissed is
+    // the number of consecutive frames without a valid decode before we
+    // consider the history stale.
+    static const int maxDeviation = 4;
+    static const int maxRejectRun = 4;
+    static const int maxMissed = 8;
+    
+    // Temporal filter history: the last two accepted positions (hist[1]
+    // is the most recent), and the number of valid entries.
+    int hist[2];
+    int nHist;
+    
+    // number of consecutive frames rejected, and consecutive frames with
+    // no valid decode
+    int nRejectRun;
+    int nMissed;
+    
+    // rejection statistics: valid decodes, and decodes rejected
+    uint32_t nDecoded;
+    uint32_t nRejected;
 };
 
 #endif
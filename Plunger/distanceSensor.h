@@ -53,12 +53,23 @@
 // a non-contact sensor, and it's easy to set up (since no mechanical
 // connection to the plunger is needed).
 //
+// The VL6180X can be read in two ways.  By default, we use single-shot
+// mode, polling the sensor over I2C from the main loop to see when each
+// reading is done.  If the sensor's GPIO1 pin is connected, we instead
+// put the sensor into continuous ranging mode, where it takes readings
+// on its own at a fixed 10ms interval and signals each new reading on
+// GPIO1.  We take that as an interrupt, noting the time, so the main loop
+// doesn't have to spend any I2C traffic on polling, and the timestamps
+// are evenly spaced at the sensor's actual sampling times rather than 
+// at whenever the main loop happened to notice the new reading.  That
+// makes for cleaner speed calculations.
 //
 
 #ifndef _DISTANCESENSOR_H_
 #define _DISTANCESENSOR_H_
 
 #include "plunger.h"
+#include "FastInterruptIn.h"
 #include "VL6180X.h"
 #include "VCNL4010.h"
 
@@ -99,10 +110,27 @@ protected:
 class PlungerSensorVL6180X: public PlungerSensorDistance
 {
 public:
-    PlungerSensorVL6180X(PinName sda, PinName scl, PinName gpio0)
+    PlungerSensorVL6180X(PinName sda, PinName scl, PinName gpio0, PinName gpio1)
         : PlungerSensorDistance(150),
           sensor(sda, scl, I2C_ADDRESS, gpio0, true)
     {
+        // no reading yet
+        last.pos = 0;
+        last.t = 0;
+        lastErr = -1;
+        
+        // set up the data-ready interrupt on GPIO1, if it's connected
+        irq = 0;
+        nReady = nRead = 0;
+        tReady = tPrvReady = 0;
+        if (gpio1 != NC)
+        {
+            irq = new FastInterruptIn(gpio1);
+            irq->mode(PullUp);
+        }
+        
+        // start the interrupt timestamp timer
+        timer.start();
     }
     
     // fixed I2C bus address for the VL6180X
@@ -114,12 +142,26 @@ public:
         sensor.init();
         sensor.setDefaults();
         
-        // start a reading
-        sensor.startRangeReading();
+        if (irq != 0)
+        {
+            // GPIO1 is connected - start continuous mode, with GPIO1 as
+            // the data-ready interrupt
+            irq->fall(&PlungerSensorVL6180X::onDataReady, this);
+            sensor.continuousDistanceMode(true);
+        }
+        else
+        {
+            // no interrupt - start a single-shot reading
+            sensor.startRangeReading();
+        }
     }
     
     virtual bool ready()
     {
+        // in continuous mode, check for a data-ready interrupt
+        if (irq != 0)
+            return nReady != nRead || interruptOverdue();
+        
         // make sure a reading has been initiated
         sensor.startRangeReading();
         
@@ -129,6 +171,10 @@ public:
     
     virtual bool readRaw(PlungerReading &r)
     {
+        // use the interrupt-driven read in continuous mode
+        if (irq != 0)
+            return readRawContinuous(r);
+            
         // if we have a new reading ready, collect it
         if (sensor.rangeReady())
         {
@@ -162,12 +208,81 @@ public:
     }
     
 protected:
+    // Read the sensor in continuous mode
+    bool readRawContinuous(PlungerReading &r)
+    {
+        // Check for a new data-ready interrupt.  If we haven't had one in 
+        // a while, the sensor might have raised the interrupt before our 
+        // handler was ready, in which case GPIO1 will be stuck low until 
+        // we read the result, so check the sensor directly.
+        uint32_t n = nReady;
+        if (n != nRead || (interruptOverdue() && sensor.rangeReady()))
+        {
+            // Get the interrupt time.  If this is a recovered reading,
+            // with no interrupt, use the current time instead.
+            uint32_t t = (n != nRead ? tReady : timer.read_us());
+            
+            // read the result
+            uint8_t d;
+            lastErr = sensor.readRangeResult(d);
+            if (lastErr == 0)
+            {
+                // Save the new reading.  The interrupt marks the end of
+                // the sample collection period, so back up by half of
+                // the collection time to get the midpoint.
+                last.pos = d;
+                last.t = t - VL6180X::nominalSampleTime()/2;
+                
+                // collect scan time statistics, using the interval 
+                // between readings
+                collectScanTimeStats(t - tPrvReady);
+            }
+            
+            // note the reading time, and mark the interrupt as handled
+            tPrvReady = t;
+            nRead = n;
+        }
+        
+        // return the most recent reading
+        r = last;
+        return lastErr == 0;
+    }
+    
+    // Is the next data-ready interrupt overdue?  The sensor takes readings
+    // every 10ms in continuous mode, so if we haven't seen one in 50ms,
+    // something's wrong.
+    bool interruptOverdue() { return timer.read_us() - tPrvReady > 50000; }
+    
+    // data-ready interrupt handler
+    static void onDataReady(void *obj)
+    {
+        PlungerSensorVL6180X *self = (PlungerSensorVL6180X *)obj;
+        self->tReady = self->timer.read_us();
+        self->nReady += 1;
+    }
+    
     // underlying sensor interface
     VL6180X sensor;
     
     // last reading and error status
     PlungerReading last;
     int lastErr;
+    
+    // Data-ready interrupt input on the sensor's GPIO1 pin, if connected
+    FastInterruptIn *irq;
+    
+    // Data-ready interrupt counter and timestamp.  The interrupt handler
+    // increments nReady and records the time; the main loop compares
+    // nReady to nRead to detect new readings.
+    volatile uint32_t nReady;
+    volatile uint32_t tReady;
+    uint32_t nRead;
+    
+    // time of the previous reading
+    uint32_t tPrvReady;
+    
+    // timer for interrupt timestamps
+    Timer timer;
 };
 
 
@@ -42,6 +42,8 @@ public:
         // initialize scan method variables
         prvRawResult0 = 0;
         prvRawResult1 = 0;
+        trackValid = false;
+        trackSlope = 0;
 
         // initialization for variables used only in old scan methods
         // midptIdx = 0;
@@ -60,6 +62,20 @@ public:
     //
     bool process(const uint8_t *pix, int n, int &pos, int &processResult)
     {
+        // this is a new frame, so any prefix sums are out of date
+        pixSums.invalidate();
+        
+        // Update the auto-exposure with the levels at the two ends of
+        // the image.  One end is the open area and the other is in the
+        // plunger's shadow, so the brighter end gives us the bright level
+        // and the darker end the dark level, whatever the orientation.
+        int a = (int(pix[0]) + pix[1] + pix[2] + pix[3] + pix[4]);
+        int b = (int(pix[n-1]) + pix[n-2] + pix[n-3] + pix[n-4] + pix[n-5]);
+        if (a > b)
+            autoExposure(a/5, b/5);
+        else
+            autoExposure(b/5, a/5);
+            
         // call the selected scan method implementation
         return (this->*scanMethodFunc)(pix, n, pos, processResult);
     }
@@ -73,13 +89,34 @@ public:
             // We use param1 to select the scan mode.  Update to the new mode.
             setScanMode(cfg.plunger.param1);
             break;
+            
+        case 24:
+            // image sensor options - enable/disable sub-pixel interpolation
+            setSubPixel((cfg.plunger.image.flags & 0x01) != 0);
+            break;
         }
 
         // inherit the default handling
         PlungerSensorImage::onConfigChange(varno, cfg);
     }
 
-    // Set the scan mode
+    // Set the scan mode.  The available modes are:
+    //
+    //   0 = steady slope (scanBySteadySlope) - the default
+    //   1 = steepest slope (scanBySteepestSlope)
+    //   2 = slope across gap (scanBySlopeAcrossGap)
+    //   3 = tracking slope across gap (scanByTrackingGap)
+    //   4 = slope across gap, packed kernel (scanBySlopeAcrossGapPacked)
+    //   5 = coarse-to-fine slope across gap (scanByCoarseToFine)
+    //
+    // In diagnostic builds, the average processing time per frame for the
+    // current mode can be read through diagnostic variable 220, index 31
+    // (see USBProtocol.h), which makes it easy to compare the modes on a
+    // live sensor.
+    //
+    // Mode 5 needs the prefix sum buffer, which init() only allocates if
+    // mode 5 is selected at startup, and only if there's enough memory
+    // for it.  If the buffer isn't available, mode 5 runs as mode 2.
     void setScanMode(int mode)
     {
         switch (mode)
@@ -96,10 +133,26 @@ public:
         case 2:
             scanMethodFunc = &PlungerSensorEdgePos::scanBySlopeAcrossGap;
             break;
+
+        case 3:
+            scanMethodFunc = &PlungerSensorEdgePos::scanByTrackingGap;
+            trackValid = false;
+            break;
+
+        case 4:
+            scanMethodFunc = &PlungerSensorEdgePos::scanBySlopeAcrossGapPacked;
+            break;
+
+        case 5:
+            scanMethodFunc = &PlungerSensorEdgePos::scanByCoarseToFine;
+            break;
         }
     }
 
 protected:
+    // we only need the prefix sums for the coarse-to-fine scan
+    virtual bool usesPixSums() const 
+        { return scanMethodFunc == &PlungerSensorEdgePos::scanByCoarseToFine; }
     
     // "Steepest Slope" scanning method.  This is the method used for
     // many years in the v2 firmware.
@@ -159,12 +212,12 @@ protected:
         if (edgeScanBySlope(pix, n, &edgep, dir))
         {
             // edgep has the pixel array pointer; convert it to an offset
-            pos = edgep - pix;
+            pos = refineEdge(pix, n, edgep - pix, dir);
             
             // if the sensor orientation is reversed, figure the index from
             // the other end of the array
             if (dir < 0)
-                pos = n - pos;
+                pos = (n << subPixelShift) - pos;
                 
             // success
             return true;
@@ -211,6 +264,90 @@ protected:
     // motion-blurred images, since it compensates for the expected blur
     // by increasing the gap size.
     bool scanBySlopeAcrossGap(const uint8_t *pix, int n, int &pos, int& /*processResult*/)
+    {
+        return scanGap(pix, n, pos, GapScanFull);
+    }
+    
+    // "Packed Slope Across a Gap" scanning method.  This is identical
+    // to the "Slope Across a Gap" method in its results, but uses the
+    // packed (four pixels at a time) implementation of the scan loop.
+    // See gapScanKernelPacked() for details.
+    bool scanBySlopeAcrossGapPacked(const uint8_t *pix, int n, int &pos, int& /*processResult*/)
+    {
+        return scanGap(pix, n, pos, GapScanPacked);
+    }
+    
+    // "Tracking Slope Across a Gap" scanning method.
+    //
+    // This is the same edge detector as the "Slope Across a Gap" method,
+    // but it uses the previous readings to narrow the search.  The edge
+    // can only move so far between frames, since the plunger has a finite
+    // top speed (about 4.5mm/ms, or roughly 280 pixels per 2.5ms frame on
+    // a TSL1410R), and more to the point, a finite acceleration under the
+    // force of the spring.  So rather than scanning the whole sensor every
+    // time, we extrapolate the last two readings to predict where the
+    // edge should be in the new frame, and only scan a window around that
+    // point.  The window is wide enough to cover the motion from the last
+    // frame plus an allowance for acceleration.  For a plunger at rest,
+    // this cuts the scan from over a thousand pixels to a few dozen.
+    //
+    // If the windowed scan doesn't find a convincing edge - the contrast
+    // is too low, or the best slope is right at the boundary of the
+    // window, which suggests that the real edge is outside the window -
+    // we fall back on a full scan of the frame.  That handles the cases
+    // the prediction can't, such as the sudden reversal when the plunger
+    // hits the barrel spring at the end of a release.  The result in
+    // these cases is exactly what the regular gap scan would produce.
+    bool scanByTrackingGap(const uint8_t *pix, int n, int &pos, int& /*processResult*/)
+    {
+        return scanGap(pix, n, pos, GapScanTracking);
+    }
+    
+    // "Coarse-to-Fine Slope Across a Gap" scanning method.
+    //
+    // This is another variation on the "Slope Across a Gap" method that
+    // reduces the amount of full-resolution scanning.  Rather than 
+    // relying on the previous frames to predict where the edge will be, 
+    // as the tracking method does, this does a two-level search.  We 
+    // first decimate the image 8:1, by summing each group of 8 pixels 
+    // into a single "cell", and search the decimated image for the
+    // steepest slope across a gap.  That gives us the edge position to
+    // within a cell.  We then run the full-resolution gap scan over a
+    // small window bracketing that cell to pin down the exact pixel.
+    //
+    // The decimation pass still has to touch every pixel, but it's just
+    // a running sum, which is much cheaper per pixel than the full gap
+    // scan with its rolling windows.  The coarse scan and the refinement
+    // window are each only a small fraction of the full image.  So this
+    // has a fixed, low cost per frame that doesn't depend on the image
+    // content or on the previous frames, which makes the worst case
+    // much better than the other methods, which can end up walking the
+    // whole array on noisy frames.
+    //
+    // Decimation also averages out pixel noise, so the coarse scan is at
+    // least as reliable as the full-resolution scan at finding the edge.
+    // If the coarse scan can't find an edge, we simply reject the frame,
+    // on the assumption that a full-resolution scan would have no better
+    // luck.
+    //
+    // The coarse scan works on the prefix sums, so if the sums buffer
+    // couldn't be allocated, we do the full-resolution scan instead.
+    bool scanByCoarseToFine(const uint8_t *pix, int n, int &pos, int& /*processResult*/)
+    {
+        return scanGap(pix, n, pos, pixSums.isAllocated() ? GapScanPyramid : GapScanFull);
+    }
+    
+    // Gap scan variations, for scanGap()
+    enum GapScanMethod
+    {
+        GapScanFull,        // scalar full-frame scan
+        GapScanPacked,      // packed full-frame scan
+        GapScanTracking,    // windowed scan around the predicted position
+        GapScanPyramid      // coarse-to-fine scan
+    };
+    
+    // Common handler for the slope-across-gap scans
+    bool scanGap(const uint8_t *pix, int n, int &pos, GapScanMethod method)
     {
         // Get the levels at each end
         int a = (int(pix[0]) + pix[1] + pix[2] + pix[3] + pix[4]);
@@ -222,6 +359,7 @@ protected:
         // scanning from the bright side, 'di' is the starting index on
         // the dark side.  'binc' and 'dinc' are the pixel increments
         // for the respective indices.
+        int prvDir = dir;
         if (a > b + 50)
         {
             // left end is brighter - standard orientation
@@ -235,8 +373,13 @@ protected:
         else
         {
             // We can't detect the orientation from this image
+            trackValid = false;
             return false;
         }
+        
+        // the tracking history is meaningless if the orientation changed
+        if (dir != prvDir)
+            trackValid = false;
 
         // Calculate the expected gap size based on the previous delta.
         // Each exposure takes almost the full time between frames, so
@@ -249,7 +392,200 @@ protected:
         // identifying the position in a frame with fast motion.
         int prvDelta = abs(prvRawResult0 - prvRawResult1);
         const int gapSize = prvDelta < 3 ? 3 : prvDelta > 175 ? 175 : prvDelta;
+        
+        // Window size for the rolling averages
+        const int windowSize = gapWindowSize;
+        
+        // If we're tracking, try scanning a window around the predicted
+        // position first.
+        int steepestSlope = 0;
+        int steepestIdx = 0;
+        bool found = false;
+        if (method == GapScanTracking && trackValid)
+        {
+            // Extrapolate the last two readings to predict the position in
+            // the new frame, and figure the search radius: the distance 
+            // traveled over the last frame, plus an allowance for the
+            // change in speed over one frame.
+            int c = prvRawResult0 + (prvRawResult0 - prvRawResult1);
+            bool interior = gapScanWindow(
+                pix, n, dir, gapSize, c, prvDelta + trackMargin, steepestIdx, steepestSlope);
+                
+            // Accept the result if the contrast is comparable to the
+            // previous frame, and the edge isn't right at the boundary
+            // of the window.  An edge at the boundary probably means
+            // that the real edge is outside of the window, and we're
+            // just seeing the shoulder of the slope leading up to it.
+            found = (interior 
+                && steepestSlope >= 8*windowSize 
+                && steepestSlope >= trackSlope/2);
+        }
+        
+        // For the coarse-to-fine scan, find the edge in the decimated
+        // image, then refine it at full resolution.  The result is final
+        // either way - we don't fall back on the full scan.
+        if (method == GapScanPyramid)
+        {
+            const PixelPrefixSum &ps = getPixSums(pix, n);
+            int c;
+            if (!coarseGapScan(ps, n, dir, gapSize, c))
+                return false;
+                
+            gapScanWindow(pix, n, dir, gapSize, c, pyramidRadius, steepestIdx, steepestSlope, &ps);
+            found = true;
+        }
+        
+        // if we didn't find the edge by tracking, scan the whole frame
+        if (!found)
+        {
+            int iStart = dir < 0 ? n - 1 : 0;
+            int nIter = n - (windowSize*2 + gapSize);
+            steepestIdx = method == GapScanPacked ?
+                gapScanKernelPacked(pix, iStart, nIter, dir, gapSize, steepestSlope) :
+                gapScanKernel(pix, iStart, nIter, dir, gapSize, steepestSlope);
+        }
 
+        // Reject the reading if the steepest slope is too shallow, which
+        // indicates that the contrast is too low to take a reading.
+        if (steepestSlope < 8*windowSize)
+        {
+            trackValid = false;
+            return false;  
+        }
+
+        // update the previous results
+        prvRawResult1 = prvRawResult0;
+        prvRawResult0 = steepestIdx;
+        
+        // we have a valid position to track from on the next frame
+        trackValid = true;
+        trackSlope = steepestSlope;
+
+        // return the best slope point, refined to sub-pixel resolution
+        // if that's enabled
+        pos = refineEdge(pix, n, steepestIdx, dir);
+
+        // if the sensor orientation is reversed, figure the index from
+        // the other end of the array
+        if (dir < 0)
+            pos = (n << subPixelShift) - pos;
+
+        // success            
+        return true;
+    }
+    
+    // Run the gap scan kernel over a window of positions.  'c' is the
+    // center of the window, as a raw pixel index, and 'radius' is the
+    // number of pixels to scan on either side of it.  The window is 
+    // limited to the sensor bounds.  Fills in 'steepestIdx' and 
+    // 'steepestSlope' with the kernel results (or zeroes if the window
+    // is entirely out of bounds), and returns true if the steepest point
+    // is in the interior of the window, false if it's at either boundary.
+    // If 'ps' is provided, we use the prefix sum kernel; otherwise we use
+    // the rolling window kernel.
+    bool gapScanWindow(const uint8_t *pix, int n, int dir, int gapSize, int c, int radius,
+        int &steepestIdx, int &steepestSlope, const PixelPrefixSum *ps = 0)
+    {
+        // Work in terms of the offset from the bright end of the sensor, 
+        // which is where the scan starts, so that the arithmetic is the 
+        // same in either orientation.
+        int cu = (dir < 0 ? n - 1 - c : c);
+        
+        // The gap center is (window + gap/2) pixels past the start of
+        // the first window, so start that much ahead of the bottom of
+        // the search range.  Limit the scan to the sensor bounds.
+        const int windowSize = gapWindowSize;
+        const int gapOfs = windowSize + gapSize/2;
+        int su = cu - radius - gapOfs;
+        if (su < 0)
+            su = 0;
+        int nIter = cu + radius - (su + gapOfs) + 1;
+        int maxIter = n - (su + 2*windowSize + gapSize);
+        if (nIter > maxIter)
+            nIter = maxIter;
+            
+        // if there's nothing left of the window, there's no result
+        if (nIter <= 2)
+        {
+            steepestIdx = steepestSlope = 0;
+            return false;
+        }
+        
+        // scan the window
+        int iStart = (dir < 0 ? n - 1 - su : su);
+        steepestIdx = (ps != 0 ?
+            gapScanKernelSums(*ps, iStart, nIter, dir, gapSize, steepestSlope) :
+            gapScanKernel(pix, iStart, nIter, dir, gapSize, steepestSlope));
+        
+        // note whether the result is in the interior of the window
+        int k = (dir < 0 ? n - 1 - steepestIdx : steepestIdx) - (su + gapOfs);
+        return k > 0 && k < nIter - 1;
+    }
+    
+    // Coarse gap scan, for the coarse-to-fine method.  This decimates the
+    // image into cells of (1 << pyramidShift) pixels, using the prefix
+    // sums to get the cell sums, and scans for the
+    // steepest slope across a gap between single cells, where the gap is
+    // the full-resolution gap size rounded up to whole cells.  A cell sum
+    // covers the same number of pixels as a full-resolution window sum,
+    // so the slope is on the same scale, but we only require half of the
+    // usual minimum contrast, since the edge can straddle cells.  On 
+    // success, fills in 'c' with the raw pixel index of the center of 
+    // the gap at the steepest slope and returns true.
+    bool coarseGapScan(const PixelPrefixSum &ps, int n, int dir, int gapSize, int &c)
+    {
+        // figure the cell layout
+        const int cellSize = 1 << pyramidShift;
+        int nCells = n >> pyramidShift;
+        
+        // figure the gap in cells
+        int gc = (gapSize + cellSize - 1) >> pyramidShift;
+        
+        // Scan for the steepest bright-to-dark slope from cell i to cell
+        // i + dir*(gc+1), starting at the bright end.
+        int steepestSlope = 0, steepestCell = -1;
+        int span = dir*((gc + 1) << pyramidShift);
+        for (int i = (dir < 0 ? nCells - 1 : 0), nIter = nCells - gc - 1 ; nIter > 0 ; --nIter, i += dir)
+        {
+            int a = i << pyramidShift;
+            int slope = int(ps.sum(a, a + cellSize)) - int(ps.sum(a + span, a + span + cellSize));
+            if (slope > steepestSlope)
+            {
+                steepestSlope = slope;
+                steepestCell = i;
+            }
+        }
+        
+        // reject the frame if the contrast is too low
+        if (steepestSlope < 4*gapWindowSize)
+            return false;
+            
+        // Figure the pixel at the center of the gap.  Going forward, the
+        // gap starts at the next cell; going backward, it ends at the 
+        // start of the current cell.
+        c = (dir > 0 ? (steepestCell + 1) << pyramidShift : (steepestCell - gc) << pyramidShift)
+            + gc*cellSize/2;
+        return true;
+    }
+    
+    // Coarse-to-fine scan parameters.  The decimation factor is 
+    // (1 << pyramidShift).  The refinement radius covers the uncertainty
+    // in the edge position from the coarse scan - a cell width on either 
+    // side - plus a little extra.
+    static const int pyramidShift = 3;
+    static const int pyramidRadius = 12;
+    
+    // Slope-across-gap scan kernel.  This scans 'nIter' positions 
+    // starting at pixel 'iPix1' and moving in direction 'dir' (+1 or -1),
+    // looking for the steepest bright-to-dark gradient across a gap of
+    // 'gapSize' pixels between two rolling-average windows.  Returns
+    // the pixel index at the center of the gap at the steepest point,
+    // and fills in 'steepestSlope' with the slope there (the difference
+    // in the window sums).  The caller is responsible for making sure
+    // that the scan stays within the pixel array: the last pixel read is
+    // at iPix1 + dir*(2*gapWindowSize + gapSize + nIter - 1).
+    int gapScanKernel(const uint8_t *pix, int iPix1, int nIter, int dir, int gapSize, int &steepestSlope)
+    {
         // Initialize a pair of rolling-average windows.  This sensor tends
         // to have a bit of per-pixel noise, so if we looked at the slope
         // from one pixel to the next, we'd see a lot of steep edges from
@@ -260,10 +596,9 @@ protected:
         // with this sensor doesn't use focusing optics, so the shadow is a
         // little fuzzy, crossing a few pixels; the gap is meant to
         // approximate the fuzzy extent of the shadow.
-        const int windowSize = 8;  // must be power of two
+        const int windowSize = gapWindowSize;
         uint8_t window1[windowSize], window2[windowSize];
         unsigned int sum1 = 0, sum2 = 0;
-        int iPix1 = dir < 0 ? n - 1 : 0;
         for (int i = 0 ; i < windowSize ; ++i, iPix1 += dir)
             sum1 += (window1[i] = pix[iPix1]);
 
@@ -273,9 +608,9 @@ protected:
             sum2 += (window2[i] = pix[iPix2]);
 
         // search for the steepest bright-to-dark gradient
-        int steepestSlope = 0;
+        steepestSlope = 0;
         int steepestIdx = 0;
-        for (int i = windowSize*2 + gapSize, wi = 0 ; i < n ; ++i, iPix1 += dir, iPix2 += dir, iGap += dir)
+        for (int i = 0, wi = 0 ; i < nIter ; ++i, iPix1 += dir, iPix2 += dir, iGap += dir)
         {
             // compute the slope at the current gap
             int slope = sum1 - sum2;
@@ -297,27 +632,226 @@ protected:
             wi += 1;
             wi &= ~windowSize;
         }
-
-        // Reject the reading if the steepest slope is too shallow, which
-        // indicates that the contrast is too low to take a reading.
-        if (steepestSlope < 8*windowSize)
-            return false;  
-
+        
         // return the best slope point
-        pos = steepestIdx;
-
-        // update the previous results
-        prvRawResult1 = prvRawResult0;
-        prvRawResult0 = pos;
-
-        // if the sensor orientation is reversed, figure the index from
-        // the other end of the array
-        if (dir < 0)
-            pos = n - pos;
-
-        // success            
-        return true;
+        return steepestIdx;
     }
+    
+    // Prefix sum version of the slope-across-gap scan kernel.  This
+    // computes the same result as gapScanKernel(), but gets the window
+    // sums from the frame's prefix sums instead of rolling windows.  
+    // This doesn't need any setup per call, so it's the better choice
+    // when scanning small windows on a frame where the prefix sums have
+    // already been built.
+    int gapScanKernelSums(const PixelPrefixSum &ps, int iPix1, int nIter, int dir, int gapSize, int &steepestSlope)
+    {
+        // Figure the [start, end) bounds of the two windows at the first
+        // position.  In the reverse direction, the windows extend 
+        // downwards from the current pixel.
+        const int windowSize = gapWindowSize;
+        int a1 = (dir > 0 ? iPix1 : iPix1 - windowSize + 1);
+        int a2 = a1 + dir*(windowSize + gapSize);
+        int iGap = iPix1 + dir*(windowSize + gapSize/2);
+        
+        // search for the steepest bright-to-dark gradient
+        steepestSlope = 0;
+        int steepestIdx = 0;
+        for (int i = 0 ; i < nIter ; ++i, a1 += dir, a2 += dir, iGap += dir)
+        {
+            int slope = int(ps.sum(a1, a1 + windowSize)) - int(ps.sum(a2, a2 + windowSize));
+            if (slope > steepestSlope)
+            {
+                steepestSlope = slope;
+                steepestIdx = iGap;
+            }
+        }
+        
+        // return the best slope point
+        return steepestIdx;
+    }
+    
+    // Packed version of the slope-across-gap scan kernel.  This computes
+    // exactly the same result as gapScanKernel(), but it's restructured
+    // to process four pixel positions per iteration using 32-bit word
+    // operations.
+    //
+    // The idea is that we don't actually need the rolling windows at all.
+    // The slope at each position is the difference of the two window sums,
+    // and when we move one pixel along, each window gains one pixel at the
+    // leading end and loses one at the trailing end.  So the change in the
+    // slope from position k to position k+1 is:
+    //
+    //    d[k] = (p[k+w] + p[k+w+gap]) - (p[k] + p[k+2w+gap])
+    //
+    // where p[] is the pixel array relative to the starting point, and w
+    // is the window size.  That's four pixel "streams" at fixed offsets
+    // from k.  We can fetch four consecutive pixels from each stream with
+    // a single 32-bit load, and then compute the deltas for all four
+    // positions at once by treating the word as a vector of smaller
+    // lanes.  The bytes don't have enough headroom to add in place, so we
+    // split each word into the even and odd bytes, giving us two 16-bit 
+    // lanes per word.  A difference d[k] is in -510..+510, so we add a
+    // bias of 512 to each lane to keep the lanes from going negative,
+    // which would borrow from the lane above.  That gives us the four
+    // deltas in four 16-bit lanes of two words, for about the same work
+    // as computing one delta pixel-by-pixel.  The running slope and
+    // maximum still have to be done serially, but that's just an add and
+    // a compare per position.
+    //
+    // The KL25Z's Cortex-M0+ can't do unaligned word loads (it faults),
+    // so the streams are read through PixWordStream, which assembles each
+    // unaligned group from two aligned words.  Every aligned word we load
+    // contains at least one pixel that the scalar kernel would also read,
+    // so we never touch memory outside of the words spanned by the pixel
+    // buffer.
+    int gapScanKernelPacked(const uint8_t *pix, int iPix1, int nIter, int dir, int gapSize, int &steepestSlope)
+    {
+        const int windowSize = gapWindowSize;
+        
+        // figure the initial window sums
+        int slope = 0;
+        for (int i = 0, ip = iPix1 ; i < windowSize ; ++i, ip += dir)
+            slope += pix[ip] - pix[ip + dir*(windowSize + gapSize)];
+            
+        // Set up the four pixel streams: leaving window 1, entering 
+        // window 1, leaving window 2, entering window 2.  Each stream 
+        // read returns the next four pixels in the scan direction.  In
+        // the reverse direction, the first pixel of each group is at the
+        // top of the word, so the word starts three bytes before it.
+        const int ofs2 = windowSize + gapSize, ofs3 = 2*windowSize + gapSize;
+        const int adj = (dir < 0 ? -3 : 0);
+        PixWordStream s0, s1, s2, s3;
+        s0.init(pix + iPix1 + adj, dir);
+        s1.init(pix + iPix1 + dir*windowSize + adj, dir);
+        s2.init(pix + iPix1 + dir*ofs2 + adj, dir);
+        s3.init(pix + iPix1 + dir*ofs3 + adj, dir);
+        
+        // scan four positions per iteration
+        const uint32_t mask = 0x00FF00FF, bias = 0x02000200;
+        steepestSlope = 0;
+        int steepestIdx = 0;
+        int iGap = iPix1 + dir*(windowSize + gapSize/2);
+        int k = 0;
+        for ( ; k + 4 <= nIter ; k += 4)
+        {
+            // get the next four pixels from each stream
+            uint32_t a = s0.next(), b = s1.next(), c = s2.next(), e = s3.next();
+            
+            // figure the biased deltas in the even and odd byte lanes
+            uint32_t de = ((b & mask) + (c & mask) + bias) - ((a & mask) + (e & mask));
+            uint32_t dodd = (((b >> 8) & mask) + ((c >> 8) & mask) + bias) - (((a >> 8) & mask) + ((e >> 8) & mask));
+            
+            // put the deltas in scan order
+            int d0, d1, d2, d3;
+            if (dir > 0)
+                d0 = de & 0xFFFF, d1 = dodd & 0xFFFF, d2 = de >> 16, d3 = dodd >> 16;
+            else
+                d0 = dodd >> 16, d1 = de >> 16, d2 = dodd & 0xFFFF, d3 = de & 0xFFFF;
+                
+            // apply them to the running slope, recording the steepest point
+            gapScanStep(slope, d0, steepestSlope, steepestIdx, iGap, dir);
+            gapScanStep(slope, d1, steepestSlope, steepestIdx, iGap, dir);
+            gapScanStep(slope, d2, steepestSlope, steepestIdx, iGap, dir);
+            gapScanStep(slope, d3, steepestSlope, steepestIdx, iGap, dir);
+        }
+        
+        // finish any leftover positions one pixel at a time
+        for (int ip = iPix1 + dir*k ; k < nIter ; ++k, ip += dir, iGap += dir)
+        {
+            if (slope > steepestSlope)
+                steepestSlope = slope, steepestIdx = iGap;
+            slope += (pix[ip + dir*windowSize] + pix[ip + dir*ofs2]) - (pix[ip] + pix[ip + dir*ofs3]);
+        }
+        
+        // return the best slope point
+        return steepestIdx;
+    }
+    
+    // One position step of gapScanKernelPacked(): record the running slope
+    // if it's the steepest so far, then apply the next biased delta and 
+    // advance to the next gap position.
+    static inline void gapScanStep(int &slope, int d, int &steepestSlope, 
+        int &steepestIdx, int &iGap, int dir)
+    {
+        if (slope > steepestSlope)
+        {
+            steepestSlope = slope;
+            steepestIdx = iGap;
+        }
+        slope += d - 512;
+        iGap += dir;
+    }
+    
+    // Packed pixel stream reader for gapScanKernelPacked().  This reads
+    // successive 4-byte groups from a byte array, starting at an arbitrary
+    // (not necessarily word-aligned) address, stepping forward or backward
+    // by four bytes per read.  Each group is returned as a 32-bit word in
+    // the native little-endian order (lowest address in the low byte).
+    // Unaligned groups are assembled from the two aligned words they
+    // straddle, carrying the shared word over to the next read, so each 
+    // read costs one aligned load.
+    struct PixWordStream
+    {
+        void init(const uint8_t *a, int step)
+        {
+            uintptr_t ua = uintptr_t(a);
+            p = reinterpret_cast<const uint32_t*>(ua & ~3);
+            shr = (ua & 3) * 8;
+            shl = 32 - shr;
+            this->step = step;
+            carry = (shr == 0 ? 0 : step > 0 ? p[0] : p[1]);
+        }
+        
+        inline uint32_t next()
+        {
+            uint32_t w;
+            if (shr == 0)
+            {
+                // aligned - just load the word
+                w = *p;
+            }
+            else if (step > 0)
+            {
+                // moving forward - the carry is the low word
+                uint32_t hi = p[1];
+                w = (carry >> shr) | (hi << shl);
+                carry = hi;
+            }
+            else
+            {
+                // moving backward - the carry is the high word
+                uint32_t lo = p[0];
+                w = (lo >> shr) | (carry << shl);
+                carry = lo;
+            }
+            p += step;
+            return w;
+        }
+        
+        const uint32_t *p;      // current aligned word pointer
+        uint32_t carry;         // word carried over from the last read
+        int shr, shl;           // funnel shift amounts for misalignment
+        int step;               // +1 to read forward, -1 backward
+    };
+    
+    // Rolling-average window size for the gap scans.  Must be a power 
+    // of two.
+    static const int gapWindowSize = 8;
+    
+    // Search margin for the tracking scan, in pixels.  This is added to
+    // the distance traveled over the previous frame to allow for changes
+    // in speed between frames.  The spring accelerates the plunger from
+    // rest to its top speed over about 30ms at the fastest, which works
+    // out to a speed change of about 1mm per frame, or 25 pixels on a
+    // TSL1410R.  We add a bit more for good measure.
+    static const int trackMargin = 32;
+    
+    // Tracking scan state.  trackValid is true when the previous frame
+    // yielded a valid reading that we can extrapolate from; trackSlope is
+    // the edge slope at that reading, for comparison against the new 
+    // frame.
+    bool trackValid;
+    int trackSlope;
 
     // Previous raw results, to estimate the plunger speed expected
     // during the new frame.  A moving plunger causes motion blur,
@@ -497,7 +1031,10 @@ protected:
                 // if we've seen enough contiguous shadow, declare success
                 if (nShadow > 10)
                 {
-                    pos = edgeFound;
+                    // refine the position, and adjust for the orientation
+                    pos = refineEdge(pix, nPixels, edgeFound, dir);
+                    if (dir < 0)
+                        pos = (nPixels << subPixelShift) - pos;
                     return true;
                 }
             }
@@ -510,6 +1047,70 @@ protected:
         return false;
     }
 
+    // Refine an edge position to sub-pixel resolution.  'idx' is the
+    // whole-pixel edge position found by one of the scan methods, as a raw
+    // index into the pixel array, and 'dir' is the scan direction from the
+    // bright end (+1 or -1).  Returns the raw position in native units, 
+    // which is simply 'idx' if sub-pixel interpolation is disabled.
+    //
+    // We refine the position by finding the centroid of the brightness
+    // gradient in a small window around the edge.  The gradient is the
+    // drop in brightness from each pixel to the next in the scan
+    // direction, which is concentrated at the edge.  The centroid of the
+    // gradient is the weighted average position of the drop, which lands
+    // between pixels in proportion to how much of the drop occurs on each
+    // side.  A centroid is more forgiving than a curve fit (e.g., a 
+    // parabola through the three steepest points) when the edge is 
+    // spread over several pixels by the penumbra or by motion blur, since
+    // it doesn't assume any particular shape.  To keep random pixel noise
+    // outside of the edge from pulling the centroid around, we subtract a
+    // noise floor of 1/4 of the peak gradient, and ignore anything below
+    // the floor.
+    int refineEdge(const uint8_t *pix, int n, int idx, int dir)
+    {
+        // if sub-pixel interpolation is disabled, use the whole-pixel result
+        if (subPixelShift == 0)
+            return idx;
+            
+        // Figure the window.  Gradient i is between pixel i and i+dir, so
+        // make sure that both pixels are in the array.
+        const int radius = 8;
+        int lo = idx - radius, hi = idx + radius;
+        if (lo < (dir < 0 ? 1 : 0)) lo = (dir < 0 ? 1 : 0);
+        if (hi > (dir < 0 ? n - 1 : n - 2)) hi = (dir < 0 ? n - 1 : n - 2);
+        
+        // find the peak gradient in the window, to set the noise floor
+        int peak = 0;
+        for (int i = lo ; i <= hi ; ++i)
+        {
+            int d = int(pix[i]) - pix[i + dir];
+            if (d > peak)
+                peak = d;
+        }
+        int floor = peak/4;
+        
+        // Figure the centroid.  Gradient i is located halfway between
+        // pixel i and pixel i+dir, at i + dir/2, so we work in half-pixel
+        // units to keep everything in integers.
+        int num = 0, den = 0;
+        for (int i = lo ; i <= hi ; ++i)
+        {
+            int w = int(pix[i]) - pix[i + dir] - floor;
+            if (w > 0)
+            {
+                num += w * (2*i + dir);
+                den += w;
+            }
+        }
+        
+        // if there's no gradient at all, use the whole-pixel result
+        if (den == 0)
+            return idx << subPixelShift;
+        
+        // convert from half pixels to sub-pixel units, rounding
+        return ((num << (subPixelShift - 1)) + den/2) / den;
+    }
+    
     // Sensor orientation.  +1 means that the "tip" end - which is always
     // the brighter end in our images - is at the 0th pixel in the array.
     // -1 means that the tip is at the nth pixel in the array.  0 means
@@ -0,0 +1,229 @@
+// Multi-frame averaging for image sensors
+//
+// This is a helper for the image sensor processors, for reducing pixel
+// noise by averaging consecutive frames while the plunger is at rest.
+// The noise in each pixel is mostly random from one frame to the next,
+// so averaging N frames reduces it by about a factor of sqrt(N), which
+// gives the edge detectors a cleaner image to work with, and in turn
+// gives steadier position readings when the plunger is parked.
+//
+// Averaging over time necessarily adds latency, which we definitely
+// don't want while the plunger is moving: a release only takes about 50ms
+// from full retraction to impact, and we want to track it as closely as
+// possible.  So we only average while the image is stable.  Before adding
+// each frame into the average, we compare it to the previous frame and
+// to the current average, and if any pixel differs from either by more
+// than a threshold, we assume that the plunger is moving, and start over
+// with the new frame.  The previous frame comparison catches the start
+// of a pull or release right away, since it isn't diluted by the older
+// frames in the average.  The average comparison catches slow creep,
+// where each frame only differs from the last by about the noise level,
+// but the differences add up.  The threshold is a fraction of the image
+// contrast (the difference between the brightest and darkest pixels),
+// since a moving edge changes the pixels it passes over by roughly the
+// full contrast, whereas the random noise is much smaller.  Averaging
+// resumes as soon as the image settles.
+//
+// The average is a running (exponential) average over approximately the
+// last N frames, where N is a power of 2, so that we can do all of the
+// arithmetic with shifts.  We start with a simple cumulative average 
+// after each reset, increasing the window size as frames accumulate, so 
+// that the averaged image is the best available estimate right from the
+// first frame.  The accumulator uses 8.8 fixed-point values, so that the
+// fractional part of the average isn't lost to rounding.
+//
+// The accumulator and previous frame buffers take 3 bytes per pixel, 
+// which is significant for the larger sensors (about 4.5K for a TSL1412R
+// or TCD1103), so this is an optional mode.  The sensor allocates the 
+// buffers when it's initialized at startup, and only if the mode is 
+// enabled in the configuration, so there's no memory cost when the
+// feature isn't in use.  Enabling the mode later, via a USB configuration
+// change, takes effect after the next reset (which normally follows a
+// configuration save anyway), since we don't want to risk running out of
+// memory after startup.  If there isn't enough free memory at startup,
+// the averaging stays off.
+
+#ifndef _FRAMEAVERAGE_H_
+#define _FRAMEAVERAGE_H_
+
+#include "mbed.h"
+#include "NewMalloc.h"
+
+class FrameAverager
+{
+public:
+    FrameAverager()
+    {
+        acc = 0;
+        prev = 0;
+        nAlloc = 0;
+        maxShift = 0;
+        shift = 0;
+        nFrames = 0;
+        threshold = 0;
+        active = false;
+    }
+    
+    // Allocate the buffers for an image of n pixels, if averaging is 
+    // enabled.  The sensor calls this once, at startup.  If there isn't 
+    // enough free memory, we leave the buffers unallocated, which keeps
+    // averaging disabled.  Returns true if the buffers are available.
+    bool allocate(int n)
+    {
+        if (maxShift != 0 && acc == 0)
+        {
+            // leave a reserve for any allocations that follow ours
+            const size_t reserve = 512;
+            size_t need = ((n*sizeof(uint16_t) + 3) & ~3) + ((n + 3) & ~3);
+            if (mallocBytesFree() >= need + reserve)
+            {
+                acc = new uint16_t[n];
+                prev = new uint8_t[n];
+                nAlloc = n;
+            }
+        }
+        return acc != 0;
+    }
+    
+    // Enable averaging over approximately 2^logN frames.  This only 
+    // takes effect if the buffers have been allocated, or are allocated
+    // later via allocate().
+    void enable(int logN)
+    {
+        // set the window size, and start over with the next frame
+        maxShift = logN;
+        reset();
+    }
+    
+    // disable averaging
+    void disable() { maxShift = 0; reset(); }
+    
+    // is averaging enabled?
+    bool isEnabled() const { return acc != 0 && maxShift != 0; }
+    
+    // Was the last frame averaged?  This is false if the last frame 
+    // reset the average, because of motion or because it was the first
+    // frame.
+    bool isActive() const { return active; }
+    
+    // start over with the next frame
+    void reset() { nFrames = 0; active = false; }
+    
+    // Apply averaging to a frame.  If the frame is consistent with the
+    // current average, we add it into the average, and replace the pixels
+    // in the caller's buffer with the averaged image.  If we detect motion,
+    // we reset the average to the new frame, and leave the caller's pixels
+    // unchanged.  Returns true if the pixels were replaced with the average.
+    bool apply(uint8_t *pix, int n)
+    {
+        // do nothing if we're not enabled
+        if (!isEnabled() || n > nAlloc)
+            return false;
+        
+        // Check for motion against the previous frame and the average,
+        // and save this frame as the new previous frame.  The average
+        // comparison uses the 8.8 fixed point accumulator, so shift the
+        // pixels to match.  If we're starting from scratch, the previous
+        // frame and the average aren't meaningful, so skip the test.
+        {
+            const uint8_t *p = pix;
+            uint8_t *q = prev;
+            const uint16_t *a = acc;
+            const int thresh = threshold, thresh88 = threshold << 8;
+            bool moving = false;
+            uint8_t lo = 255, hi = 0;
+            for (int i = n ; i != 0 ; --i)
+            {
+                int c = *p++;
+                int d = c - *q;
+                int da = (c << 8) - *a++;
+                if (d > thresh || d < -thresh || da > thresh88 || da < -thresh88)
+                    moving = true;
+                *q++ = uint8_t(c);
+                if (c < lo) lo = c;
+                if (c > hi) hi = c;
+            }
+            
+            // set the motion threshold for the new frame's contrast
+            setThreshold(hi - lo);
+            
+            // start over if the plunger is moving
+            if (moving)
+                nFrames = 0;
+        }
+        
+        // if we're starting over, reset the average to this frame
+        if (nFrames == 0)
+        {
+            const uint8_t *p = pix;
+            uint16_t *a = acc;
+            for (int i = n ; i != 0 ; --i)
+                *a++ = uint16_t(*p++ << 8);
+            
+            // count the frame and leave the pixels as they are
+            nFrames = 1;
+            shift = 0;
+            active = false;
+            return false;
+        }
+        
+        // Count the frame, and figure the window size.  Grow the window
+        // with the frame count until we reach the maximum, so that we 
+        // average evenly over the frames since the last reset.
+        ++nFrames;
+        if (shift < maxShift && nFrames >= (2 << shift))
+            ++shift;
+        
+        // Add the frame into the average, and replace the pixels with
+        // the new average, rounded to the nearest integer.  Note that
+        // a shift of zero can't happen here, since the window is always
+        // at least 2 frames once we have a second frame.
+        uint8_t *p = pix;
+        uint16_t *a = acc;
+        for (int i = n ; i != 0 ; --i, ++p, ++a)
+        {
+            int v = *a;
+            v += ((int(*p) << 8) - v) >> shift;
+            *a = uint16_t(v);
+            *p = uint8_t((v + 128) >> 8);
+        }
+        
+        // the output is averaged
+        active = true;
+        return true;
+    }
+    
+protected:
+    // Set the motion threshold for a given image contrast.  We use an
+    // eighth of the contrast, with a minimum of 8 levels, so that a very
+    // low contrast image isn't treated as moving all the time due to noise.
+    void setThreshold(int contrast)
+    {
+        int t = contrast / 8;
+        threshold = t < 8 ? 8 : t;
+    }
+    
+    // Accumulator, as 8.8 fixed-point pixel values
+    uint16_t *acc;
+    
+    // previous frame
+    uint8_t *prev;
+    
+    // allocated pixel capacity of the buffer
+    int nAlloc;
+    
+    // maximum window size, as a power of 2, and current window size
+    int maxShift;
+    int shift;
+    
+    // number of frames averaged since the last reset
+    int nFrames;
+    
+    // motion detection threshold, in pixel brightness levels
+    int threshold;
+    
+    // was the last frame averaged?
+    bool active;
+};
+
+#endif /* _FRAMEAVERAGE_H_ */
@@ -0,0 +1,187 @@
+// Plunger frame replay
+//
+// This is an image sensor interface that plays back recorded frames from
+// a capture file, in place of a live sensor.  It's meant for running the
+// image processors off the device, on a PC, against real frames captured
+// from a cabinet.  The host build is in HostTest/, which supplies 
+// stand-ins for the bits of mbed that plunger.h depends on; 
+// HostTest/frameReplayTest replays a capture file through each edge 
+// sensor scan mode.  Plug it into any of the PlungerSensorImage 
+// subclasses in place of the hardware sensor interface, and the processor
+// can't tell the difference: each ready()/readPix() cycle returns the 
+// next frame in the file.  That makes it possible to check a change to one of the scan
+// algorithms against a set of known-good recordings, including fast
+// motion like firing events, and to profile the processing without the
+// hardware attached.
+//
+// The capture file is recorded on the host from the raw frame capture
+// mode of the pixel dump command (message 65 3, with flag 0x02 to select
+// raw frames and 0x04 for continuous streaming; see USBProtocol.h).  In
+// that mode, each frame's pixel reports are preceded by a frame header
+// report with the frame's timestamp and sequence number, and the pixels
+// are sent exactly as the sensor delivered them.  The recorder simply
+// writes each frame out in the format below.
+//
+// File format.  All multi-byte values are little-endian.
+//
+//   File header (8 bytes):
+//     bytes 0:3 = signature, "PFRM"
+//     bytes 4:5 = number of pixels per frame
+//     byte  6   = flags: 0x01 = negative image (brighter pixels have
+//                 lower values), as reported in the frame header
+//     byte  7   = reserved, 0
+//
+//   Frame records, repeated to the end of the file:
+//     bytes 0:3 = frame timestamp, microseconds on the device clock
+//     bytes 4:7 = frame sequence number
+//     bytes 8.. = pixels, one byte each, in sensor order
+//
+// The sequence numbers are the device's own frame counter, so gaps show
+// where the device read frames that didn't make it into the recording
+// (which is normal, since the USB transfer of a full frame takes longer
+// than the sensor's frame time).
+
+#ifndef _FRAMEREPLAY_H_
+#define _FRAMEREPLAY_H_
+
+#include <stdio.h>
+#include <string.h>
+#include "plunger.h"
+
+class PlungerSensorImageInterfaceReplay: public PlungerSensorImageInterface
+{
+public:
+    // Set up a replay from an open capture file.  The caller retains
+    // ownership of the file.  Check ok() after construction to make sure
+    // the file header was valid.
+    PlungerSensorImageInterfaceReplay(FILE *fp) : PlungerSensorImageInterface(0)
+    {
+        this->fp = fp;
+        buf = outBuf = 0;
+        valid = false;
+        negativeImage = false;
+        nFrames = 0;
+        tFrame = seqFrame = 0;
+        tFirst = tLast = seqLast = 0;
+        
+        // read and check the file header
+        uint8_t hdr[8];
+        if (fread(hdr, 1, 8, fp) != 8 || memcmp(hdr, "PFRM", 4) != 0)
+            return;
+        native_npix = hdr[4] | (hdr[5] << 8);
+        negativeImage = (hdr[6] & 0x01) != 0;
+        if (native_npix == 0)
+            return;
+        
+        // allocate the frame buffers and load the first frame
+        buf = new uint8_t[native_npix];
+        outBuf = new uint8_t[native_npix];
+        loadFrame();
+    }
+    
+    ~PlungerSensorImageInterfaceReplay() 
+    { 
+        delete [] buf; 
+        delete [] outBuf;
+    }
+    
+    // did the file header load successfully?
+    bool ok() const { return buf != 0; }
+    
+    // get the file's pixel count and image polarity, for setting up the
+    // image processor to match the recording
+    int getNPix() const { return native_npix; }
+    bool isNegativeImage() const { return negativeImage; }
+    
+    // get the sequence number of the last frame read
+    uint32_t getFrameSeq() const { return seqLast; }
+    
+    // get the number of frames read so far
+    int getFrameCount() const { return nFrames; }
+    
+    // nothing to initialize
+    virtual void init() { }
+    
+    // we're ready as long as there's another frame in the file
+    virtual bool ready() { return valid; }
+    
+    // Read the current frame, and advance to the next one.  The image
+    // processors are allowed to modify the buffer (the status report
+    // does), so we always hand out our own copy rather than anything
+    // that the caller might need again.
+    virtual void readPix(uint8_t* &pix, uint32_t &t)
+    {
+        // hand out a copy of the prefetched frame
+        memcpy(outBuf, buf, native_npix);
+        pix = outBuf;
+        t = tFrame;
+        
+        // keep track of the timestamp range for the scan time average
+        if (nFrames++ == 0)
+            tFirst = tFrame;
+        tLast = tFrame;
+        seqLast = seqFrame;
+        
+        // prefetch the next frame
+        loadFrame();
+    }
+    
+    // nothing to do on release, since the caller's copy is separate
+    virtual void releasePix() { }
+    
+    // Figure the average frame time from the recorded timestamps.  This
+    // isn't the sensor's actual scan time, since we only see the frames
+    // that made it into the recording, but it's the closest thing we have.
+    virtual uint32_t getAvgScanTime() 
+    { 
+        return nFrames > 1 ? (tLast - tFirst) / (nFrames - 1) : 0;
+    }
+    
+    // the exposure time is fixed in the recording, so ignore this
+    virtual void setMinIntTime(uint32_t us) { }
+    
+protected:
+    // Load the next frame from the file into the prefetch buffer.  We
+    // always read one frame ahead, so that ready() can report the end
+    // of the file before the caller asks for a frame that isn't there.
+    void loadFrame()
+    {
+        uint8_t hdr[8];
+        valid = fread(hdr, 1, 8, fp) == 8 
+            && fread(buf, 1, native_npix, fp) == size_t(native_npix);
+        if (valid)
+        {
+            tFrame = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | (uint32_t(hdr[3]) << 24);
+            seqFrame = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | (uint32_t(hdr[7]) << 24);
+        }
+    }
+    
+    // capture file
+    FILE *fp;
+    
+    // Prefetched frame, and the buffer we hand out to the caller.  The
+    // latter is separate because we load the next frame as soon as the
+    // caller reads the current one.
+    uint8_t *buf;
+    uint8_t *outBuf;
+    
+    // is there a frame in the prefetch buffer?
+    bool valid;
+    
+    // does the recording use a negative image?
+    bool negativeImage;
+    
+    // number of frames read so far
+    int nFrames;
+    
+    // timestamp and sequence number of the prefetched frame
+    uint32_t tFrame;
+    uint32_t seqFrame;
+    
+    // timestamps of the first and last frames read, for the scan time,
+    // and the sequence number of the last frame read
+    uint32_t tFirst, tLast;
+    uint32_t seqLast;
+};
+
+#endif /* _FRAMEREPLAY_H_ */
@@ -0,0 +1,235 @@
+// Sensor noise estimator for the adaptive jitter filter
+//
+// The jitter filter (PlungerSensor::jitterFilter) hides the small random
+// variations in the sensor readings behind a hysteresis window.  The right
+// window size depends on the noise level of the particular sensor and
+// installation: too small and the jitter shows through, too large and the
+// filter hides real small movements and adds lag.  Users normally find
+// the size by trial and error.  This class measures the noise instead, so
+// that the filter can size the window automatically.
+//
+// We collect the raw readings in blocks of 16 and figure the mean and
+// variance of each block.  While the plunger is parked, the block variance
+// is just the sensor noise, so we keep a running average of the block 
+// variances as the noise estimate.  A block only counts as parked if it
+// passes two tests.  First, its variance has to be within 2x of the 
+// current estimate.  With 16 readings, pure noise exceeds that less than
+// 1% of the time.  Second, its mean has to be within about 3 standard
+// deviations of the previous block's mean.  Slow motion can keep the 
+// variance within a block low, but it moves the mean from one block to
+// the next, so this catches slow pulls that the variance test misses.  
+// Blocks that fail either test mean that the plunger is moving, so we 
+// leave them out of the average.
+//
+// We don't have an estimate to test against at startup, so we wait for
+// two consecutive blocks that agree with each other: variances within 2x
+// of each other, and means within a tighter version of the same limit.  Likewise, if we reject
+// several blocks in a row, the estimate might be too low (if the noise 
+// level has gone up, say), so we start over from the next pair of 
+// consecutive blocks that agree.  Motion doesn't produce agreeing pairs,
+// so neither case can take its estimate from a moving plunger.  If the
+// estimate does come out too high, parked blocks still pass the tests, 
+// and each one pulls the average variance 1/8 of the way back down, so a
+// standard deviation 4x too high comes back to within 2x in about 11
+// blocks (about 180 readings).
+//
+// The block statistics take 16 readings to detect motion, which is too
+// slow for shrinking the window when a pull starts.  So we also check
+// each reading against the filter window: noise stays within the window,
+// so a reading more than a full window width outside of it must be real
+// motion.  We drop the window to zero when we see that, so that the filter
+// adds no lag while the plunger is moving, and restore it as soon as a 
+// block passes the noise test again.
+//
+// The variance is kept as a fixed-point value with 8 fraction bits, in
+// native sensor units squared.
+
+#ifndef _JITTERNOISE_H_
+#define _JITTERNOISE_H_
+
+#include "mbed.h"
+
+class JitterNoiseEstimator
+{
+public:
+    JitterNoiseEstimator() { reset(); }
+    
+    // reset the estimate
+    void reset()
+    {
+        valid = false;
+        moving = true;
+        var = 0;
+        sigma = 0;
+        nBlock = 0;
+        nReject = 0;
+        havePrv = false;
+        prvVar = 0;
+        prvMean16 = 0;
+    }
+    
+    // Add a raw reading.  'lo' and 'hi' are the current jitter filter
+    // window bounds, and 'w' is the current window size.
+    void add(int pos, int lo, int hi, int w)
+    {
+        // check for motion against the filter window
+        if (valid && !moving && (pos < lo - w || pos > hi + w))
+            moving = true;
+        
+        // accumulate the reading into the block, relative to the first
+        // reading of the block to keep the sums small
+        if (nBlock == 0)
+        {
+            base = pos;
+            sum = 0;
+            sumSq = 0;
+        }
+        int d = pos - base;
+        sum += d;
+        sumSq += uint64_t(int64_t(d) * d);
+        
+        // process the block when it's full
+        if (++nBlock == blockSize)
+        {
+            nBlock = 0;
+            endBlock();
+        }
+    }
+    
+    // do we have a noise estimate yet?
+    bool isValid() const { return valid; }
+    
+    // is the plunger moving, as far as we can tell?
+    bool isMoving() const { return moving; }
+    
+    // get the standard deviation of the noise, in 1/16 native units
+    int getSigma16() const { return sigma; }
+    
+    // Get the filter window size for the current noise level, in native
+    // units.  This is 5 standard deviations, which covers the spread of
+    // nearly all readings at rest.
+    int getWindow() const { return (5*sigma + 8) >> 4; }
+    
+protected:
+    // finish a block
+    void endBlock()
+    {
+        // Figure the block variance.  With 16 readings, the variance in
+        // units squared is (16*sumSq - sum^2)/256, so the numerator is
+        // exactly the variance with 8 fraction bits.
+        int64_t v = int64_t(sumSq << 4) - int64_t(sum) * sum;
+        uint32_t bv = v < 0 ? 0 : v > 0x3FFFFFFF ? 0x3FFFFFFF : uint32_t(v);
+        
+        // Figure the block mean, in 1/16 units, and the change from the
+        // previous block.  The square of the change in 1/16 units is in
+        // units squared with 8 fraction bits, the same as the variance.
+        // For a parked plunger, the difference between two block means 
+        // has variance 2/16 of the noise variance, so limiting the square
+        // to the noise variance allows for about 3 standard deviations.
+        int32_t mean16 = (base << 4) + sum;
+        int32_t dm = mean16 - prvMean16;
+        uint32_t dm2 = (dm < -0x7FFF || dm > 0x7FFF) ? 0xFFFFFFFF : uint32_t(dm*dm);
+        
+        // Check if this block and the previous one agree with each other
+        // as samples of the same noise at the same position: variances 
+        // within 2x of each other, and means within about 2 standard 
+        // deviations, going by the smaller variance.  This is stricter
+        // than the test against the estimate, since a pair that passes
+        // sets a new estimate.  The small constant slack keeps near-zero
+        // variances from rejecting everything.
+        uint32_t vMax = bv > prvVar ? bv : prvVar;
+        uint32_t vMin = bv > prvVar ? prvVar : bv;
+        bool pairAgrees = havePrv && vMax <= 2*vMin + 64 && dm2 <= (vMin >> 1) + 64;
+        
+        // Check the block against the current estimate
+        bool quiet = valid && havePrv && bv <= 2*var + 64 && dm2 <= var + 64;
+        
+        if (quiet)
+        {
+            // quiet block - average it into the estimate
+            var = var - (var >> 3) + (bv >> 3);
+            moving = false;
+            nReject = 0;
+        }
+        else if (pairAgrees && (!valid || nReject >= maxReject))
+        {
+            // We don't have an estimate yet, or the current one has
+            // rejected too many blocks in a row, and the last two blocks
+            // agree with each other, so start over from their average
+            var = (bv >> 1) + (prvVar >> 1);
+            valid = true;
+            moving = false;
+            nReject = 0;
+        }
+        else
+        {
+            // noisy block - assume the plunger is moving
+            moving = true;
+            if (valid && nReject < maxReject)
+                ++nReject;
+        }
+        
+        // this block becomes the previous block for next time
+        prvVar = bv;
+        prvMean16 = mean16;
+        havePrv = true;
+        
+        // update the standard deviation
+        sigma = isqrt(var);
+    }
+    
+    // integer square root
+    static int isqrt(uint32_t x)
+    {
+        uint32_t r = 0, bit = 1UL << 30;
+        while (bit > x)
+            bit >>= 2;
+        while (bit != 0)
+        {
+            if (x >= r + bit)
+            {
+                x -= r + bit;
+                r = (r >> 1) + bit;
+            }
+            else
+                r >>= 1;
+            bit >>= 2;
+        }
+        return int(r);
+    }
+    
+    // readings per block
+    static const int blockSize = 16;
+    
+    // consecutive rejected blocks before we restart the estimate
+    static const int maxReject = 8;
+    
+    // do we have an estimate?
+    bool valid;
+    
+    // is the plunger moving?
+    bool moving;
+    
+    // noise variance estimate, units squared << 8
+    uint32_t var;
+    
+    // noise standard deviation, units << 4
+    int sigma;
+    
+    // current block: number of readings, first reading, and the sums of
+    // the readings and their squares relative to the first reading
+    int nBlock;
+    int base;
+    int32_t sum;
+    uint64_t sumSq;
+    
+    // consecutive rejected blocks
+    int nReject;
+    
+    // previous block's variance and mean (1/16 units), if we have one
+    bool havePrv;
+    uint32_t prvVar;
+    int32_t prvMean16;
+};
+
+#endif /* _JITTERNOISE_H_ */
@@ -14,6 +14,12 @@
 #define PLUNGER_H
 
 #include "config.h"
+#include "diags.h"
+#include "prefixSum.h"
+#include "frameAverage.h"
+#include "frameStats.h"
+#include "edgeStats.h"
+#include "jitterNoise.h"
 
 // Plunger reading with timestamp
 struct PlungerReading
@@ -44,7 +50,8 @@ public:
         scalingFactor = (65535UL*65536UL) / nativeScale;
         
         // presume no jitter filter
-        jfWindow = 0;
+        jfWindow = jfWindowMax = 0;
+        jfAdaptive = false;
         
         // initialize the jitter filter
         jfLo = jfHi = jfLast = 0;
@@ -134,6 +141,36 @@ public:
     // timestamp, without jitter filtering and without any scale adjustment.
     virtual bool readRaw(PlungerReading &r) = 0;
     
+    // Read the sensor's direct speed measurement, if it has one.  Most
+    // sensors can only measure position, so the main loop figures the
+    // speed by differencing successive position readings.  Some sensors
+    // can measure the speed more precisely on their own, such as the
+    // quadrature sensors, which can time the individual pulses.  If the
+    // sensor supports this, we return true and fill in 'v' with the speed
+    // in abstract-scale units (0x0000..0xFFFF = full scale) per second,
+    // adjusted for the orientation.  Returns false if the sensor doesn't
+    // have its own speed measurement.
+    bool readSpeed(int &v)
+    {
+        // get the raw speed, in native units per second
+        int vRaw;
+        if (!readRawSpeed(vRaw))
+            return false;
+            
+        // adjust for orientation
+        if (reverseOrientation)
+            vRaw = -vRaw;
+            
+        // adjust to the abstract scale via the scaling factor
+        v = int((int64_t(scalingFactor) * vRaw) >> 16);
+        return true;
+    }
+    
+    // Get the raw speed measurement, in native sensor units per second.
+    // Sensors that can measure speed directly override this; the default
+    // returns false to indicate that it's not supported.
+    virtual bool readRawSpeed(int &v) { return false; }
+    
     // Restore the saved calibration data from the configuration.  The main 
     // loop calls this at startup to let us initialize internals from the
     // saved calibration data.  This is called even if the plunger isn't 
@@ -160,6 +197,11 @@ public:
     //
     // 'flags' is a combination of bit flags:
     //   0x01  -> low-res scan (default is high res scan)
+    //   0x02  -> raw frame capture: send a frame header with the frame
+    //            timestamp and sequence number, and send the pixels 
+    //            exactly as captured (full resolution, and without 
+    //            converting negative images to positive)
+    //   0x08  -> compressed pixel reports (see USBJoystick::sendPlungerPixPacked)
     //
     // Low-res scan mode means that the sensor should send a scaled-down
     // image, at a reduced size determined by the sensor subtype.  The
@@ -196,7 +238,7 @@ public:
         // with the raw readings (all they usually have to do is scale the
         // value to the abstract reporting range).
         js.sendPlungerStatus(0, pos, 0x01, getAvgScanTime(), 0, speed);
-        js.sendPlungerStatus2(nativeScale, jfLo, jfHi, r.pos, 0);
+        js.sendPlungerStatus2(nativeScale, jfLo, jfHi, r.pos, 0, getJitterNoise());
     }
     
     // Set extra image integration time, in microseconds.  This is only 
@@ -208,6 +250,37 @@ public:
     // Get the average sensor scan time in microseconds
     virtual uint32_t getAvgScanTime() = 0;
     
+    // Get the average time, in microseconds, spent analyzing each raw 
+    // sensor reading to determine the plunger position.  This is mostly
+    // meaningful for image sensors, where the image analysis (finding the
+    // shadow edge or decoding the bar code) is the most CPU-intensive part
+    // of the plunger reading cycle.  It's useful for comparing the speeds
+    // of the different edge-detection scan modes on live data, which is
+    // the only truly representative benchmark, since the time for some of
+    // the scan algorithms depends on the image content.  Sensors that don't
+    // do any significant processing can use the default, which reports 0.
+    virtual uint32_t getAvgProcessTime() { return 0; }
+    
+    // Get the frame capture statistics, for image sensors.  Returns null
+    // for sensors that don't collect frame statistics.
+    virtual const FrameStats *getFrameStats() { return 0; }
+    
+    // Get the edge statistics, for quadrature sensors.  Returns null for
+    // other sensor types.
+    virtual const EdgeStats *getEdgeStats() { return 0; }
+    
+    // Run a step of the fixed-pattern noise calibration: 0 = erase the
+    // calibration, 1 = capture the dark frame, 2 = capture the flat field
+    // and save the calibration.  Sensors that don't use per-pixel
+    // calibration can ignore this.
+    virtual void calibrateFixedPattern(int step) { }
+    
+    // Write any pending calibration data to flash.  Sensors that store
+    // calibration data in flash do the writes here rather than while
+    // processing frames, since programming flash stalls the CPU with
+    // interrupts disabled.  The main loop calls this between readings.
+    virtual void flushCalibration() { }
+    
     // Apply the orientation filter.  The position is in unscaled
     // native sensor units.
     int applyOrientation(int pos)
@@ -232,6 +305,34 @@ public:
     // sensor units.
     int jitterFilter(int pos)
     {
+        // Update the noise estimate.  We do this even when the adaptive
+        // mode is off, so that the status report can show the measured
+        // noise as a guide to setting the window size manually.
+        jfNoise.add(pos, jfLo, jfHi, jfWindow);
+        
+        // In adaptive mode, set the window from the noise estimate.  Use
+        // the configured window until we have an estimate; after that,
+        // use the estimate, limited to the configured window, or to the
+        // default maximum if that's zero.  If the plunger is moving, close the window, so that
+        // the filter doesn't add any lag, and reset it to the new reading.
+        if (jfAdaptive && jfNoise.isValid())
+        {
+            if (jfNoise.isMoving())
+            {
+                if (jfWindow != 0)
+                {
+                    jfWindow = 0;
+                    jfLo = jfHi = jfLast = pos;
+                }
+            }
+            else
+            {
+                int w = jfNoise.getWindow();
+                int wMax = getAdaptiveWindowMax();
+                jfWindow = (w > wMax ? wMax : w);
+            }
+        }
+        
         // Check to see where the new reading is relative to the
         // current window
         if (pos < jfLo)
@@ -276,26 +377,68 @@ public:
         case 19:
             // Plunger filters - jitter window and reverse orientation.
             setJitterWindow(cfg.plunger.jitterWindow);
+            setAdaptiveJitter((cfg.plunger.reverseOrientation & 0x02) != 0);
             setReverseOrientation((cfg.plunger.reverseOrientation & 0x01) != 0);
             break;
         }
     }
     
     // Set the jitter filter window size.  This is specified in native
-    // sensor units.
+    // sensor units.  In adaptive mode, this is the maximum window size,
+    // with zero selecting the default maximum (see getAdaptiveWindowMax).
     void setJitterWindow(int w)
     {
         // set the new window size
-        jfWindow = w;
+        jfWindow = jfWindowMax = w;
         
         // reset the running window
         jfHi = jfLo = jfLast;
     }
     
+    // Set adaptive jitter filter mode.  In this mode, the window size is
+    // set automatically from the measured sensor noise.
+    void setAdaptiveJitter(bool f)
+    {
+        jfAdaptive = f;
+        jfWindow = jfWindowMax;
+        jfNoise.reset();
+    }
+    
+    // Get the maximum window size for adaptive mode.  This is the
+    // configured window size, or 1/64 of the sensor's native range if
+    // that's zero.  The noise estimate should never come anywhere near
+    // that on a working sensor, but it keeps a bad estimate from hiding
+    // real plunger motion.
+    int getAdaptiveWindowMax() const
+    {
+        return jfWindowMax != 0 ? jfWindowMax : nativeScale >> 6;
+    }
+    
+    // Get the jitter noise estimate for the status report: the standard
+    // deviation of the readings at rest, in 1/16 native units, or 0xFFFF
+    // if we don't have an estimate yet
+    int getJitterNoise() const 
+    {
+        return jfNoise.isValid() ? jfNoise.getSigma16() : 0xFFFF;
+    }
+    
     // Set reverse orientation
     void setReverseOrientation(bool f) { reverseOrientation = f; }
         
 protected:
+    // Change the native scale.  This is for sensors that can change their
+    // reading resolution on the fly (e.g., image sensors with sub-pixel
+    // edge interpolation enabled).  This updates the scaling factor to 
+    // match, and resets the jitter filter, since its window position is
+    // in terms of the old native units.
+    void setNativeScale(int newScale)
+    {
+        nativeScale = newScale;
+        scalingFactor = (65535UL*65536UL) / nativeScale;
+        jfLo = jfHi = jfLast = 0;
+        jfNoise.reset();
+    }
+    
     // Native scale of the device.  This is the scale used for the position
     // reading in status reports.  This lets us report the position in the
     // same units the sensor itself uses, to avoid any rounding error 
@@ -332,8 +475,11 @@ protected:
     
     // Jitter filtering
     int jfWindow;                // window size, in native sensor units
+    int jfWindowMax;             // configured window size (the maximum, in adaptive mode)
     int jfLo, jfHi;              // bounds of current window
     int jfLast;                  // last filtered reading
+    bool jfAdaptive;             // adaptive window mode
+    JitterNoiseEstimator jfNoise;  // sensor noise estimate
     
     // Reverse the raw reading orientation.  If set, raw readings will be
     // switched to the opposite orientation.  This allows flipping the sensor
@@ -387,6 +533,9 @@ public:
     // Set the minimum integration time (microseconds)
     virtual void setMinIntTime(uint32_t us) = 0;
     
+    // get the frame capture statistics, if the sensor collects them
+    virtual const FrameStats *getFrameStats() { return 0; }
+    
 protected:
     // number of pixels on sensor
     int native_npix;
@@ -407,13 +556,34 @@ public:
         sensor(sensor),
         native_npix(npix),
         negativeImage(negativeImage),
+        frameSeq(0),
+        statusFrame(false),
         axcTime(0),
-        extraIntTime(0)
+        extraIntTime(0),
+        pixNativeScale(nativeScale),
+        subPixelShift(0),
+        aeEnabled(false),
+        aeTarget(aeDefaultTarget),
+        aeCount(0)
     {
+#if ENABLE_DIAGNOSTICS
+        // start the image processing timer, and clear the statistics
+        processTimer.start();
+        resetProcessTime();
+#endif
     }
     
-    // initialize the sensor
-    virtual void init() { sensor.init(); }
+    // Initialize the sensor.  This is also where we allocate the frame
+    // averaging buffers, if averaging is enabled, and the prefix sum
+    // buffer, if the processor uses it, since the configuration has been
+    // loaded by now, and it's still startup time.
+    virtual void init() 
+    { 
+        sensor.init(); 
+        frameAvg.allocate(native_npix);
+        if (usesPixSums())
+            pixSums.allocate(native_npix);
+    }
 
     // is the sensor ready?
     virtual bool ready() { return sensor.ready(); }
@@ -424,6 +594,67 @@ public:
     // set extra integration time
     virtual void setExtraIntegrationTime(uint32_t us) { extraIntTime = us; }
     
+    virtual void onConfigChange(int varno, Config &cfg)
+    {
+        switch (varno)
+        {
+#if ENABLE_DIAGNOSTICS
+        case 5:
+            // Plunger sensor type and param1.  The edge sensors use param1
+            // to select the scan mode, so start new processing time 
+            // statistics, to keep the averages for different modes apart.
+            resetProcessTime();
+            break;
+#endif
+            
+        case 24:
+            // image sensor options - auto-exposure mode and target
+            {
+                bool ae = (cfg.plunger.image.flags & 0x02) != 0;
+                
+                // if we're turning auto-exposure off, go back to the 
+                // minimum exposure time
+                if (aeEnabled && !ae)
+                    axcTime = 0;
+                    
+                aeEnabled = ae;
+                aeTarget = cfg.plunger.image.aeTarget != 0 ? 
+                    cfg.plunger.image.aeTarget : aeDefaultTarget;
+                    
+                // Multi-frame averaging.  The frame count is rounded down
+                // to a power of 2, from 2 to 16, with 0 selecting the
+                // default of 8.
+                if ((cfg.plunger.image.flags & 0x08) != 0)
+                {
+                    int nFrames = cfg.plunger.image.avgFrames;
+                    int logN = 3;
+                    if (nFrames != 0)
+                    {
+                        for (logN = 1 ; logN < 4 && (2 << logN) <= nFrames ; ++logN) ;
+                    }
+                    frameAvg.enable(logN);
+                }
+                else
+                    frameAvg.disable();
+            }
+            break;
+        }
+        
+        // inherit the default handling
+        PlungerSensor::onConfigChange(varno, cfg);
+    }
+    
+#if ENABLE_DIAGNOSTICS
+    // get the average image processing time
+    virtual uint32_t getAvgProcessTime()
+    {
+        return nProcessRuns != 0 ? uint32_t(totalProcessTime / nProcessRuns) : 0;
+    }
+#endif
+    
+    // get the frame capture statistics from the sensor
+    virtual const FrameStats *getFrameStats() { return sensor.getFrameStats(); }
+    
     // read the plunger position
     virtual bool readRaw(PlungerReading &r)
     {
@@ -431,11 +662,22 @@ public:
         uint8_t *pix;
         uint32_t tpix;
         sensor.readPix(pix, tpix);
+        ++frameSeq;
+        
+        // If multi-frame averaging is enabled, add the frame into the
+        // average.  This replaces the pixels with the averaged image if
+        // the plunger is at rest, and leaves them as they are if it's 
+        // moving.
+        frameAvg.apply(pix, native_npix);
         
-        // process the pixels
+        // process the pixels, timing the analysis
         int pixpos;
         ProcessResult res;
+        IF_DIAG(uint32_t tProc0 = processTimer.read_us();)
         bool ok = process(pix, native_npix, pixpos, res);
+        IF_DIAG(
+            totalProcessTime += uint32_t(processTimer.read_us() - tProc0);
+            nProcessRuns += 1;)
         
         // release the buffer back to the sensor
         sensor.releasePix();
@@ -466,12 +708,19 @@ public:
         uint8_t *pix;
         uint32_t t;
         sensor.readPix(pix, t);
+        ++frameSeq;
+        
+        // note if this is a raw frame capture
+        bool capture = (flags & 0x02) != 0;
 
         // process the pixels and read the position
         int pos, rawPos;
         int n = native_npix;
         ProcessResult res;
-        if (process(pix, n, rawPos, res))
+        statusFrame = true;
+        bool ok = process(pix, n, rawPos, res);
+        statusFrame = false;
+        if (ok)
         {
             // success - apply the post jitter filter
             pos = postJitterFilter(rawPos);
@@ -490,8 +739,8 @@ public:
         uint32_t processTime = pt.read_us();
         
         // If a low-res scan is desired, reduce to a subset of pixels.  Ignore
-        // this for smaller sensors (below 512 pixels)
-        if ((flags & 0x01) && n >= 512)
+        // this for smaller sensors (below 512 pixels), and for raw captures.
+        if ((flags & 0x01) && n >= 512 && !capture)
         {
             // figure how many sensor pixels we combine into each low-res pixel
             const int group = 8;
@@ -528,13 +777,32 @@ public:
         else if (dir == -1)
             jsflags |= 0x02;
             
+        // add the frame averaging status
+        if (frameAvg.isActive())
+            jsflags |= 0x40;
+            
+        // add any sensor-specific status flags
+        jsflags |= getStatusFlags();
+            
         // send the sensor status report headers
         js.sendPlungerStatus(n, pos, jsflags, sensor.getAvgScanTime(), processTime, speed);
-        js.sendPlungerStatus2(nativeScale, jfLo, jfHi, rawPos, axcTime);
+        js.sendPlungerStatus2(nativeScale, jfLo, jfHi, rawPos, axcTime, getJitterNoise());
+        
+        // send the frame capture statistics, if the sensor collects them
+        const FrameStats *fs = sensor.getFrameStats();
+        if (fs != 0)
+        {
+            js.sendPlungerFrameStats(fs->nCaptured, fs->nProcessed, fs->nOverwritten,
+                fs->ageHist, FrameStats::nAgeBuckets);
+        }
         
         // send any extra status headers for subclasses
         extraStatusHeaders(js, res);
         
+        // for a raw capture, send the frame header
+        if (capture)
+            js.sendPlungerFrameHeader(t, frameSeq, negativeImage ? 0x01 : 0x00);
+        
         // If we're not in calibration mode, send the pixels
         extern bool plungerCalMode;
         if (!plungerCalMode)
@@ -542,8 +810,9 @@ public:
             // If the sensor uses a negative image format (brighter pixels are
             // represented by lower numbers in the pixel array), invert the scale
             // back to a normal photo-positive scale, so that the client doesn't
-            // have to know these details.
-            if (negativeImage)
+            // have to know these details.  Skip this for a raw capture,
+            // which sends the pixels exactly as the sensor reported them.
+            if (negativeImage && !capture)
             {
                 // Invert the photo-negative 255..0 scale to a normal,
                 // photo-positive 0..255 scale.  This is just a matter of
@@ -596,8 +865,16 @@ public:
 
             // send the pixels in report-sized chunks until we get them all
             int idx = 0;
-            while (idx < n)
-                js.sendPlungerPix(idx, n, pix);
+            if (flags & 0x08)
+            {
+                while (idx < n)
+                    js.sendPlungerPixPacked(idx, n, pix);
+            }
+            else
+            {
+                while (idx < n)
+                    js.sendPlungerPix(idx, n, pix);
+            }
         }
         
         // release the pixel buffer
@@ -614,6 +891,101 @@ protected:
     // get the detected orientation
     virtual int getOrientation() const { return 0; }
     
+    // get sensor-specific flags for the status report
+    virtual int getStatusFlags() const { return 0; }
+    
+    // Enable or disable sub-pixel position reporting.  Subclasses that
+    // can interpolate the edge position to a fraction of a pixel call this
+    // when the option changes.  When sub-pixel reporting is enabled, the
+    // native scale is multiplied by 2^subPixelBits, so process() must
+    // report positions in units of 1/2^subPixelBits pixel.  Note that
+    // the jitter filter window is in native units, so it gets finer
+    // along with the scale.
+    void setSubPixel(bool enable)
+    {
+        int shift = enable ? subPixelBits : 0;
+        if (shift != subPixelShift)
+        {
+            subPixelShift = shift;
+            setNativeScale(pixNativeScale << shift);
+        }
+    }
+    
+    // Automatic exposure control.  Subclasses that support auto-exposure
+    // call this from process() on each frame, with the average brightness 
+    // levels (0-255, photo-positive) at the bright and dark ends of the 
+    // image.  If auto-exposure is enabled, we adjust axcTime to bring the
+    // contrast between the two into the target band.
+    //
+    // The brightness of a pixel is roughly proportional to the total
+    // integration time, so we figure the time that should produce the
+    // target contrast, and move halfway there.  The total integration
+    // time is the sensor's own minimum, which is about one pixel transfer
+    // time, plus our extra time.  We only adjust every few frames, since
+    // the sensors' double-buffered pipelines delay the effect of a change
+    // by a couple of frames, and adjusting on every frame would make the
+    // loop overshoot and oscillate.
+    void autoExposure(int bright, int dark)
+    {
+        // do nothing if auto-exposure is disabled or we're between updates
+        if (!aeEnabled || ++aeCount < aeInterval)
+            return;
+        aeCount = 0;
+        
+        // figure the current total integration time
+        int tBase = sensor.getAvgScanTime();
+        int tCur = tBase + axcTime;
+        
+        // figure the new total time
+        int tNew;
+        int contrast = bright - dark;
+        if (bright >= 250)
+        {
+            // The bright end is saturated, so the contrast reading doesn't
+            // tell us how far off we are.  Just cut the time by a quarter.
+            tNew = tCur - tCur/4;
+        }
+        else if (contrast < aeTarget - aeTarget/4 || contrast > aeTarget + aeTarget/4)
+        {
+            // outside the target band - move halfway to the proportional 
+            // estimate of the target time
+            int tTarget = tCur * aeTarget / (contrast < 8 ? 8 : contrast);
+            tNew = (tCur + tTarget)/2;
+        }
+        else
+        {
+            // within the target band - no change
+            return;
+        }
+        
+        // set the new extra time, within the allowed range
+        int t = tNew - tBase;
+        axcTime = t < 0 ? 0 : t > aeMaxTime ? aeMaxTime : t;
+    }
+    
+    // Does the processor use the prefix sums with its current settings?
+    // init() only allocates the prefix sum buffer if so.
+    virtual bool usesPixSums() const { return false; }
+    
+    // Get the prefix sums for the current frame, for window sum queries.
+    // The sums are built on the first call for each frame, and shared
+    // by any later callers while processing the same frame.  'pix' and
+    // 'n' must be the frame passed to process().  The process() 
+    // implementation must call pixSums.invalidate() at the start of each
+    // frame, and must only call this if pixSums.isAllocated().
+    const PixelPrefixSum &getPixSums(const uint8_t *pix, int n)
+    {
+        if (!pixSums.isValid())
+            pixSums.build(pix, n);
+        return pixSums;
+    }
+    
+    // Number of fractional bits in sub-pixel positions.  Four bits (1/16
+    // pixel) is finer than the interpolation can really resolve, but 
+    // leaves plenty of room in the 16-bit native scale for any of our
+    // sensors (the biggest is the TCD1103, at 1546 pixels).
+    static const int subPixelBits = 4;
+    
     // underlying hardware sensor interface
     PlungerSensorImageInterface &sensor;
     
@@ -625,6 +997,19 @@ protected:
     // the pixel array.
     bool negativeImage;
     
+    // Frame sequence number.  This counts the frames we've taken from
+    // the sensor, for the raw frame capture header, so that the host can
+    // tell how many frames went by between captured frames.
+    uint32_t frameSeq;
+    
+    // Are we processing a frame for a status report?  This is set during
+    // the process() call in sendStatusReport(), so that subclasses can 
+    // leave status frames out of any frame-to-frame state they keep.
+    // Status frames are slow and irregular (each one takes as long as it
+    // takes to send the pixels over USB), so they don't fit in with the
+    // regular stream of readings.
+    bool statusFrame;
+    
     // Auto-exposure time.  This is for use by process() in the subclass.
     // On each frame processing iteration, it can adjust this to optimize
     // the image quality.
@@ -634,6 +1019,52 @@ protected:
     // debugging use to allow the PC user to manually adjust the exposure
     // when inspecting captured frames.
     uint32_t extraIntTime;
+    
+    // Native scale in whole pixels, and the current sub-pixel shift.
+    // process() reports positions in units of (1 << subPixelShift) 
+    // per pixel.  The shift is zero unless the subclass has enabled 
+    // sub-pixel interpolation via setSubPixel().
+    int pixNativeScale;
+    int subPixelShift;
+    
+    // Pixel prefix sums for the current frame.  Use getPixSums() to
+    // access these from process().  The buffer is only allocated if
+    // usesPixSums() returns true at init() time.
+    PixelPrefixSum pixSums;
+    
+    // Multi-frame averager, for noise reduction while the plunger is 
+    // at rest
+    FrameAverager frameAvg;
+    
+    // Auto-exposure settings and state.  aeCount counts frames between
+    // adjustments.  aeMaxTime is the upper limit for axcTime in
+    // microseconds; the limit keeps a dark or empty image from running
+    // the frame rate into the ground.
+    bool aeEnabled;
+    int aeTarget;
+    int aeCount;
+    static const int aeDefaultTarget = 128;
+    static const int aeInterval = 4;
+    static const int aeMaxTime = 2500;
+    
+#if ENABLE_DIAGNOSTICS
+    // Image processing time statistics.  We time each process() call in
+    // readRaw() to collect the average analysis time per frame.  This
+    // covers only the regular readings, not status reports, since the 
+    // status reports are subject to USB delays.  The statistics can only
+    // be read through the diagnostic variables, so we only collect them
+    // in diagnostic builds.
+    Timer processTimer;           // free-running timer for process() timing
+    uint64_t totalProcessTime;    // total time spent in process() so far
+    uint32_t nProcessRuns;        // number of process() calls timed
+    
+    // clear the processing time statistics
+    void resetProcessTime()
+    {
+        totalProcessTime = 0;
+        nProcessRuns = 0;
+    }
+#endif
 };
 
 
@@ -0,0 +1,1160 @@
+// Plunger reader
+//
+// This class encapsulates our plunger data processing.  At the simplest
+// level, we read the position from the sensor, adjust it for the
+// calibration settings, and report the calibrated position to the host.
+//
+// In addition, we constantly monitor the data for "firing" motions.
+// A firing motion is when the user pulls back the plunger and releases
+// it, allowing it to shoot forward under the force of the main spring.
+// When we detect that this is happening, we briefly stop reporting the
+// real physical position that we're reading from the sensor, and instead
+// report a synthetic series of positions that depicts an idealized 
+// firing motion.
+//
+// The point of the synthetic reports is to correct for distortions
+// created by the joystick interface conventions used by VP and other
+// PC pinball emulators.  The convention they use is simply to have the
+// plunger device report the instantaneous position of the real plunger.
+// The PC software polls this reported position periodically, and moves 
+// the on-screen virtual plunger in sync with the real plunger.  This
+// works fine for human-scale motion when the user is manually moving
+// the plunger.  But it doesn't work for the high speed motion of a 
+// release.  The plunger simply moves too fast.  VP polls in about 10ms
+// intervals; the plunger takes about 50ms to travel from fully
+// retracted to the park position when released.  The low sampling
+// rate relative to the rate of change of the sampled data creates
+// a classic digital aliasing effect.  
+//
+// The synthetic reporting scheme compensates for the interface
+// distortions by essentially changing to a coarse enough timescale
+// that VP can reliably interpret the readings.  Conceptually, there
+// are three steps involved in doing this.  First, we analyze the
+// actual sensor data to detect and characterize the release motion.
+// Second, once we think we have a release in progress, we fit the 
+// data to a mathematical model of the release.  The model we use is 
+// dead simple: we consider the release to have one parameter, namely
+// the retraction distance at the moment the user lets go.  This is an 
+// excellent proxy in the real physical system for the final speed 
+// when the plunger hits the ball, and it also happens to match how 
+// VP models it internally.  Third, we construct synthetic reports
+// that will make VP's internal state match our model.  This is also
+// pretty simple: we just need to send VP the maximum retraction
+// distance for long enough to be sure that it polls it at least
+// once, and then send it the park position for long enough to 
+// ensure that VP will complete the same firing motion.  The 
+// immediate jump from the maximum point to the zero point will
+// cause VP to move its simulation model plunger forward from the
+// starting point at its natural spring acceleration rate, which 
+// is exactly what the real plunger just did.
+//
+// The class lives in its own header so that it can be built and tested on
+// the host (see HostTest/), but it's really part of the main program, and
+// it uses several of the main program's globals.  main.cpp includes it at
+// the point where those are defined:
+//
+//   cfg            - the global configuration
+//   plungerSensor  - the plunger sensor object
+//   plungerCalMode - the calibration mode flag
+//   JOYMAX         - the joystick axis range
+//
+
+#ifndef _PLUNGERREADER_H_
+#define _PLUNGERREADER_H_
+
+#include "mbed.h"
+#include "plunger.h"
+#include "alphaBeta.h"
+
+class PlungerReader
+{
+public:
+    PlungerReader()
+    {
+        // not in a firing event yet
+        firing = 0;
+
+        // zero the position and speed
+        z = 0;
+        z0 = 0;
+        prv.pos = 0;
+        prv.t = 0;
+        z0Hold.pos = 0;
+        z0Hold.t = 0;
+        f0.pos = 0;
+        f0.t = 0;
+        
+        // not calibrating
+        calState = 0;
+        
+        // start the latency compensation timer
+        predTimer.start();
+    }
+    
+    // Collect a reading from the plunger sensor.  The main loop calls
+    // this frequently to read the current raw position data from the
+    // sensor.  We analyze the raw data to produce the calibrated
+    // position that we report to the PC via the joystick interface.
+    void read()
+    {
+        // if the sensor is busy, skip the reading on this round
+        if (!plungerSensor->ready())
+            return;
+        
+        // Read a sample from the sensor
+        PlungerReading r;
+        if (plungerSensor->read(r))
+        {
+            // Get the sensor's direct speed measurement, if it has one.
+            // We only use this outside of calibration mode, since we need
+            // the calibration to convert it to joystick units.
+            int vSensor = 0;
+            bool hasSensorSpeed = !plungerCalMode && plungerSensor->readSpeed(vSensor);
+            
+            // check for calibration mode
+            if (plungerCalMode)
+            {
+                // Calibration mode.  Adjust the calibration bounds to fit
+                // the value.  If this value is beyond the current min or max,
+                // expand the envelope to include this new value.
+                if (r.pos > cfg.plunger.cal.max)
+                    cfg.plunger.cal.max = r.pos;
+                if (r.pos < cfg.plunger.cal.min)
+                    cfg.plunger.cal.min = r.pos;
+                    
+                // update our cached calibration data
+                onUpdateCal();
+
+                // If we're in calibration state 0, we're waiting for the
+                // plunger to come to rest at the park position so that we
+                // can take a sample of the park position.  Check to see if
+                // we've been at rest for a minimum interval.
+                if (calState == 0)
+                {
+                    if (abs(r.pos - calZeroStart.pos) < 65535/3/50)
+                    {
+                        // we're close enough - make sure we've been here long enough
+                        if (uint32_t(r.t - calZeroStart.t) > 100000UL)
+                        {
+                            // we've been at rest long enough - count it
+                            calZeroPosSum += r.pos;
+                            calZeroPosN += 1;
+                            
+                            // update the zero position from the new average
+                            cfg.plunger.cal.zero = uint16_t(calZeroPosSum / calZeroPosN);
+                            onUpdateCal();
+                            
+                            // switch to calibration state 1 - at rest
+                            calState = 1;
+                        }
+                    }
+                    else
+                    {
+                        // we're not close to the last position - start again here
+                        calZeroStart = r;
+                    }
+                }
+                
+                // Rescale to the joystick range, and adjust for the current
+                // park position, but don't calibrate.  We don't know the maximum
+                // point yet, so we can't calibrate the range.
+                r.pos = int(
+                    (long(r.pos - cfg.plunger.cal.zero) * JOYMAX)
+                    / (65535 - cfg.plunger.cal.zero));
+            }
+            else
+            {
+                // Not in calibration mode.  Apply the existing calibration and 
+                // rescale to the joystick range.
+                r.pos = applyCal(r.pos);
+                    
+                // limit the result to the valid joystick range
+                if (r.pos > JOYMAX)
+                    r.pos = JOYMAX;
+                else if (r.pos < -JOYMAX)
+                    r.pos = -JOYMAX;
+            }
+
+            // Skip the new sample if less than 1ms has elapsed.  There's
+            // no benefit in sampling more frequently than this, and there's
+            // a cost to sampling too frequently, which is that shorter time
+            // intervals have higher relative uncertainty, which gives our
+            // speed calculation higher relative uncertainty.  The optimal
+            // sampling interval needs to be short enough that we can detect
+            // the direction of motion properly without aliasing after
+            // direction changes, but long enough that we have an accurate
+            // time base for the speed calculation.  1ms is fast enough
+            // because a typical pinball plunger mechanism's top speed is
+            // about 5mm/ms, or about 1/20 of the travel range per ms.  As
+            // long as we sample at a rate where it won't traverse more
+            // than about 1/4 of the travel range per sample, we'll be
+            // able to detect the direction correctly.  So intervals up
+            // to about 4ms still yield good results.
+            static const uint32_t dtMinForSpeed = 1000;
+            if (static_cast<uint32_t>(r.t - speed.nxt.t) < dtMinForSpeed)
+                return;
+
+            // collect the raw reading in the diagnostic log
+            diagnosticMode.Add(static_cast<int16_t>(r.pos));
+
+            // add the new sample into the speed calculation
+            speed.Add(r, hasSensorSpeed, hasSensorSpeed ? applyCalSpeed(vSensor) : 0);
+
+            // For the remainder of this step, switch to the output reading
+            // from the speed calculation.  With the three-point slope, 
+            // that's the "current" position in the history, which is
+            // actually the prior input sample; with the alpha-beta filter,
+            // it's the filtered estimate at the new sample time.  Keep the
+            // new sample's timestamp for the prediction clock offset.
+            uint32_t tIn = r.t;
+            r = speed.out;
+
+            // collect the sample for the batch reports, if enabled
+            sampleBatch.Add(r.pos, speed.vCur, r.t);
+            
+            // remember the latest sample for position prediction
+            pred.Add(r, speed.vCur, tIn, predTimer.read_us());
+
+            // set the new calibrated reading, before firing event detection
+            z0 = r.pos;
+
+            // Check for a Z0 hold in effect.  If we're earlier than the Z0
+            // hold time, use the Z0 hold position.  Otherwise, check for a
+            // new hold: if we're forward of the zero point, and the plunger
+            // just reversed direction, hold the current position for a few
+            // USB reports.  This helps ensure that the simulator doesn't 
+            // miss the forward peak, which can easily happen in the USB 
+            // report cycle samples it just before and then again just
+            // after the peak.
+            const int z0HoldTime = 75000;
+            if (static_cast<uint32_t>(r.t - z0Hold.t) < z0HoldTime)
+            {
+                // Z0 hold in effect
+                z0 = z0Hold.pos;
+            }
+            else if (speed.prvOut.pos < 0 && r.pos > speed.prvOut.pos)
+            {
+                // reversing when forward of the firing line - hold the peak briefly
+                z0Hold.pos = z0 = speed.prvOut.pos;
+                z0Hold.t = r.t;
+            }
+                
+            // Look for a firing event - the user releasing the plunger and
+            // allowing it to shoot forward at full speed.  Wait at least 5ms
+            // between samples for this, to help distinguish random motion 
+            // from the rapid motion of a firing event.  
+            //
+            // There's a trade-off in the choice of minimum sampling interval.
+            // The longer we wait, the more certain we can be of the trend.
+            // But if we wait too long, the user will perceive a delay.  We
+            // also want to sample frequently enough to see the release motion
+            // at intermediate steps along the way, so the sampling has to be
+            // considerably faster than the whole travel time, which is about
+            // 25-50ms.
+            static const uint32_t dtMinForFiringEvent = 5000UL;
+            if (static_cast<uint32_t>(r.t - prv.t) < dtMinForFiringEvent)
+                return;
+
+            // assume that this will also be the fully processed reported value
+            z = r.pos;
+
+            // Firing event detection.
+            //
+            // A "firing event" is when the player releases the plunger from
+            // a retracted position, allowing it to shoot forward under the
+            // spring tension.
+            //
+            // We monitor the plunger motion for these events, and when they
+            // occur, we report an "idealized" version of the motion to the
+            // PC.  The idealized version consists of a series of readings
+            // frozen at the fully retracted position for the whole duration 
+            // of the forward travel, followed by a series of readings at the
+            // fully forward position for long enough for the plunger to come
+            // mostly to rest.  The series of frozen readings aren't meant to
+            // be perceptible to the player - we try to keep them short enough
+            // that they're not apparent as delay.  Instead, they're for the
+            // PC client software's benefit.  PC joystick clients use polling,
+            // so they only see an unpredictable subset of the readings we
+            // send.  The only way to be sure that the client sees a particular 
+            // reading is to hold it for long enough that the client is sure to
+            // poll within the hold interval.  In the case of the plunger 
+            // firing motion, it's important that the client sees the *ends*
+            // of the travel - the fully retracted starting position in
+            // particular.  If the PC client only polls for a sample while the
+            // plunger is somewhere in the middle of the travel, the PC will
+            // think that the firing motion *started* in that middle position,
+            // so it won't be able to model the right amount of momentum when
+            // the plunger hits the ball.  We try to ensure that the PC sees
+            // the right starting point by reporting the starting point for 
+            // extra time during the forward motion.  By the same token, we
+            // want the PC to know that the plunger has moved all the way
+            // forward, rather than mistakenly thinking that it stopped
+            // somewhere in the middle of the travel, so we freeze at the
+            // forward position for a short time.
+            //
+            // To detect a firing event, we look for forward motion that's
+            // fast enough to be a firing event.  To determine how fast is
+            // fast enough, we use a simple model of the plunger motion where 
+            // the acceleration is constant.  This is only an approximation, 
+            // as the spring force actually varies with spring's compression, 
+            // but it's close enough for our purposes here.
+            //
+            // Do calculations in fixed-point 2^48 scale with 64-bit ints.
+            // acc2 = acceleration/2 for 50ms release time, units of unit
+            // distances per microsecond squared, where the unit distance
+            // is the overall travel from the starting retracted position
+            // to the park position.
+            const int32_t acc2 = 112590;  // 2^48 scale
+            switch (firing)
+            {
+            case 0:
+                // Not in firing mode.  If we're retracted a bit, and the
+                // motion is forward at a fast enough rate to look like a
+                // release, enter firing mode.
+                if (r.pos > JOYMAX/6)
+                {
+                    const uint32_t dt = uint32_t(r.t - prv.t);
+                    const uint32_t dt2 = dt*dt;  // dt^2
+                    if (r.pos < prv.pos - int((prv.pos*acc2*uint64_t(dt2)) >> 48))
+                    {
+                        // Tentatively enter firing mode.  Use the prior reading
+                        // as the starting point, and freeze reports for now.
+                        firingMode(1);
+                        f0 = prv;
+                        z = f0.pos;
+
+                        // if in calibration state 1 (at rest), switch to 
+                        // state 2 (not at rest)
+                        if (calState == 1)
+                            calState = 2;
+                    }
+                }
+                break;
+                
+            case 1:
+                // Tentative firing mode: the plunger was moving forward
+                // at last check.  To stay in firing mode, the plunger has
+                // to keep moving forward fast enough to look like it's 
+                // moving under spring force.  To figure out how fast is
+                // fast enough, we use a simple model where the acceleration
+                // is constant over the whole travel distance and the total
+                // travel time is 50ms.  The acceleration actually varies
+                // slightly since it comes from the spring force, which
+                // is linear in the displacement; but the plunger spring is
+                // fairly compressed even when the plunger is all the way
+                // forward, so the difference in tension from one end of
+                // the travel to the other is fairly small, so it's not too
+                // far off to model it as constant.  And the real travel
+                // time obviously isn't a constant, but all we need for 
+                // that is an upper bound.  So: we'll figure the time since 
+                // we entered firing mode, and figure the distance we should 
+                // have traveled to complete the trip within the maximum
+                // time allowed.  If we've moved far enough, we'll stay
+                // in firing mode; if not, we'll exit firing mode.  And if
+                // we cross the finish line while still in firing mode,
+                // we'll switch to the next phase of the firing event.
+                if (r.pos <= 0)
+                {
+                    // We crossed the park position.  Switch to the second
+                    // phase of the firing event, where we hold the reported
+                    // position at the "bounce" position (where the plunger
+                    // is all the way forward, compressing the barrel spring).
+                    // We'll stick here long enough to ensure that the PC
+                    // client (Visual Pinball or whatever) sees the reading
+                    // and processes the release motion via the simulated
+                    // physics.
+                    firingMode(2);
+                    
+                    // if in calibration mode, and we're in state 2 (moving), 
+                    // collect firing statistics for calibration purposes
+                    if (plungerCalMode && calState == 2)
+                    {
+                        // collect a new zero point for the average when we 
+                        // come to rest
+                        calState = 0;
+                        
+                        // collect average firing time statistics in millseconds,
+                        // if it's in range (20 to 255 ms)
+                        const int dt = uint32_t(r.t - f0.t)/1000UL;
+                        if (dt >= 15 && dt <= 255)
+                        {
+                            calRlsTimeSum += dt;
+                            calRlsTimeN += 1;
+                            cfg.plunger.cal.tRelease = uint8_t(calRlsTimeSum / calRlsTimeN);
+                        }
+                    }
+
+                    // Figure the "bounce" position as forward of the park
+                    // position by 1/6 of the starting retraction distance.
+                    // This simulates the momentum of the plunger compressing
+                    // the barrel spring on the rebound.  The barrel spring
+                    // can compress by about 1/6 of the maximum retraction 
+                    // distance, so we'll simply treat its compression as
+                    // proportional to the retraction.  (It might be more
+                    // realistic to use a slightly higher value here, maybe
+                    // 1/4 or 1/3 or the retraction distance, capping it at
+                    // a maximum of 1/6, because the real plunger probably 
+                    // compresses the barrel spring by 100% with less than 
+                    // 100% retraction.  But that won't affect the physics
+                    // meaningfully, just the animation, and the effect is
+                    // small in any case.)
+                    z = f0.pos = -f0.pos / 6;
+                    
+                    // reset the starting time for this phase
+                    f0.t = r.t;
+                }
+                else
+                {
+                    // check for motion since the start of the firing event
+                    const uint32_t dt = uint32_t(r.t - f0.t);
+                    const uint32_t dt2 = dt*dt;  // dt^2
+                    if (dt < 50000 
+                        && r.pos < f0.pos - int((f0.pos*acc2*uint64_t(dt2)) >> 48))
+                    {
+                        // It's moving fast enough to still be in a release
+                        // motion.  Continue reporting the start position, and
+                        // stay in the first release phase.
+                        z = f0.pos;
+                    }
+                    else
+                    {
+                        // It's not moving fast enough to be a release
+                        // motion.  Return to the default state.
+                        firingMode(0);
+                        calState = 1;
+                    }
+                }
+                break;
+                
+            case 2:
+                // Firing mode, holding at forward compression position.
+                // Hold here for 25ms.
+                if (uint32_t(r.t - f0.t) < 25000)
+                {
+                    // stay here for now
+                    z = f0.pos;
+                }
+                else
+                {
+                    // advance to the next phase, where we report the park
+                    // position until the plunger comes to rest
+                    firingMode(3);
+                    z = 0;
+
+                    // remember when we started
+                    f0.t = r.t;
+                }
+                break;
+                
+            case 3:
+                // Firing event, holding at park position.  Stay here for
+                // a few moments so that the PC client can simulate the
+                // full release motion, then return to real readings.
+                if (uint32_t(r.t - f0.t) < 250000)
+                {
+                    // stay here a while longer
+                    z = 0;
+                }
+                else
+                {
+                    // it's been long enough - return to normal mode
+                    firingMode(0);
+                }
+                break;
+            }
+            
+            // Check for auto-zeroing, if enabled
+            if ((cfg.plunger.autoZero.flags & PlungerAutoZeroEnabled) != 0)
+            {
+                // If we moved since the last reading, reset and restart the 
+                // auto-zero timer.  Otherwise, if the timer has reached the 
+                // auto-zero timeout, it means we've been motionless for that 
+                // long, so auto-zero now.                
+                if (r.pos != prv.pos)
+                {
+                    // movement detected - reset the timer
+                    autoZeroTimer.reset();
+                    autoZeroTimer.start();
+                }
+                else if (autoZeroTimer.read_us() > cfg.plunger.autoZero.t * 1000000UL)
+                {
+                    // auto-zero now
+                    plungerSensor->autoZero();
+                    
+                    // stop the timer so that we don't keep repeating this
+                    // if the plunger stays still for a long time
+                    autoZeroTimer.stop();
+                    autoZeroTimer.reset();
+                }
+            }
+            
+            // this new reading becomes the previous reading for next time
+            prv = r;
+        }
+    }
+    
+    // Get the current value to report through the joystick interface.
+    // This is the processed position, without latency compensation.
+    int16_t getPosition() const
+    {
+        // return the last processed reading
+        return z;
+    }
+
+    // Get the position to send in a joystick report.  This is the same
+    // as getPosition(), except that if latency compensation is enabled,
+    // we extrapolate the position to the current time plus the lookahead.
+    //
+    // The sample timestamps come from the sensor's own timer, which has
+    // an arbitrary zero point, so we can't compare them directly to our
+    // own timer.  But all of the mbed timers count the same microsecond
+    // ticker, so the difference between the clocks is constant.  We
+    // estimate it as the smallest difference between our clock when we
+    // receive a sample and the sample's timestamp, over the last one to 
+    // two seconds (see PredictionData::Add).  That includes
+    // the sensor's minimum processing delay, which the prediction thus 
+    // leaves out; the lookahead can cover it if it's significant.
+    int16_t getReportPosition()
+    {
+        // only predict when enabled and we're reporting live positions
+        if ((cfg.plunger.motion.flags & 0x01) == 0 || firing != 0 || !pred.valid)
+            return z;
+        
+        // Don't extrapolate forward motion from the retracted position,
+        // since that could be the start of a release, which the firing
+        // event processing handles.  We'd otherwise report the plunger
+        // moving forward, then jumping back to the start position when
+        // the firing event begins.  Report the processed position, as 
+        // with prediction off.
+        if (pred.v < 0 && pred.pos > JOYMAX/6)
+            return z;
+        
+        // figure the sample age on the sensor clock
+        int32_t age = static_cast<int32_t>(predTimer.read_us() - pred.ofs - pred.t);
+        if (age < 0)
+            age = 0;
+        
+        // if the sample is too old, don't try to predict
+        if (age > 50000)
+            return z;
+        
+        // extrapolate to now plus the lookahead
+        int32_t dt = age + lookaheadTime();
+        int pos = pred.pos + pred.v * dt / 10000;
+        return pos < -JOYMAX ? -JOYMAX : pos > JOYMAX ? JOYMAX : pos;
+    }
+
+    // Get the current pre-firing-event value
+    int16_t getPosition0() const
+    {
+        // return the last unprocessed reading
+        return z0;
+    }
+
+    int16_t getSpeed()
+    {
+        // return the recent peak forward (negative) speed reading
+        return speed.peak.pos;
+    }
+        
+    // Set calibration mode on or off
+    void setCalMode(bool f) 
+    {
+        // check to see if we're entering calibration mode
+        if (f && !plungerCalMode)
+        {
+            // reset the calibration in the configuration
+            cfg.plunger.cal.begin();
+            
+            // start in state 0 (waiting to settle)
+            calState = 0;
+            calZeroPosSum = 0;
+            calZeroPosN = 0;
+            calRlsTimeSum = 0;
+            calRlsTimeN = 0;
+            
+            // tell the plunger we're starting calibration
+            plungerSensor->beginCalibration(cfg);
+            
+            // set the initial zero point to the current position
+            PlungerReading r;
+            if (plungerSensor->read(r))
+            {
+                // got a reading - use it as the initial zero point
+                cfg.plunger.cal.zero = r.pos;
+                onUpdateCal();
+                
+                // use it as the starting point for the settling watch
+                calZeroStart = r;
+            }
+            else
+            {
+                // no reading available - use the default 1/6 position
+                cfg.plunger.cal.zero = 0xffff/6;
+                onUpdateCal();
+                
+                // we don't have a starting point for the setting watch
+                calZeroStart.pos = -65535;
+                calZeroStart.t = 0;
+            }
+        }
+        else if (!f && plungerCalMode)
+        {
+            // Leaving calibration mode.  Make sure the max is past the
+            // zero point - if it's not, we'd have a zero or negative
+            // denominator for the scaling calculation, which would be
+            // physically meaningless.
+            if (cfg.plunger.cal.max <= cfg.plunger.cal.zero)
+            {
+                // bad settings - reset to defaults
+                cfg.plunger.cal.max = 0xffff;
+                cfg.plunger.cal.zero = 0xffff/6;
+            }
+            
+            // finalize the configuration in the plunger object
+            plungerSensor->endCalibration(cfg);
+
+            // update our internal cached information for the new calibration
+            onUpdateCal();
+        }
+            
+        // remember the new mode
+        plungerCalMode = f; 
+    }
+    
+    // Cached inverse of the calibration range.  This is for calculating
+    // the calibrated plunger position given a raw sensor reading.  The
+    // cached inverse is calculated as
+    //
+    //    64K * JOYMAX / (cfg.plunger.cal.max - cfg.plunger.cal.zero)
+    //
+    // To convert a raw sensor reading to a calibrated position, calculate
+    //
+    //    ((reading - cfg.plunger.cal.zero)*invCalRange) >> 16
+    //
+    // That yields the calibration result without performing a division.
+    int invCalRange;
+    
+    // apply the calibration range to a reading
+    inline int applyCal(int reading)
+    {
+        return ((reading - cfg.plunger.cal.zero)*invCalRange) >> 16;
+    }
+    
+    // Apply the calibration to a sensor speed reading, converting from
+    // abstract-scale units per second to joystick units per centisecond
+    inline int applyCalSpeed(int v)
+    {
+        return int((int64_t(v) * invCalRange) >> 16) / 100;
+    }
+    
+    void onUpdateCal()
+    {
+        invCalRange = (JOYMAX << 16)/(cfg.plunger.cal.max - cfg.plunger.cal.zero);
+    }
+
+    // is a firing event in progress?
+    bool isFiring() { return firing == 3; }
+    
+    // Get the firing event state (0-3; see the 'firing' member).  This
+    // is for checking the firing event detection against recorded traces
+    // (see Plunger/traceReplay.h).
+    int getFiringState() const { return firing; }
+
+    // Diagnostic mode
+    void SetDiagnosticMode(bool enable) { diagnosticMode.enabled = enable; }
+    bool IsDiagnosticMode() const { return diagnosticMode.enabled; }
+    void PopulateDiagnosticReport(uint8_t *buf, size_t buflen) { diagnosticMode.PopulateReport(buf, buflen); }
+    
+    // Sample batch report mode
+    void SetBatchMode(bool enable) { sampleBatch.Enable(enable); }
+    bool IsBatchPending() const { return sampleBatch.nSamples != 0; }
+    void PopulateBatchReport(uint8_t *buf, size_t buflen) { sampleBatch.PopulateReport(buf, buflen); }
+    
+private:
+    // Diagnostic mode
+    struct DiagnosticMode
+    {
+        DiagnosticMode()
+        {
+            enabled = false;
+            nReadings = 0;
+            writeIdx = 0;
+        }
+
+        // mode enabled
+        bool enabled;
+
+        // recent readings
+        static const int MAX_READINGS = 10;
+        int16_t readings[MAX_READINGS];
+        int nReadings;
+        int writeIdx;
+
+        // add a reading
+        void Add(int16_t r) 
+        { 
+            readings[writeIdx++] = r;
+            if (writeIdx >= MAX_READINGS) writeIdx = 0;
+            if (++nReadings > MAX_READINGS) nReadings = MAX_READINGS;
+        }
+
+        // populate a USB report
+        void PopulateReport(uint8_t *buf, size_t buflen)
+        {
+            int nReported = (buflen - 2)/2;
+            if (nReported > nReadings) nReported = nReadings;
+            buf[0] = static_cast<uint8_t>(nReported);
+            buf[1] = 0;
+            Get(&buf[2], nReported);
+        }
+
+        // Get readings into a USB buffer, most recent first.  Clears the
+        // buffer by resetting the reading count.
+        void Get(uint8_t *buf, int n)
+        {
+            int idx = writeIdx - 1;
+            for (int i = 0 ; i < n && i < nReadings ; ++i, --idx)
+            {
+                if (idx < 0) idx = MAX_READINGS - 1;
+                int r = readings[idx];
+                *buf++ = static_cast<uint8_t>(r & 0xFF);
+                *buf++ = static_cast<uint8_t>((r >> 8) & 0xFF);
+            }
+            nReadings = 0;
+        }
+    } diagnosticMode;
+    
+    // Sample batch reports.  When enabled, we buffer each processed
+    // sample with its speed and timestamp, so that the main loop can pass
+    // them back to the host in batch reports, several samples per report.
+    // If the buffer fills before the main loop sends the samples, we 
+    // discard the oldest ones; the host can detect the gap from the 
+    // sample sequence numbers.
+    struct SampleBatch
+    {
+        SampleBatch()
+        {
+            Enable(false);
+        }
+        
+        // turn batch mode on or off, clearing the buffer
+        void Enable(bool enable)
+        {
+            enabled = enable;
+            nSamples = 0;
+            writeIdx = 0;
+            seq = 0;
+            tPrv = 0;
+        }
+        
+        // mode enabled
+        bool enabled;
+        
+        // buffered samples
+        struct Sample
+        {
+            int16_t pos;        // position, joystick units
+            int16_t speed;      // speed, joystick units per centisecond
+            uint32_t t;         // timestamp, microseconds
+        };
+        static const int MAX_SAMPLES = 16;
+        Sample samples[MAX_SAMPLES];
+        int nSamples;
+        int writeIdx;
+        
+        // sequence number of the oldest buffered sample
+        uint8_t seq;
+        
+        // timestamp of the sample just before the oldest buffered sample
+        uint32_t tPrv;
+        
+        // add a sample
+        void Add(int pos, int speed, uint32_t t)
+        {
+            if (!enabled)
+                return;
+            
+            // if the buffer is full, drop the oldest sample, which is the
+            // one we're about to overwrite
+            if (nSamples == MAX_SAMPLES)
+            {
+                tPrv = samples[writeIdx].t;
+                ++seq;
+                --nSamples;
+            }
+            
+            // Store the sample.  Clamp the position and speed to the 
+            // -4096..+4095 range of the 13-bit fields in the report, so 
+            // that a reading at the maximum retraction (+4096) doesn't
+            // wrap around to -4096.
+            Sample &s = samples[writeIdx];
+            s.pos = static_cast<int16_t>(pos < -4096 ? -4096 : pos > 4095 ? 4095 : pos);
+            s.speed = static_cast<int16_t>(speed < -4096 ? -4096 : speed > 4095 ? 4095 : speed);
+            s.t = t;
+            if (++writeIdx >= MAX_SAMPLES) writeIdx = 0;
+            ++nSamples;
+        }
+        
+        // Populate a USB report with the oldest buffered samples, removing
+        // them from the buffer
+        void PopulateReport(uint8_t *buf, size_t buflen)
+        {
+            memset(buf, 0, buflen);
+            int n = (buflen - 6)/4;
+            if (n > nSamples) n = nSamples;
+            
+            int idx = writeIdx - nSamples;
+            if (idx < 0) idx += MAX_SAMPLES;
+            
+            buf[0] = 0x00;
+            buf[1] = 0xA3;
+            buf[2] = static_cast<uint8_t>(n);
+            buf[3] = seq;
+            uint32_t t10 = samples[idx].t / 10;
+            buf[4] = static_cast<uint8_t>(t10 & 0xFF);
+            buf[5] = static_cast<uint8_t>((t10 >> 8) & 0xFF);
+            
+            for (int i = 0, ofs = 6 ; i < n ; ++i, ofs += 4)
+            {
+                const Sample &s = samples[idx];
+                uint32_t dt = (s.t - tPrv)/100;
+                if (dt > 63) dt = 63;
+                uint32_t v = (static_cast<uint32_t>(s.pos) & 0x1FFF)
+                    | ((static_cast<uint32_t>(s.speed) & 0x1FFF) << 13)
+                    | (dt << 26);
+                buf[ofs] = static_cast<uint8_t>(v & 0xFF);
+                buf[ofs+1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+                buf[ofs+2] = static_cast<uint8_t>((v >> 16) & 0xFF);
+                buf[ofs+3] = static_cast<uint8_t>((v >> 24) & 0xFF);
+                
+                tPrv = s.t;
+                ++seq;
+                if (++idx >= MAX_SAMPLES) idx = 0;
+            }
+            nSamples -= n;
+        }
+    } sampleBatch;
+
+    // Current reported joystick reading, after caliobration and
+    // firing-event processing.
+    int z;
+
+    // Current reading, after calibration but before firing-event processing
+    int z0;
+
+    // Z0 hold.  Z0 is nominally the position reading without firing-event
+    // processing, but there is still one element we apply: when the plunger
+    // reaches the forward end of its travel and starts bouncing back, we
+    // we hold the reading in the forward position for an extra couple of
+    // USB cycles.  The reason this is needed is that the bounce-back can
+    // be so quick that the simulator never sees the fully forward position
+    // at all, as the USB reports often align just before and after the
+    // bounce.  This manifests in the simulator as a delayed firing time,
+    // since the simulator doesn't see the plunger hit the ball until some
+    // later bounce cycle that does happen to align with the USB reports.
+    PlungerReading z0Hold;
+
+    // previous reading, for firing event detection
+    PlungerReading prv;
+    
+    // Latency compensation: the latest output sample, and the estimated
+    // offset between our prediction timer and the sensor's clock
+    struct PredictionData
+    {
+        PredictionData()
+        {
+            valid = false;
+            pos = 0;
+            v = 0;
+            t = 0;
+            ofs = 0;
+            winMin = prvWinMin = 0;
+            winStart = 0;
+        }
+        
+        // Add an output sample.  'tIn' is the timestamp of the input
+        // sample just received, and 'tNow' is the prediction timer time.
+        // The clock offset comes from the input sample, since the output
+        // sample can be older (one sample behind, with the three-point 
+        // slope), and the prediction has to cover that age.
+        void Add(const PlungerReading &r, int vNow, uint32_t tIn, uint32_t tNow)
+        {
+            // Update the clock offset estimate.  This is the minimum lag
+            // over the current window and the one before it, so that an
+            // unusually short lag ages out after a window or two instead
+            // of setting the offset for good.
+            uint32_t lag = tNow - tIn;
+            if (!valid)
+            {
+                winMin = prvWinMin = lag;
+                winStart = tNow;
+            }
+            else if (tNow - winStart >= offsetWindow)
+            {
+                prvWinMin = winMin;
+                winMin = lag;
+                winStart = tNow;
+            }
+            else if (static_cast<int32_t>(lag - winMin) < 0)
+            {
+                winMin = lag;
+            }
+            ofs = static_cast<int32_t>(winMin - prvWinMin) < 0 ? winMin : prvWinMin;
+            
+            pos = r.pos;
+            t = r.t;
+            v = vNow;
+            valid = true;
+        }
+        
+        bool valid;     // do we have a sample yet?
+        int pos;        // latest position, joystick units
+        int v;          // speed at the latest sample, joystick units per centisecond
+        uint32_t t;     // timestamp of the latest sample, sensor clock
+        uint32_t ofs;   // prediction timer time minus sensor time
+        
+        // minimum lag in the current and previous windows, and the 
+        // prediction timer time at the start of the current window
+        static const uint32_t offsetWindow = 1000000;
+        uint32_t winMin;
+        uint32_t prvWinMin;
+        uint32_t winStart;
+    } pred;
+    
+    // prediction timer
+    Timer predTimer;
+    
+    // Get the configured prediction lookahead time in microseconds, or
+    // zero if latency compensation is disabled
+    int32_t lookaheadTime() const
+    {
+        if ((cfg.plunger.motion.flags & 0x01) == 0)
+            return 0;
+        int ms = cfg.plunger.motion.lookahead;
+        return (ms > 50 ? 50 : ms) * 1000;
+    }
+
+    // For the speed, we maintain a three-element history: previous, 
+    // current, and next.  The current speed is the slope across the
+    // previous and next reading.  The previous/current/next designations
+    // are for the *output* side, of course, as we can't know the next
+    // reading until we read it, at which point it's the current one on
+    // the input side.
+    //
+    // For rapid forward motions that resemble firing events, we also
+    // track the starting point of the forward motion.  This lets us
+    // figure the speed based on an assumption of constant acceleration
+    // from the starting position.  That has a longer time base than
+    // the span between adjacent sensor readings, which makes the speed
+    // calculation more consistent.
+    //
+    // Alternatively, if the configuration selects the alpha-beta speed
+    // estimator, we run each sample through a position/velocity tracking
+    // filter, and take both the output position and the speed from the
+    // filter.  The filter's estimates apply to the newest sample, so this
+    // mode doesn't have the one-sample lag of the three-point history.
+    struct SpeedData
+    {
+        SpeedData()
+        {
+            prv.pos = cur.pos = nxt.pos = out.pos = prvOut.pos = 0;
+            prv.t = cur.t = nxt.t = out.t = prvOut.t = 0;
+            estActive = false;
+            vCur = 0;
+        }
+
+        // Rotate in a sample.  If the sensor measured the speed directly,
+        // hasSensorSpeed is true and vSensor is the measured speed in the
+        // same units as our calculated speed.
+        void Add(PlungerReading &r, bool hasSensorSpeed = false, int vSensor = 0)
+        {
+            // rotate in the sample
+            prv = cur;
+            cur = nxt;
+            nxt = r;
+            
+            // the last output reading becomes the previous one
+            prvOut = out;
+            
+            // If the alpha-beta estimator is selected, feed it the new
+            // sample, and take the output position from its estimate.
+            // Otherwise, the output is the center point of the three-point
+            // history.  Reset the filter whenever we switch into this mode,
+            // so that it doesn't start from a stale estimate.
+            bool useEst = (cfg.plunger.motion.mode == 1);
+            if (useEst)
+            {
+                if (!estActive)
+                    est.reset();
+                est.setTimeConstant(cfg.plunger.motion.tau * 100);
+                est.update(r.pos, r.t);
+                
+                int pos = est.getPosition();
+                out.pos = (pos < -JOYMAX ? -JOYMAX : pos > JOYMAX ? JOYMAX : pos);
+                out.t = r.t;
+            }
+            else
+            {
+                out = cur;
+            }
+            estActive = useEst;
+
+            // Calculate the speed as the slope from previous to next.
+            // The units are normalized joystick Z axis units per centisecond
+            // (1/100ths of a second, or 10ms).  The native timestamps are in
+            // microseconds, and there are 10,000 us per cs, to multiply the
+            // ds/dt value by 10000 to get Z/cs speed units.  The reason we
+            // use centiseconds as the time unit for the speed reports is that
+            // it yields speed values that fit well into the available range
+            // of the joystick reports.  The maximum speed for a mechanical
+            // plunger is about 4.5mm/ms, according to practical measurements,
+            // which is 45mm/cs, or 2764 Z/cs, with the calibrated maximum
+            // retraction point at 4096 and the calibrated rest at zero.
+            // The joystick reports can handle +/- 4095, so a practical max
+            // reading of 2764 uses most of the available range, but leaves
+            // some headroom for mechanisms that are faster than the ones
+            // I've tested.  Using "most of the range" is good because it
+            // takes advantage of the available precision, and headroom is
+            // good because it avoids clipping if we exceed the maximum.
+            //
+            // If the sensor measures the speed directly, use its reading
+            // instead.  The sensor's own measurement is generally better,
+            // especially at low speeds, where the position only changes
+            // by a few units between readings.  Otherwise, if the alpha-
+            // beta estimator is active, use its velocity estimate, which
+            // is in the same units.
+            int v;
+            if (hasSensorSpeed)
+            {
+                v = vSensor;
+            }
+            else if (useEst)
+            {
+                v = est.getSpeed();
+            }
+            else
+            {
+                float dt = static_cast<float>(static_cast<uint32_t>(nxt.t - prv.t));
+                float ds = static_cast<float>(nxt.pos - prv.pos);
+                v = static_cast<int>(ds / dt * 10000.0f);
+            }
+
+            // limit the velocity to the joystick range
+            v = (v < -JOYMAX ? -JOYMAX : v > JOYMAX ? JOYMAX : v);
+            vCur = v;
+
+            // If we've reached the peak speed hold time, or this is a new
+            // peak speed, record the current speed as the new peak speed.
+            // We only care about forward peak speeds, which are negative.
+            //
+            // The hold time is intended to ensure that the simulator sees
+            // the peak reading, even if misses one or two of our HID reports.
+            // Analog axis values in HID reports are generally meant to be
+            // treated as instantaneous states, not "events".  This is
+            // important because it means that applications don't have to
+            // process every report: they can skip as many as they like and
+            // still get the latest state as soon as they read a new report,
+            // since every report contains the full current state of the
+            // sensors and thus supersedes all prior reports.  The problem
+            // this creates for the speed axis is that the simulator might
+            // not happen to sample the speed axis at exactly the time when
+            // the simulated plunger hit the ball.  It will read whatever
+            // speed the device happens to report at that point in the
+            // simulation, which may be quite different from the
+            // collision-point speed.  Holding the peak speed is meant to
+            // make the collision speeds more consistent by assuming that
+            // plungers are normally situated so that they hit the ball at
+            // roughly at the end of their travel, where the speed is at
+            // its highest.  So the peak speed should also be the collision
+            // speed.  Holding this for a few reports helps ensure that the
+            // simulator sees the peak speed even if it doesn't detect the
+            // collision until a few HID cycles after the mecahnical plunger
+            // passed the notional collision point.
+            //
+            // Since the speed isn't visible to the user in the simulation,
+            // we can hold it for a relatively extended time, to be sure
+            // that the simulator sees the value we want it to see.
+            const int peakSpeedHoldTime = 100000;
+            if (static_cast<uint32_t>(r.t - peak.t) > peakSpeedHoldTime || v < peak.pos)
+            {
+                peak.pos = v;
+                peak.t = r.t;
+            }
+        }
+
+        // three-point history of recent position readings, for the slope calculation
+        PlungerReading prv;
+        PlungerReading cur;
+        PlungerReading nxt;
+        
+        // current and previous output readings
+        PlungerReading out;
+        PlungerReading prvOut;
+        
+        // alpha-beta estimator, and flag: estimator was active on the last sample
+        AlphaBetaFilter est;
+        bool estActive;
+
+        // peak speed reading (peak.pos is a speed, not a position)
+        PlungerReading peak;
+        
+        // latest instantaneous speed reading
+        int vCur;
+    };
+    SpeedData speed;
+
+    // Calibration state.  During calibration mode, we watch for release
+    // events, to measure the time it takes to complete the release
+    // motion; and we watch for the plunger to come to reset after a
+    // release, to gather statistics on the rest position.
+    //   0 = waiting to settle
+    //   1 = at rest
+    //   2 = retracting
+    //   3 = possibly releasing
+    uint8_t calState;
+    
+    // Calibration zero point statistics.
+    // During calibration mode, we collect data on the rest position (the 
+    // zero point) by watching for the plunger to come to rest after each 
+    // release.  We average these rest positions to get the calibrated 
+    // zero point.  We use the average because the real physical plunger 
+    // itself doesn't come to rest at exactly the same spot every time, 
+    // largely due to friction in the mechanism.  To calculate the average,
+    // we keep a sum of the readings and a count of samples.
+    PlungerReading calZeroStart;
+    long calZeroPosSum;
+    int calZeroPosN;
+    
+    // Calibration release time statistics.
+    // During calibration, we collect an average for the release time.
+    long calRlsTimeSum;
+    int calRlsTimeN;
+
+    // Auto-zeroing timer
+    Timer autoZeroTimer;
+    
+    // set a firing mode
+    inline void firingMode(int m) 
+    {
+        firing = m;
+    }
+    
+    // Firing event state.
+    //
+    //   0 - Default state: not in firing event.  We report the true
+    //       instantaneous plunger position to the joystick interface.
+    //
+    //   1 - Moving forward at release speed
+    //
+    //   2 - Firing - reporting the bounce position
+    //
+    //   3 - Firing - reporting the park position
+    //
+    int firing;
+    
+    // Starting position for current firing mode phase
+    PlungerReading f0;
+};
+
+#endif /* _PLUNGERREADER_H_ */
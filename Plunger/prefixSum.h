@@ -0,0 +1,125 @@
+// Pixel prefix sums
+//
+// This is a helper for the image sensor processors, for calculating the
+// sum of the pixels over any window of an image in constant time.  The
+// idea is to make one pass over the image to compute the running total
+// at each pixel - the "prefix sums", where sums[i] is the sum of all of
+// the pixels before pixel i.  The sum over any range of pixels [a, b) 
+// is then simply sums[b] - sums[a].  This is the one-dimensional version
+// of the "integral image" used in a lot of 2D image processing work.
+//
+// Many of our image processing algorithms work in terms of window sums
+// (averages, really, but we skip the division wherever we can), so this
+// lets them look at as many windows as they want, at any positions and
+// widths, without any per-pixel work beyond the initial pass.  It also
+// lets several algorithms share the same work when they run on the same
+// frame.
+//
+// We store the sums as 16-bit values to save memory, since RAM is
+// precious on the KL25Z.  The full sums overflow 16 bits, of course, but
+// that's okay: we do the subtraction for a window mod 2^16 as well, and
+// modular arithmetic gives us the exact window sum as long as the true
+// sum fits in 16 bits.  For 8-bit pixels, that's guaranteed for windows
+// up to 257 pixels wide (257*255 = 65535), which is far wider than
+// anything we need.
+//
+// The buffer takes 2 bytes per pixel, which is significant for the 
+// larger sensors (about 3K for a TSL1412R or TCD1103), so the sensor only
+// allocates it at startup, when it's initialized, and only if the 
+// configured processor actually uses it.  Allocating later could run us
+// out of memory in the middle of a session, which halts the device (our
+// allocator has no way to fail gracefully), so a processor that needs
+// the sums has to check isAllocated() and fall back on some other method
+// if they're not available.
+
+#ifndef _PREFIXSUM_H_
+#define _PREFIXSUM_H_
+
+#include "mbed.h"
+#include "NewMalloc.h"
+
+class PixelPrefixSum
+{
+public:
+    PixelPrefixSum()
+    {
+        sums = 0;
+        nAlloc = 0;
+        valid = false;
+    }
+    
+    // Allocate the buffer for an image of n pixels.  This should only 
+    // be called during initialization.  If there isn't enough free 
+    // memory, we leave the buffer unallocated.  Returns true if the 
+    // buffer is available.
+    bool allocate(int n)
+    {
+        if (sums == 0)
+        {
+            // leave a reserve for any allocations that follow ours
+            const size_t reserve = 512;
+            size_t need = ((n + 1)*sizeof(uint16_t) + 3) & ~3;
+            if (mallocBytesFree() >= need + reserve)
+            {
+                sums = new uint16_t[n + 1];
+                nAlloc = n;
+            }
+        }
+        return sums != 0;
+    }
+    
+    // is the buffer allocated?
+    bool isAllocated() const { return sums != 0; }
+    
+    // Build the prefix sums for an image.  The buffer must have been 
+    // allocated for at least n pixels; if not, we leave the sums invalid.
+    void build(const uint8_t *pix, int n)
+    {
+        if (n > nAlloc)
+        {
+            valid = false;
+            return;
+        }
+        
+        // figure the running totals
+        uint16_t s = 0;
+        uint16_t *p = sums;
+        *p++ = 0;
+        for (int i = n ; i != 0 ; --i)
+            *p++ = (s += *pix++);
+            
+        // the sums are now valid for this frame
+        valid = true;
+    }
+    
+    // Invalidate the sums.  The image processors call this at the start
+    // of each process() call, so that the sums are rebuilt on first use
+    // for each new frame.
+    void invalidate() { valid = false; }
+    
+    // are the sums valid for the current frame?
+    bool isValid() const { return valid; }
+    
+    // Get the sum of pixels over the range [a, b), where a and b are
+    // pixel indices in 0..n.  Returns zero for an empty range.  The 
+    // window must be no wider than maxWindow pixels.
+    inline unsigned int sum(int a, int b) const
+    {
+        return b > a ? uint16_t(sums[b] - sums[a]) : 0;
+    }
+    
+    // Maximum window width that sum() can handle without overflow
+    static const int maxWindow = 257;
+    
+protected:
+    // Prefix sums.  sums[i] is the sum of pixels 0..i-1, mod 2^16.
+    uint16_t *sums;
+    
+    // allocated pixel capacity of the buffer
+    int nAlloc;
+    
+    // are the sums valid for the current frame?
+    bool valid;
+};
+
+#endif /* _PREFIXSUM_H_ */
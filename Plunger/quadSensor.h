@@ -75,11 +75,37 @@
 // within both limits, but FastInterruptIn gives us a little more headroom
 // for substituting other sensors with higher pulse rates.
 //
+// Speed measurement.  In addition to counting the pulses, we timestamp
+// each one, and figure the speed from the time between pulses.  That's
+// much more precise than differencing the position readings, which is
+// what the main loop does for other sensor types, particularly at low
+// speeds: at a few pulses per millisecond, a position difference over 
+// a 1ms sampling interval is only good to one part in a few, whereas
+// the pulse period can be timed to a fraction of a microsecond.  For
+// the timestamps, we use the Cortex-M SysTick counter, which counts CPU
+// clock cycles.  Reading it is a single register load, so it adds almost
+// nothing to the interrupt handler, and it gives us cycle-accurate times.
+// (SysTick is otherwise unused in this firmware: the mbed library uses
+// the PIT for its microsecond timer.)  The interrupt handler writes the
+// timestamps into a small ring buffer, which the main loop reads when it
+// wants a speed reading.  The ring is lock-free: the interrupt handler 
+// is the only writer, and the main loop reader just checks afterwards
+// that the handler didn't lap it while it was reading.
+//
+// We also count "illegal" transitions, which skip a quadrature state (or
+// repeat the current one).  Those can only happen if we missed an edge
+// interrupt, so they show whether the sensor's pulse rate is within the
+// interrupt capacity.  The count is reported in the status report,
+// along with the total edge count.  When diagnostics are enabled, we also
+// collect edge timing statistics (see edgeStats.h), to measure how much
+// headroom the interrupt handler has at the encoder's peak pulse rate.
+//
 
 #ifndef _QUADSENSOR_H_
 #define _QUADSENSOR_H_
 
 #include "FastInterruptIn.h"
+#include "edgeStats.h"
 
 class PlungerSensorQuad: public PlungerSensor
 {
@@ -111,6 +137,18 @@ public:
         st = (chA.read() ? 0x01 : 0x00) 
              | (chB.read() ? 0x02 : 0x00);
         
+        // no edges recorded yet
+        nEdges = 0;
+        nEdgesSeen = 0;
+        tEdgeSeen = 0;
+        
+        // Start the SysTick counter free-running at the CPU clock rate, 
+        // with the full 24-bit range and no interrupt, for the edge
+        // timestamps
+        SysTick->LOAD = 0xFFFFFF;
+        SysTick->VAL = 0;
+        SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+        
         // set up the interrupt handlers
         chA.rise(&PlungerSensorQuad::aUp, this);
         chA.fall(&PlungerSensorQuad::aDown, this);
@@ -149,6 +187,100 @@ public:
         // the sensor.
         r.t = timer.read_us();
         
+        // Note the time whenever we see new edges.  The SysTick timestamps
+        // wrap around every few hundred milliseconds, so the speed reader
+        // uses this to tell how long it's been since the last edge.
+        uint32_t n = nEdges;
+        if (n != nEdgesSeen)
+        {
+            nEdgesSeen = n;
+            tEdgeSeen = r.t;
+        }
+        
+        // success
+        return true;
+    }
+    
+    // Read the speed, in pulses per second, from the edge timestamps
+    virtual bool readRawSpeed(int &v)
+    {
+        // If we haven't seen an edge in a while, the plunger is at rest.
+        // This also ensures that the SysTick time since the last edge
+        // hasn't wrapped.
+        uint32_t now = timer.read_us();
+        if (nEdgesSeen == 0 || now - tEdgeSeen > maxEdgeAge)
+        {
+            v = 0;
+            return true;
+        }
+        
+        // Snapshot the most recent edges from the ring, newest first.  If
+        // the interrupt handler wrote enough new edges while we were 
+        // reading to overwrite the ones we were reading, try again.
+        uint32_t e[maxSpeedEdges + 1];
+        uint32_t cnt;
+        int n;
+        do
+        {
+            cnt = nEdges;
+            n = cnt < maxSpeedEdges + 1 ? cnt : maxSpeedEdges + 1;
+            for (int i = 0 ; i < n ; ++i)
+                e[i] = edgeRing[(cnt - 1 - i) & (ringSize - 1)];
+        } while (nEdges - cnt > ringSize - (maxSpeedEdges + 1));
+        
+        // get the current SysTick time, for the time since the last edge
+        uint32_t ticksNow = SysTick->VAL;
+        
+        // If the latest edge was illegal, we don't know the direction, and
+        // if the SysTick counter wrapped since the edge before it, we don't
+        // know its period.  Either way, let the caller fall back on the
+        // position readings.  (The wrap only affects the one edge, so this
+        // only lasts until the next edge.)
+        if (n == 0 || (e[0] & (edgeIllegal | edgeGap)) != 0)
+            return false;
+        
+        // Add up the periods between consecutive edges, going back from
+        // the newest, until we reach a direction change or a gap in the 
+        // timing, or we have enough time or edges for a good average.  
+        // Note that SysTick counts down, so the elapsed time is the older
+        // timestamp minus the newer one, mod 2^24.
+        bool rev = (e[0] & edgeRev) != 0;
+        uint32_t span = 0;
+        int nPeriods = 0;
+        uint32_t maxSpan = SystemCoreClock / 500;
+        for (int i = 1 ; i < n && span < maxSpan ; ++i)
+        {
+            if ((e[i-1] & edgeGap) != 0
+                || (e[i] & edgeIllegal) != 0
+                || ((e[i] & edgeRev) != 0) != rev)
+                break;
+                
+            span += (e[i] - e[i-1]) & 0xFFFFFF;
+            ++nPeriods;
+        }
+        
+        // If we don't have any periods, the plunger just started moving,
+        // or just reversed direction.  Either way, it's moving slowly.
+        if (nPeriods == 0 || span == 0)
+        {
+            v = 0;
+            return true;
+        }
+        
+        // Figure the speed from the average period.  But if it's been 
+        // longer than that since the last edge, the plunger is slowing 
+        // down, and the time since the last edge gives a better (upper
+        // bound) estimate.
+        uint32_t since = (e[0] - ticksNow) & 0xFFFFFF;
+        if (since * nPeriods > span)
+            v = int(SystemCoreClock / since);
+        else
+            v = int(SystemCoreClock * nPeriods / span);
+            
+        // negate it for motion in the decreasing direction
+        if (rev)
+            v = -v;
+        
         // success
         return true;
     }
@@ -158,10 +290,22 @@ public:
         // send the common status report
         PlungerSensor::sendStatusReport(js, flags, speed);
 
-        // send the extra quadrature sensor status report
-        js.sendPlungerStatusQuadrature((st & 0x01) != 0, (st & 0x02) != 0);
+        // get the measured speed
+        int v = 0;
+        readRawSpeed(v);
+
+        // send the extra quadrature sensor status report, with the edge
+        // handler statistics (the timing statistics are only collected in
+        // diagnostic builds, and read as zero otherwise)
+        js.sendPlungerStatusQuadrature(
+            (st & 0x01) != 0, (st & 0x02) != 0, stats.nIllegal, v,
+            nEdges, stats.nEdges > 1 ? stats.minPeriod : 0,
+            stats.avgHandlerTime(), stats.handlerMax);
     }
     
+    // get the edge statistics
+    virtual const EdgeStats *getEdgeStats() { return &stats; }
+    
     // figure the average scan time in microseconds
     virtual uint32_t getAvgScanTime() 
     { 
@@ -191,6 +335,36 @@ private:
     //   0x02 = channel B state
     uint8_t st;
     
+    // Edge timestamp ring.  Each entry is the SysTick counter value at
+    // the edge (in the low 24 bits), combined with the edge flags below.
+    // nEdges is the total number of edges recorded, which also serves as
+    // the write index (mod the ring size).  The ring size must be a power
+    // of 2.
+    static const int ringSize = 16;
+    volatile uint32_t edgeRing[ringSize];
+    volatile uint32_t nEdges;
+    
+    // edge flags in the ring entries
+    static const uint32_t edgeRev = 0x01000000;      // motion in the decreasing direction
+    static const uint32_t edgeGap = 0x02000000;      // period since the prior edge is unknown
+    static const uint32_t edgeIllegal = 0x04000000;  // illegal transition (missed edge)
+    
+    // Maximum number of edges to average for the speed calculation
+    static const int maxSpeedEdges = 8;
+    
+    // Maximum time since the last edge, in microseconds, before we treat
+    // the plunger as stopped.  This must be well under the SysTick wrap
+    // time (2^24 clocks, or 349ms at 48MHz).
+    static const uint32_t maxEdgeAge = 100000;
+    
+    // Edge statistics, including the illegal transition counter
+    EdgeStats stats;
+    
+    // Edge count as of the last reading, and the time of the reading 
+    // when we first saw that count
+    uint32_t nEdgesSeen;
+    uint32_t tEdgeSeen;
+    
     // interrupt handlers
     static void aUp(void *obj) { 
         PlungerSensorQuad *self = (PlungerSensorQuad *)obj; 
@@ -215,9 +389,19 @@ private:
     // our work here is simple:  we just have to count the pulse in 
     // the appropriate direction according to the state transition 
     // that the pulse represents.  We can do this with a simple table 
-    // lookup.
+    // lookup.  We also record the edge timestamp for the speed
+    // calculation.
     inline void transition(int stNew)
     {
+        // Grab the timestamp first, so that it's as close as possible to
+        // the actual edge time.  If the SysTick counter has wrapped since
+        // the last edge (which reading CTRL tells us, and resets), the 
+        // period since the last edge might be longer than the counter
+        // can represent, so flag it as unknown.
+        uint32_t ticks = SysTick->VAL;
+        if ((SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) != 0)
+            ticks |= edgeGap;
+        
         // Transition matrix: dir[n][m] gives the direction of 
         // motion when we switch from state 'n' to state 'm'.
         // The state number is formed by the two-bit number B:A,
@@ -241,7 +425,27 @@ private:
         
         // increment or decrement the position counter by one notch, 
         // according to the direction of motion implied by the transition
-        pos += dir[st][stNew];
+        int d = dir[st][stNew];
+        pos += d;
+        
+        // flag the direction, or count an illegal transition
+        if (d < 0)
+            ticks |= edgeRev;
+        else if (d == 0)
+        {
+            ticks |= edgeIllegal;
+            stats.onIllegal();
+        }
+        
+        // record the edge in the timestamp ring
+        uint32_t n = nEdges;
+        edgeRing[n & (ringSize - 1)] = ticks;
+        nEdges = n + 1;
+        
+#if ENABLE_DIAGNOSTICS
+        // collect the edge timing statistics
+        stats.onEdge(ticks, SysTick->VAL, (ticks & edgeGap) != 0);
+#endif
 
         // the new state is now the current state
         st = stNew;
@@ -14,9 +14,9 @@
 // axis of motion:
 //
 //    =X=======================|===   <- plunger, X = connector attachment point
-//      \
-//       \                            <- connector between plunger and shaft
-//        \
+//      \                             <- connector between plunger and shaft,
+//       \                               running from the attachment point
+//        \                              down to the shaft
 //         *                          <- rotating shaft, at a fixed position
 //
 // As the plunger moves, the angle of the connector relative to the fixed
@@ -135,6 +135,17 @@
 // real-world lengths.  We can simply figure a scaling factor that maps the
 // physical range to map to roughly the full range of the joystick units.
 //
+// The KL25Z doesn't have an FPU, so calling tanf() on every reading would
+// be slow, since it has to be done in software floating point.  Instead,
+// we pre-compute a table of the linear positions, already scaled to 
+// joystick units, at fixed steps in the angle relative to the vertical,
+// and interpolate between entries in fixed-point integer arithmetic.  The 
+// table only depends on alpha and the scaling factor, so we only have to 
+// rebuild it when the calibration changes.  The steps are about 0.7 
+// degrees, which keeps the interpolation error to a few units on the
+// 0..65535 scale over the practical range of the mechanism, well below 
+// the sensor's own resolution.
+//
 // If you're wondering how we derived that ugly formula, read on.  Start
 // with the basic relationships D*tan(alpha) = C1 and D*tan(beta) = C2.
 // This lets us write tan(beta) in terms of tan(alpha) as 
@@ -265,6 +276,22 @@ public:
                 
         // reset the calibration counters
         biasedMinObserved = biasedMaxObserved = 0;
+        
+        // Allocate the linearization table.  Use a step size of about 0.7
+        // degrees, rounded to a power of 2 in sensor units, covering angles
+        // up to +/- 72 degrees from the vertical.  That's well beyond the
+        // range the mechanism can actually reach, but it gives us some room
+        // for rough initial guesses at the calibration.
+        for (linTabShift = 0 ; (2 << linTabShift) <= (maxRawAngle + 1)/512 ; ++linTabShift) ;
+        linTabHalfRange = ((maxRawAngle/5) >> linTabShift) << linTabShift;
+        linTabSize = ((2*linTabHalfRange) >> linTabShift) + 1;
+        linTab = new int[linTabSize];
+        
+        // Set an initial guess at the calibration, so that we have a valid
+        // table until the real calibration is restored.  This is the same
+        // guess we use when there's no saved calibration.
+        biasedMax = (35 + 25) * maxRawAngle/360;
+        updateAlpha();
     }
     
     // Restore the saved calibration at startup
@@ -401,20 +428,50 @@ private:
     // Convert a biased angle value to a linear reading
     int biasedAngleToLinear(int angle)
     {
-        // Translate to an angle relative to the vertical, in sensor units
-        float theta = static_cast<float>(angle)*radiansPerSensorUnit - alpha;
+        // Translate to an angle relative to the vertical, in sensor units,
+        // in fixed point with linTabFracBits fraction bits, and offset it
+        // to the start of the table.
+        int theta = (angle << linTabFracBits) - alphaFixed 
+            + (linTabHalfRange << linTabFracBits);
         
-        // Calculate the linear position relative to the vertical.  Zero
-        // is right at the intersection of the vertical line from the
-        // sensor rotation center to the plunger axis; positive numbers
-        // are behind the vertical (more retracted).
-        int linearPos = static_cast<int>(tanf(theta) * linearScaleFactor);
+        // Figure the table index and the fractional position between
+        // this entry and the next one.  Clamp to the ends of the table.
+        int shift = linTabShift + linTabFracBits;
+        int idx = theta >> shift;
+        int linearPos;
+        if (idx < 0)
+            linearPos = linTab[0];
+        else if (idx >= linTabSize - 1)
+            linearPos = linTab[linTabSize - 1];
+        else
+        {
+            // interpolate linearly between the two table entries
+            int frac = theta & ((1 << shift) - 1);
+            int a = linTab[idx], b = linTab[idx + 1];
+            linearPos = a + (((b - a) * frac) >> shift);
+        }
         
         // Finally, figure the offset.  The vertical is the halfway point
         // of the plunger motion, so we want to put it at half of the raw
         // scale of 0..65535.
         return linearPos + 32767;
     }
+    
+    // Rebuild the linearization table.  Each entry is the linear position
+    // relative to the vertical for an angle from the vertical of 
+    // (i << linTabShift) - linTabHalfRange sensor units.  Zero is right
+    // at the intersection of the vertical line from the sensor rotation 
+    // center to the plunger axis; positive numbers are behind the vertical
+    // (more retracted).
+    void buildLinTab()
+    {
+        for (int i = 0 ; i < linTabSize ; ++i)
+        {
+            float theta = static_cast<float>((i << linTabShift) - linTabHalfRange)
+                * radiansPerSensorUnit;
+            linTab[i] = static_cast<int>(tanf(theta) * linearScaleFactor);
+        }
+    }
 
     // Update the estimation of the vertical angle, based on the angle
     // between the park position and maximum retraction point.
@@ -441,6 +498,12 @@ private:
         const float safeMax = 60000.0f;
         const float alphaInLinearUnits = safeMax * .316327f; // 31/22" / 3-1/16"
         linearScaleFactor = static_cast<int>(alphaInLinearUnits / tanf(alpha));
+        
+        // figure alpha in fixed-point sensor units, for the table lookup
+        alphaFixed = static_cast<int>(alpha / radiansPerSensorUnit * (1 << linTabFracBits) + 0.5f);
+        
+        // rebuild the linearization table for the new parameters
+        buildLinTab();
     }
 
     // Maximum raw angular reading from the sensor.  The sensor's readings
@@ -472,6 +535,19 @@ private:
     // represented in radians.
     float alpha;
     
+    // Alpha in sensor units, as a fixed-point value with linTabFracBits
+    // fraction bits
+    int alphaFixed;
+    static const int linTabFracBits = 8;
+    
+    // Linearization table.  This gives the linear position for angles
+    // relative to the vertical, from -linTabHalfRange to +linTabHalfRange
+    // sensor units, in steps of (1 << linTabShift) sensor units.
+    int *linTab;
+    int linTabSize;
+    int linTabShift;
+    int linTabHalfRange;
+    
     // The linear scaling factor, applied in our trig calculation from
     // angle to linear position.  This corresponds to the distance from
     // the rotation center to the plunger rod, but since the linear result
@@ -500,9 +576,9 @@ private:
 template<int nDataBits> class PlungerSensorAEAT601X : public PlungerSensorRotary
 {
 public:
-    PlungerSensorAEAT601X(PinName csPin, PinName clkPin, PinName doPin) :
+    PlungerSensorAEAT601X(PinName csPin, PinName clkPin, PinName doPin, bool useSPI) :
         PlungerSensorRotary((1 << nDataBits) - 1, 6.283185f/((1 << nDataBits) - 1)),
-        aeat(csPin, clkPin, doPin) 
+        aeat(csPin, clkPin, doPin, useSPI) 
     {
         // Make sure the sensor has had time to finish initializing.
         // Power-up time (tCF) from the data sheet is 20ms for the 12-bit
@@ -47,11 +47,36 @@
 // pretty complicated to set up and fine-tune to get the voltage range
 // expansion just right, and we really don't need it; the edge detection
 // works fine with what we get directly from the sensor.
-
+//
+// Fixed-pattern noise correction.  Like any CCD, the TCD1103's pixels
+// aren't perfectly uniform: each pixel has its own dark level (offset)
+// and its own sensitivity (gain), so a uniformly lit scene comes out as
+// a slightly ragged line rather than a flat one.  The variation is fixed
+// for a given sensor, so we can measure it once and subtract it out.
+// The calibration process takes two captures: a dark frame, with the
+// light source off or the lens covered, which gives us each pixel's 
+// offset, and a flat field, with the sensor looking at a uniformly lit
+// white target, which gives us each pixel's gain relative to the 
+// average.  The correction is applied on the fly as process() reads the
+// pixels, so it doesn't need a separate frame buffer.  The calibration
+// data is stored in its own flash area, since it's much too large for 
+// the Config struct (and we read it directly from flash, so it doesn't
+// take up any RAM).  Removing the pixel-to-pixel variation lets the edge
+// detector work with a lower contrast image, which means a shorter
+// integration time for the same reliability.
 
 
 #include "plunger.h"
+#include "NewMalloc.h"
 #include "TCD1103.h"
+#include "FreescaleIAP.h"
+#include "crc32.h"
+
+// Plunger sensor calibration flash area, reserved in the main program.
+// These return the starting address of the area, which is sector-aligned,
+// and its size in bytes.
+extern uint32_t plungerCalFlashAddr();
+extern uint32_t plungerCalFlashSize();
 
 template <bool invertedLogicGates>
 class PlungerSensorImageInterfaceTCD1103: public PlungerSensorImageInterface
@@ -79,6 +104,8 @@ public:
     virtual void releasePix() { sensor.releasePix(); }
     
     virtual void setMinIntTime(uint32_t us) { sensor.setMinIntTime(us); }
+    
+    virtual const FrameStats *getFrameStats() { return &sensor.getFrameStats(); }
 
     // the low-level interface to the TSL14xx sensor
     TCD1103<invertedLogicGates> sensor;
@@ -91,6 +118,102 @@ public:
     PlungerSensorTCD1103(PinName fm, PinName os, PinName icg, PinName sh)
         : PlungerSensorImage(sensor, 1546, 1545, true), sensor(fm, os, icg, sh)
     {
+        // no fixed-pattern calibration capture in progress
+        fpnEnabled = false;
+        fpnCapture = 0;
+        fpnFrames = 0;
+        fpnDarkDone = false;
+        fpnSave = 0;
+        fpnSum = 0;
+        fpnBuf = 0;
+        
+        // Locate the calibration data in flash, and check if it's valid.
+        // If our layout doesn't fit the reserved area, we can't use the
+        // area at all, since writing it would overwrite whatever follows.
+        uint32_t addr = plungerCalFlashAddr();
+        fpnOffset = reinterpret_cast<const uint8_t *>(addr);
+        fpnHeader = reinterpret_cast<const FPNHeader *>(addr + fpnGainOfs);
+        fpnGain = reinterpret_cast<const uint8_t *>(fpnHeader + 1);
+        fpnFits = fpnGainOfs + fpnBufSize <= plungerCalFlashSize();
+        fpnValid = fpnFits && checkFPN();
+    }
+    
+    // Initialize the sensor.  If fixed-pattern noise correction is 
+    // enabled, this is also where we allocate the calibration capture
+    // buffer, since we can't risk running out of memory later, when the
+    // calibration command arrives.  The buffer is only needed for the 
+    // calibration, but we can't free memory once allocated, so we only
+    // take the memory when the correction is enabled in the configuration,
+    // and only if there's enough to spare.
+    virtual void init()
+    {
+        PlungerSensorImage::init();
+        if (fpnFits && fpnEnabled)
+        {
+            // leave a reserve for any allocations that follow ours
+            const size_t reserve = 512;
+            if (mallocBytesFree() >= fpnPixAlloc*sizeof(uint16_t) + reserve)
+            {
+                fpnSum = new uint16_t[fpnPixAlloc];
+                fpnBuf = reinterpret_cast<uint8_t *>(fpnSum);
+            }
+        }
+    }
+    
+    virtual void onConfigChange(int varno, Config &cfg)
+    {
+        switch (varno)
+        {
+        case 24:
+            // image sensor options - enable/disable sub-pixel interpolation
+            // and fixed-pattern noise correction
+            setSubPixel((cfg.plunger.image.flags & 0x01) != 0);
+            fpnEnabled = (cfg.plunger.image.flags & 0x04) != 0;
+            break;
+        }
+        
+        // inherit the default handling
+        PlungerSensorImage::onConfigChange(varno, cfg);
+    }
+    
+    // Fixed-pattern noise calibration.  Step 1 captures the dark frame,
+    // step 2 captures the flat field and saves the calibration, and step
+    // 0 erases the saved calibration.
+    virtual void calibrateFixedPattern(int step)
+    {
+        // ignore calibration requests if the flash area is too small, or
+        // we didn't allocate the capture buffer at startup
+        if (!fpnFits || fpnSum == 0)
+            return;
+            
+        // finish any save still pending from the last step
+        flushCalibration();
+            
+        switch (step)
+        {
+        case 0:
+            // Erase the calibration.  This happens on the next flush.
+            fpnValid = false;
+            fpnCapture = 0;
+            fpnSave = 3;
+            break;
+            
+        case 1:
+            // start the dark frame capture
+            fpnCapture = 1;
+            fpnFrames = 0;
+            break;
+            
+        case 2:
+            // start the flat field capture; this requires the dark frame
+            // from the same session
+            if (fpnDarkDone)
+            {
+                fpnCapture = 2;
+                fpnFrames = 0;
+            }
+            break;
+        }
     }
     
 protected:
@@ -130,6 +253,16 @@ protected:
         // Deduct the dummy pixels so that we only scan the true image
         // pixels in our search for the plunger edge.
         int startOfs = 32;
+        
+        // if a calibration capture is in progress, add this frame
+        if (fpnCapture != 0)
+            captureFPN(pix, n);
+            
+        // Use the fixed-pattern correction if it's enabled and we have
+        // valid calibration data
+        if (fpnEnabled && fpnValid)
+            return processFPN(pix, n, startOfs, pos);
+        
         n -= 32 + 14;
         
         // Scan the pixel array to determine the actual dynamic range 
@@ -144,6 +277,10 @@ protected:
             if (c > pixMax) pixMax = c;
         }
         
+        // Update the auto-exposure.  Remember that this is a negative
+        // image, so the brightest pixel is the minimum.
+        autoExposure(255 - pixMin, 255 - pixMax);
+        
         // Figure the threshold brightness for the bright spot as halfway
         // between the min and max.
         uint8_t threshold = (pixMin + pixMax)/2;
@@ -157,6 +294,22 @@ protected:
             {
                 // got it - report this position
                 pos = p - pix;
+                
+                // If sub-pixel interpolation is enabled, figure where the
+                // threshold crossing falls between the previous pixel and
+                // this one, by linear interpolation.  The previous pixel
+                // is at or above the threshold and this one is below it,
+                // so the fraction is in [0, 1).
+                if (subPixelShift != 0)
+                {
+                    pos <<= subPixelShift;
+                    if (p > pix + startOfs)
+                    {
+                        int prv = p[-1], cur = *p;
+                        pos -= (1 << subPixelShift)
+                            - ((prv - threshold) << subPixelShift) / (prv - cur);
+                    }
+                }
                 return true;
             }
         }
@@ -165,6 +318,204 @@ protected:
         return false;
     }
     
+    // Process an image with fixed-pattern noise correction.  This is the
+    // same algorithm as process(), but applies the per-pixel correction
+    // to each pixel as we read it.
+    bool processFPN(const uint8_t *pix, int n, int startOfs, int &pos)
+    {
+        // figure the end of the image pixels
+        int endOfs = n - 14;
+        
+        // scan for the dynamic range of the corrected image
+        int pixMin = 255, pixMax = 0;
+        for (int i = startOfs ; i < endOfs ; ++i)
+        {
+            int c = correctFPN(pix, i);
+            if (c < pixMin) pixMin = c;
+            if (c > pixMax) pixMax = c;
+        }
+        
+        // update the auto-exposure (this is still a negative image)
+        autoExposure(255 - pixMin, 255 - pixMax);
+        
+        // scan for the first pixel brighter than the midpoint
+        int threshold = (pixMin + pixMax)/2;
+        int prv = 255;
+        for (int i = startOfs ; i < endOfs ; ++i)
+        {
+            int cur = correctFPN(pix, i);
+            if (cur < threshold)
+            {
+                // got it - report this position, interpolating between
+                // this pixel and the previous one if desired
+                pos = i;
+                if (subPixelShift != 0)
+                {
+                    pos <<= subPixelShift;
+                    if (i > startOfs)
+                        pos -= (1 << subPixelShift)
+                            - ((prv - threshold) << subPixelShift) / (prv - cur);
+                }
+                return true;
+            }
+            prv = cur;
+        }
+        
+        // no edge found
+        return false;
+    }
+    
+    // Apply the fixed-pattern correction to pixel i.  The signal is the
+    // pixel's deviation from its own dark level (remembering that this is
+    // a negative image, so light lowers the reading), scaled by its gain.
+    // We return the result as a negative image again, on a 0-255 scale, 
+    // so that the rest of the processing works the same way as with the
+    // raw pixels.  The gain is stored as a 7-bit fixed-point multiplier,
+    // minus 64, so it covers a range of 0.5 to 2.5.
+    inline int correctFPN(const uint8_t *pix, int i) const
+    {
+        int sig = int(fpnOffset[i]) - pix[i];
+        if (sig < 0)
+            return 255;
+        sig = (sig * (fpnGain[i] + 64)) >> 7;
+        return sig > 255 ? 0 : 255 - sig;
+    }
+    
+    // Add a frame to the calibration capture in progress.  We sum the 
+    // frames into fpnSum, and divide once at the end, so that the average
+    // is only rounded once.  (A running mean in 8 bits would round on
+    // every frame, and the rounding errors add up to a bias.)
+    void captureFPN(const uint8_t *pix, int n)
+    {
+        // add the frame into the sums
+        int k = ++fpnFrames;
+        for (int i = 0 ; i < n ; ++i)
+            fpnSum[i] = (k == 1 ? 0 : fpnSum[i]) + pix[i];
+        
+        // keep going until we have all of the frames
+        if (k < fpnCaptureFrames)
+            return;
+            
+        // Figure the averages, rounded to the nearest level, as bytes.
+        // The bytes go into the same buffer as the sums: byte i overlaps
+        // sums[i/2], which we've already used by the time we get to i, so
+        // we can pack the bytes in place working upwards.  Then move them
+        // up to make room for the header, so that we can write the header
+        // and gains to flash together.
+        for (int i = 0 ; i < fpnPixAlloc ; ++i)
+            fpnBuf[i] = i < n ? uint8_t((fpnSum[i] + (k >> 1)) / k) : 0;
+        memmove(fpnBuf + sizeof(FPNHeader), fpnBuf, fpnPixAlloc);
+        uint8_t *buf = fpnBuf + sizeof(FPNHeader);
+            
+        // The capture is done.  Prepare the data to save, and leave the
+        // flash write to flushCalibration().
+        if (fpnCapture == 1)
+        {
+            // Dark frame - the offsets are the averaged frame.  Saving
+            // this will invalidate any prior calibration.
+            fpnValid = false;
+            fpnDarkDone = false;
+        }
+        else
+        {
+            // Flat field.  Figure each pixel's signal level relative to
+            // its dark level, and the average signal over the image.
+            int sum = 0, cnt = 0;
+            for (int i = 32 ; i < n - 14 ; ++i)
+            {
+                int sig = int(fpnOffset[i]) - buf[i];
+                if (sig > 0)
+                {
+                    sum += sig;
+                    ++cnt;
+                }
+            }
+            int avg = cnt != 0 ? sum / cnt : 1;
+            
+            // Figure each pixel's gain, to bring it to the average level.
+            // Use unity gain for any pixels with no signal.
+            for (int i = 0 ; i < fpnPixAlloc ; ++i)
+            {
+                int sig = i < n ? int(fpnOffset[i]) - buf[i] : 0;
+                int g = sig > 0 ? (avg << 7) / sig : 128;
+                buf[i] = g < 64 ? 0 : g > 319 ? 255 : g - 64;
+            }
+            
+            // fill in the header, and save the header and gains
+            FPNHeader *h = reinterpret_cast<FPNHeader *>(fpnBuf);
+            h->sig = FPNHeader::SIGNATURE;
+            h->npix = native_npix;
+            h->reserved = 0;
+            h->checksum = fpnChecksum(fpnOffset, buf);
+        }
+        
+        // the capture is finished, and ready to save
+        fpnSave = fpnCapture;
+        fpnCapture = 0;
+    }
+    
+    // Write any completed calibration step to flash.  captureFPN() only
+    // prepares the data, since it runs in the middle of processing a
+    // frame; the main loop calls this between readings to do the actual
+    // write.
+    virtual void flushCalibration()
+    {
+        if (fpnSave == 0)
+            return;
+            
+        FreescaleIAP iap;
+        uint32_t addr = plungerCalFlashAddr();
+        switch (fpnSave)
+        {
+        case 1:
+            // Dark frame - save the offsets directly to flash.  This
+            // invalidates any prior calibration, since the checksum
+            // won't match any more.
+            fpnDarkDone = 
+                iap.programFlash(addr, fpnBuf + sizeof(FPNHeader), fpnPixAlloc) == FreescaleIAP::Success;
+            break;
+            
+        case 2:
+            // flat field - save the header and gains
+            iap.programFlash(addr + fpnGainOfs, fpnBuf, fpnBufSize);
+            fpnValid = checkFPN();
+            break;
+            
+        case 3:
+            // erase - overwriting the header is enough to invalidate it
+            {
+                FPNHeader h;
+                memset(&h, 0, sizeof(h));
+                iap.programFlash(addr + fpnGainOfs, &h, sizeof(h));
+            }
+            break;
+        }
+        
+        // the save is done
+        fpnSave = 0;
+    }
+    
+    // Check the calibration data in flash for validity
+    bool checkFPN() const
+    {
+        return fpnHeader->sig == FPNHeader::SIGNATURE
+            && fpnHeader->npix == native_npix
+            && fpnHeader->checksum == fpnChecksum(fpnOffset, fpnGain);
+    }
+    
+    // figure the calibration data checksum, over the offsets and gains
+    uint32_t fpnChecksum(const uint8_t *offsets, const uint8_t *gains) const
+    {
+        return CRC32(offsets, native_npix) ^ CRC32(gains, native_npix);
+    }
+    
+    // report the fixed-pattern correction status in the status report
+    virtual int getStatusFlags() const 
+    { 
+        return (fpnEnabled && fpnValid ? 0x10 : 0x00) 
+            | (fpnCapture != 0 || fpnSave != 0 ? 0x20 : 0x00);
+    }
+    
     // Use a fixed orientation for this sensor.  The shadow-edge sensors
     // try to infer the direction by checking which end of the image is
     // brighter, which works well for the shadow sensors because the back
@@ -186,4 +537,64 @@ protected:
 
     // the hardware sensor interface
     PlungerSensorImageInterfaceTCD1103<invertedLogicGates> sensor;
+    
+    // Fixed-pattern calibration data layout in flash.  The per-pixel 
+    // offsets (dark levels) come first, at the start of the area.  The
+    // header and the per-pixel gains follow, starting on a separate flash
+    // sector, so that we can save the dark frame and the flat field as
+    // separate steps.  The gains immediately follow the header.
+    struct FPNHeader
+    {
+        static const uint32_t SIGNATURE = 0x314E5046;   // "FPN1"
+        uint32_t checksum;
+        uint32_t sig;
+        uint16_t npix;
+        uint16_t reserved;
+    };
+    static const int fpnPixAlloc = (1546 + 3) & ~3;
+    static const int fpnGainOfs = ((fpnPixAlloc + SECTOR_SIZE - 1)/SECTOR_SIZE)*SECTOR_SIZE;
+    static const int fpnBufSize = sizeof(FPNHeader) + fpnPixAlloc;
+    
+    // Number of frames to average for each calibration capture.  The 
+    // 16-bit sums can hold up to 257 frames of 8-bit pixels.
+    static const int fpnCaptureFrames = 32;
+    
+    // The capture buffer holds 16-bit sums, and is reused for the data
+    // to save, so make sure that it's big enough for the latter.  (This
+    // declares a negative-size array type, which is a compile error, if
+    // the buffer is too small.)
+    typedef char fpnBufSizeCheck[fpnPixAlloc*sizeof(uint16_t) >= fpnBufSize ? 1 : -1];
+    
+    // calibration data in flash
+    const uint8_t *fpnOffset;
+    const FPNHeader *fpnHeader;
+    const uint8_t *fpnGain;
+    
+    // is the correction enabled in the configuration?
+    bool fpnEnabled;
+    
+    // is the calibration data in flash valid?
+    bool fpnValid;
+    
+    // Calibration capture in progress: 0 = none, 1 = dark frame, 2 = flat
+    // field.  fpnFrames is the number of frames captured so far.
+    int fpnCapture;
+    int fpnFrames;
+    
+    // have we captured the dark frame in this session?
+    bool fpnDarkDone;
+    
+    // Pending flash write for flushCalibration(): 0 = none, 1 = dark
+    // frame, 2 = flat field, 3 = erase
+    int fpnSave;
+    
+    // does our calibration data layout fit the reserved flash area?
+    bool fpnFits;
+    
+    // Calibration capture buffer, allocated at startup if the correction
+    // is enabled.  fpnSum holds the per-pixel sums during the capture, 
+    // and fpnBuf is the same memory viewed as bytes, which holds the 
+    // header and pixel data to write to flash when the capture is done.
+    uint16_t *fpnSum;
+    uint8_t *fpnBuf;
 };
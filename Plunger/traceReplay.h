@@ -0,0 +1,167 @@
+// Plunger position trace replay
+//
+// This is a plunger sensor that plays back a recorded trace of position
+// readings, in place of a live sensor.  It's the counterpart of the frame
+// replay interface (frameReplay.h) one level up: rather than feeding
+// recorded pixels to an image processor, it feeds recorded positions to
+// the main program's PlungerReader, which does the calibration, speed
+// calculation, and firing event detection.  Install it as the plunger
+// sensor in a host build, and PlungerReader can't tell the difference:
+// each read() returns the next reading in the trace, with its original
+// timestamp.  That makes it possible to run PlungerReader over a corpus
+// of recorded plunger motions (releases, slow pulls, bounces, pushes
+// forward of the park position) and compare its reported position and
+// firing state sequences against known-good results, so that changes 
+// to the firing event logic can be checked against real-world data.
+//
+// Traces can be recorded on the host from the plunger sample batch
+// reports (message 65 20; see USBProtocol.h), which pass back every
+// sample that PlungerReader processes, with its timestamp.  The batch
+// reports give the calibrated position in joystick units, so the recorder
+// converts each one back to the raw scale using the device's calibration
+// (from the configuration report, message 65 4):
+//
+//    raw = zero + pos*(max - zero)/4096
+//
+// (4096 is JOYMAX, the calibrated position at the maximum retraction
+// point), and stores the same calibration in the file header, so that 
+// the replay can restore it.  For the most faithful recording, use the
+// three-point speed mode (variable 25 byte 3 = 0) while recording, since
+// the batch reports carry the filtered positions in the alpha-beta mode.
+//
+// The recorded positions have already been through the sensor's 
+// orientation adjustment and jitter filter, so the replay doesn't apply
+// them again.  It bypasses the jitter filter, and ignores the plunger
+// filter settings (variable 19), so the orientation is always normal.
+//
+// File format.  All multi-byte values are little-endian.
+//
+//   File header (8 bytes):
+//     bytes 0:3 = signature, "PTRC"
+//     bytes 4:5 = calibration zero point, on the raw 0..65535 scale
+//     bytes 6:7 = calibration maximum point, on the raw 0..65535 scale
+//
+//   Sample records (6 bytes each), repeated to the end of the file:
+//     bytes 0:3 = timestamp, microseconds on the device clock
+//     bytes 4:5 = position, on the raw 0..65535 scale
+
+#ifndef _TRACEREPLAY_H_
+#define _TRACEREPLAY_H_
+
+#include <stdio.h>
+#include <string.h>
+#include "plunger.h"
+
+class PlungerSensorTraceReplay: public PlungerSensor
+{
+public:
+    // Set up a replay from an open trace file.  The caller retains
+    // ownership of the file.  Check ok() after construction to make sure
+    // the file header was valid.
+    PlungerSensorTraceReplay(FILE *fp) : PlungerSensor(65535)
+    {
+        this->fp = fp;
+        headerOk = false;
+        valid = false;
+        calZero = 0;
+        calMax = 65535;
+        nSamples = 0;
+        tFirst = tLast = 0;
+        
+        // read and check the file header
+        uint8_t hdr[8];
+        if (fread(hdr, 1, 8, fp) != 8 || memcmp(hdr, "PTRC", 4) != 0)
+            return;
+        calZero = hdr[4] | (hdr[5] << 8);
+        calMax = hdr[6] | (hdr[7] << 8);
+        headerOk = true;
+        
+        // load the first sample
+        loadSample();
+    }
+    
+    // did the file header load successfully?
+    bool ok() const { return headerOk; }
+    
+    // Get the calibration recorded in the file header.  The caller should
+    // set these in the configuration (cfg.plunger.cal.zero and .max)
+    // before starting the replay, so that PlungerReader reproduces the
+    // calibrated positions of the original recording.
+    uint16_t getCalZero() const { return calZero; }
+    uint16_t getCalMax() const { return calMax; }
+    
+    // get the number of samples read so far
+    int getSampleCount() const { return nSamples; }
+    
+    // we're ready as long as there's another sample in the file
+    virtual bool ready() { return valid; }
+    
+    // read the current sample, and advance to the next one
+    virtual bool readRaw(PlungerReading &r)
+    {
+        if (!valid)
+            return false;
+            
+        r = next;
+        if (nSamples++ == 0)
+            tFirst = next.t;
+        tLast = next.t;
+        
+        loadSample();
+        return true;
+    }
+    
+    // Figure the average time between samples from the recorded timestamps
+    virtual uint32_t getAvgScanTime() 
+    { 
+        return nSamples > 1 ? (tLast - tFirst) / (nSamples - 1) : 0;
+    }
+    
+    // The recorded positions were already jitter filtered on the device,
+    // so pass them through unchanged
+    virtual int postJitterFilter(int pos) { return pos; }
+    
+    // Ignore the plunger filter settings (variable 19), since the recorded
+    // positions already reflect the jitter filter and orientation.  There
+    // are no other settings that apply to the replay.
+    virtual void onConfigChange(int varno, Config &cfg) { }
+    
+protected:
+    // Load the next sample from the file.  We always read one sample
+    // ahead, so that ready() can report the end of the file before the
+    // caller asks for a sample that isn't there.
+    void loadSample()
+    {
+        uint8_t rec[6];
+        valid = fread(rec, 1, 6, fp) == 6;
+        if (valid)
+        {
+            next.t = rec[0] | (rec[1] << 8) | (rec[2] << 16) | (uint32_t(rec[3]) << 24);
+            next.pos = rec[4] | (rec[5] << 8);
+        }
+    }
+    
+    // trace file
+    FILE *fp;
+    
+    // did the header load successfully?
+    bool headerOk;
+    
+    // is there a sample in the prefetch buffer?
+    bool valid;
+    
+    // prefetched sample
+    PlungerReading next;
+    
+    // calibration from the file header
+    uint16_t calZero;
+    uint16_t calMax;
+    
+    // number of samples read so far
+    int nSamples;
+    
+    // timestamps of the first and last samples read, for the scan time
+    uint32_t tFirst, tLast;
+};
+
+#endif /* _TRACEREPLAY_H_ */
@@ -44,6 +44,8 @@ public:
     virtual void releasePix() { sensor.releasePix(); }
     
     virtual void setMinIntTime(uint32_t us) { sensor.setMinIntTime(us); }
+    
+    virtual const FrameStats *getFrameStats() { return &sensor.getFrameStats(); }
 
     // the low-level interface to the TSL14xx sensor
     TSL14xx sensor;
@@ -180,6 +180,7 @@
 #include "AltAnalogIn.h"
 #include "SimpleDMA.h"
 #include "DMAChannels.h"
+#include "frameStats.h"
 
 
 template<bool invertedLogicGates> class TCD1103
@@ -301,6 +302,9 @@ public:
             pix = pix2;
             t = t2;
         }
+        
+        // count the frame in the statistics
+        stats.onProcess(uint32_t(this->t.read_us() - t));
     }
     
     // release the client's pixel buffer
@@ -308,6 +312,9 @@ public:
     
     // figure the average scan time from the running totals
     uint32_t getAvgScanTime() { return static_cast<uint32_t>(totalXferTime / nRuns);}
+    
+    // get the frame statistics
+    const FrameStats &getFrameStats() const { return stats; }
 
     // Set the requested minimum integration time.  If this is less than the
     // sensor's physical minimum time, the physical minimum applies.
@@ -324,7 +331,9 @@ protected:
     // processing during the capture.
     void startTransfer()
     {
-        // if we own the stable buffer, swap buffers
+        // If we own the stable buffer, swap buffers.  Otherwise we have
+        // to reuse the current DMA buffer, which discards the frame we 
+        // just captured into it (if any), so count it as overwritten.
         if (!clientOwnsStablePix)
         {
             // swap buffers
@@ -333,6 +342,8 @@ protected:
             // release the prior DMA buffer to the client
             clientOwnsStablePix = true;
         }
+        else if (nRuns != 0)
+            stats.onOverwrite();
         
         // figure our destination buffer
         uint8_t *dst = pixDMA ? pix2 : pix1;
@@ -377,6 +388,7 @@ protected:
         uint32_t dt = dtPixXfer = static_cast<uint32_t>(now - tXfer);
         totalXferTime += dt;
         nRuns += 1;
+        stats.onCapture();
         
         // collect debug statistics
         if (dt < minXferTime) minXferTime = dt;
@@ -706,4 +718,7 @@ protected:
     // debugging - min/max transfer time statistics
     uint32_t minXferTime;
     uint32_t maxXferTime;
+    
+    // frame capture/drop statistics
+    FrameStats stats;
 };
@@ -221,6 +221,7 @@
 #include "AltAnalogIn.h"
 #include "SimpleDMA.h"
 #include "DMAChannels.h"
+#include "frameStats.h"
  
 #ifndef TSL14XX_H
 #define TSL14XX_H
@@ -368,6 +369,9 @@ public:
             pix = pix2;
             t = t2;
         }
+        
+        // count the frame in the statistics
+        stats.onProcess(uint32_t(this->t.read_us() - t));
     }
     
     // Wait for the current DMA transfer to finish, and retrieve its
@@ -431,6 +435,9 @@ public:
         return uint32_t(totalTime / nRuns);
     }
     
+    // get the frame statistics
+    const FrameStats &getFrameStats() const { return stats; }
+    
 private:
     // Start a new transfer.  We call this at the end of each integration
     // cycle, in interrupt mode.  This can be called directly by the interrupt
@@ -446,6 +453,8 @@ private:
         // If the client owns the stable buffer, we can't swap buffers,
         // because the client is still working on the stable one.  So we
         // must start the new transfer using the existing DMA buffer.
+        // That discards the frame we just captured, so count it as an
+        // overwritten frame (unless this is the very first transfer).
         if (!clientOwnsStablePix)
         {
             // swap buffers
@@ -454,6 +463,8 @@ private:
             // release the prior DMA buffer to the client
             clientOwnsStablePix = true;
         }
+        else if (nRuns != 0)
+            stats.onOverwrite();
         
         // Set up the active pixel array as the destination buffer for 
         // the ADC DMA channel. 
@@ -524,6 +535,7 @@ private:
         uint32_t now = t.read_us();
         totalTime += uint32_t(now - t0);
         nRuns += 1;
+        stats.onCapture();
         
         // note the ending time of the transfer
         tDone = now;
@@ -676,6 +688,9 @@ private:
     uint32_t tDone;           // end time of latest finished transfer
     uint64_t totalTime;       // total time consumed by all reads so far
     uint32_t nRuns;           // number of runs so far
+    
+    // frame capture/drop statistics
+    FrameStats stats;
 };
  
 #endif /* TSL14XX_H */
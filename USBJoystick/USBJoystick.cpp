@@ -19,6 +19,7 @@
  
 #include "stdint.h"
 #include "USBJoystick.h"
+#include "pixPack.h"
 
 #include "config.h"  // Pinscape configuration
 
@@ -187,7 +188,7 @@ bool USBJoystick::sendPlungerStatus(int npix, int plungerPos, int flags,
 bool USBJoystick::sendPlungerStatus2(
     int nativeScale, 
     int jitterLo, int jitterHi, int rawPos,
-    int axcTime)
+    int axcTime, int noise)
 {
     HID_REPORT report;
     memset(report.data, 0, sizeof(report.data));
@@ -230,13 +231,18 @@ bool USBJoystick::sendPlungerStatus2(
     put(ofs, uint16_t(axcTime));
     ofs += 2;
     
+    // add the noise estimate
+    put(ofs, uint16_t(noise));
+    ofs += 2;
+    
     // send the report
     report.length = reportLen;
     return sendTO(&report, 100);
 }
 
 bool USBJoystick::sendPlungerStatusBarcode(
-        int nbits, int codetype, int startOfs, int pixPerBit, int raw, int mask)
+        int nbits, int codetype, int startOfs, int pixPerBit, int raw, int mask,
+        int rejectRate, int filterFlags)
 {
     HID_REPORT report;
     memset(report.data, 0, sizeof(report.data));
@@ -268,12 +274,18 @@ bool USBJoystick::sendPlungerStatusBarcode(
     put(ofs, uint16_t(mask));
     ofs += 2;
     
+    // write the temporal filter rejection rate and flags
+    put(ofs, uint16_t(rejectRate));
+    ofs += 2;
+    report.data[ofs++] = filterFlags;
+    
     // send the report
     report.length = reportLen;
     return sendTO(&report, 100);
 }
 
-bool USBJoystick::sendPlungerStatusQuadrature(int chA, int chB)
+bool USBJoystick::sendPlungerStatusQuadrature(int chA, int chB, int nIllegal, int speed,
+    uint32_t nEdges, uint32_t minPeriod, uint32_t avgHandler, uint32_t maxHandler)
 {
     HID_REPORT report;
     memset(report.data, 0, sizeof(report.data));
@@ -290,6 +302,29 @@ bool USBJoystick::sendPlungerStatusQuadrature(int chA, int chB)
     report.data[ofs++] = static_cast<uint8_t>(chA);
     report.data[ofs++] = static_cast<uint8_t>(chB);
     
+    // write the illegal transition count
+    put(ofs, static_cast<uint16_t>(nIllegal));
+    ofs += 2;
+    
+    // write the measured speed
+    putl(ofs, static_cast<uint32_t>(speed));
+    ofs += 4;
+    
+    // write the edge count
+    putl(ofs, nEdges);
+    ofs += 4;
+    
+    // write the minimum edge period, in 24 bits
+    report.data[ofs++] = minPeriod & 0xff;
+    report.data[ofs++] = (minPeriod >> 8) & 0xff;
+    report.data[ofs++] = (minPeriod >> 16) & 0xff;
+    
+    // write the average and maximum handler times, limited to 16 bits
+    put(ofs, static_cast<uint16_t>(avgHandler > 0xFFFF ? 0xFFFF : avgHandler));
+    ofs += 2;
+    put(ofs, static_cast<uint16_t>(maxHandler > 0xFFFF ? 0xFFFF : maxHandler));
+    ofs += 2;
+    
     // send the report
     report.length = reportLen;
     return sendTO(&report, 100);
@@ -317,6 +352,75 @@ bool USBJoystick::sendPlungerStatusVCNL4010(int filteredProxCount, int rawProxCo
     return sendTO(&report, 100);
 }
 
+bool USBJoystick::sendPlungerFrameHeader(uint32_t t, uint32_t seq, int flags)
+{
+    HID_REPORT report;
+    memset(report.data, 0, sizeof(report.data));
+    
+    // set the status bits to indicate that it's an extended
+    // status report
+    put(0, 0x87FF);
+    int ofs = 2;
+    
+    // write the report subtype (5)
+    report.data[ofs++] = 5;
+    
+    // write the frame timestamp and sequence number
+    putl(ofs, t);
+    ofs += 4;
+    putl(ofs, seq);
+    ofs += 4;
+    
+    // write the format flags
+    report.data[ofs++] = static_cast<uint8_t>(flags);
+    
+    // send the report
+    report.length = reportLen;
+    return sendTO(&report, 100);
+}
+
+bool USBJoystick::sendPlungerFrameStats(
+    uint32_t nCaptured, uint32_t nProcessed, uint32_t nOverwritten,
+    const uint32_t *ageHist, int nAgeBuckets)
+{
+    HID_REPORT report;
+    memset(report.data, 0, sizeof(report.data));
+    
+    // set the status bits to indicate that it's an extended
+    // status report
+    put(0, 0x87FF);
+    int ofs = 2;
+    
+    // write the report subtype (6)
+    report.data[ofs++] = 6;
+    
+    // write the frame counters
+    putl(ofs, nCaptured);
+    ofs += 4;
+    putl(ofs, nProcessed);
+    ofs += 4;
+    putl(ofs, nOverwritten);
+    ofs += 4;
+    
+    // send the report
+    report.length = reportLen;
+    if (!sendTO(&report, 100))
+        return false;
+        
+    // set up the age histogram report, subtype 7
+    memset(report.data, 0, sizeof(report.data));
+    put(0, 0x87FF);
+    ofs = 2;
+    report.data[ofs++] = 7;
+    
+    // write the histogram buckets, 16 bits each
+    for (int i = 0 ; i < nAgeBuckets && ofs + 2 <= reportLen ; ++i, ofs += 2)
+        put(ofs, static_cast<uint16_t>(ageHist[i]));
+    
+    // send the report
+    return sendTO(&report, 100);
+}
+
 
 bool USBJoystick::sendPlungerPix(int &idx, int npix, const uint8_t *pix)
 {
@@ -340,6 +444,34 @@ bool USBJoystick::sendPlungerPix(int &idx, int npix, const uint8_t *pix)
     return sendTO(&report, 100);
 }
 
+bool USBJoystick::sendPlungerPixPacked(int &idx, int npix, const uint8_t *pix)
+{
+    HID_REPORT report;
+    
+    // Set the special status bits to indicate it's a compressed exposure
+    // report.  The high 5 bits of the status word are set to 10101, and
+    // the low 11 bits are the current pixel index.
+    int start = idx;
+    uint16_t s = idx | 0xA800;
+    put(0, s);
+    
+    // pack the pixels into the rest of the report
+    PixelPacker::pack(&report.data[2], reportLen - 2, idx, npix, pix);
+    
+    // If the encoding didn't fit more pixels than a plain exposure report
+    // would have, which can happen with a very noisy image, send a plain
+    // report instead.  The host can tell them apart by the status bits.
+    if (!PixelPacker::beatsPlain(idx - start, npix - start, reportLen - 2))
+    {
+        idx = start;
+        return sendPlungerPix(idx, npix, pix);
+    }
+    
+    // send the report
+    report.length = reportLen;
+    return sendTO(&report, 100);
+}
+
 bool USBJoystick::reportID(int index)
 {
     HID_REPORT report;
@@ -182,9 +182,12 @@ public:
       * @param jitterHi high end of jitter filter window
       * @param rawPos raw position reading, before applying jitter filter
       * @param axcTime auto-exposure time in microseconds
+      * @param noise measured sensor noise (standard deviation at rest), in
+      *        1/16 native scale units, or 0xFFFF if not yet measured
       */
     bool sendPlungerStatus2(
-        int nativeScale, int jitterLo, int jitterHi, int rawPos, int axcTime);
+        int nativeScale, int jitterLo, int jitterHi, int rawPos, int axcTime,
+        int noise);
         
     /**
      * Send a barcode plunger status report header.
@@ -194,17 +197,27 @@ public:
      * @param pixofs pixel offset of first bit
      * @param raw raw bar code bits
      * @param mask mask of successfully read bar code bits
+     * @param rejectRate temporal filter rejection rate, in parts per 1000
+     * @param filterFlags temporal filter flags for this reading
      */
     bool sendPlungerStatusBarcode(
-        int nbits, int codetype, int startOfs, int pixPerBit, int raw, int mask);
+        int nbits, int codetype, int startOfs, int pixPerBit, int raw, int mask,
+        int rejectRate, int filterFlags);
         
     /**
      * Send a quadrature sensor status report header.
      *
      * @param chA channel "A" reading
      * @param chB channel "B" reading
+     * @param nIllegal illegal transition (missed edge) count
+     * @param speed speed measured from the pulse timing, in pulses per second
+     * @param nEdges number of channel edges counted
+     * @param minPeriod shortest time between edges, in CPU clocks
+     * @param avgHandler average edge handler time, in CPU clocks
+     * @param maxHandler longest edge handler time, in CPU clocks
      */
-    bool sendPlungerStatusQuadrature(int chA, int chB);
+    bool sendPlungerStatusQuadrature(int chA, int chB, int nIllegal, int speed,
+        uint32_t nEdges, uint32_t minPeriod, uint32_t avgHandler, uint32_t maxHandler);
     
     /**
      * Send a VCNL4010 sensor extra status report
@@ -212,6 +225,30 @@ public:
      * @param proxCount raw proximity count reading from the sensor
      */
      bool sendPlungerStatusVCNL4010(int filteredProxCount, int rawProxCount);
+     
+    /**
+     * Send an image sensor frame capture header.  This precedes the pixel
+     * reports in a raw frame capture (pixel dump flag 0x02).
+     *
+     * @param t frame timestamp, in microseconds on the device clock
+     * @param seq frame sequence number
+     * @param flags frame format flags (see USBProtocol.h, report 2A, subtype 5)
+     */
+    bool sendPlungerFrameHeader(uint32_t t, uint32_t seq, int flags);
+    
+    /**
+     * Send the image sensor frame statistics reports.  This sends two
+     * reports: the frame counters, and the frame age histogram.
+     *
+     * @param nCaptured number of frames the sensor has captured
+     * @param nProcessed number of frames taken for processing
+     * @param nOverwritten number of frames overwritten before processing
+     * @param ageHist frame age histogram buckets (see frameStats.h)
+     * @param nAgeBuckets number of histogram buckets
+     */
+    bool sendPlungerFrameStats(
+        uint32_t nCaptured, uint32_t nProcessed, uint32_t nOverwritten,
+        const uint32_t *ageHist, int nAgeBuckets);
     
     /**
      * Write an exposure report.  We'll fill out a report with as many pixels as
@@ -224,6 +261,21 @@ public:
      * @param pix pixel array
      */
     bool sendPlungerPix(int &idx, int npix, const uint8_t *pix);
+    
+    /**
+     * Write a compressed exposure report.  This works like sendPlungerPix(),
+     * but packs the pixels using the delta/run-length nibble encoding 
+     * described in USBProtocol.h, which typically fits about twice as many 
+     * pixels into each report.  Each report is self-contained, so the host
+     * can decode it even if it missed earlier reports.  If a stretch of 
+     * the image doesn't compress, this sends a plain exposure report for 
+     * it instead.
+     *
+     * @param idx current index in pixel array, updated to point to next pixel to send
+     * @param npix number of pixels in the overall array
+     * @param pix pixel array
+     */
+    bool sendPlungerPixPacked(int &idx, int npix, const uint8_t *pix);
      
     /**
      * Write a configuration report.
@@ -0,0 +1,117 @@
+// Compressed pixel packet encoder
+//
+// This packs image sensor pixels into the compressed exposure report 
+// format described in USBProtocol.h: an absolute first pixel, followed by
+// 4-bit codes for small deltas, runs of repeated values, and absolute 
+// escapes.  It's separate from USBJoystick so that the encoder can be
+// built and tested on its own, off the device (see HostTest/).
+
+#ifndef _PIXPACK_H_
+#define _PIXPACK_H_
+
+#include <stdint.h>
+
+class PixelPacker
+{
+public:
+    // Encode pixels starting at pix[idx] into dst, which has room for len
+    // bytes.  The first byte gets the absolute value of pix[idx], and the
+    // rest get the nibble codes, with any unused space at the end filled
+    // with 0xF padding.  On return, idx is advanced past the last pixel
+    // encoded.
+    static void pack(uint8_t *dst, int len, int &idx, int npix, const uint8_t *pix)
+    {
+        // Send the first pixel as an absolute value.  This serves as the
+        // starting point for the deltas, which makes each report decodable
+        // on its own.
+        int prv = pix[idx++];
+        dst[0] = prv;
+        
+        // Encode the remaining pixels as a string of 4-bit codes, packed
+        // two per byte, high nibble first:
+        //
+        //   0x0..0xD = delta from the previous pixel, -7..+6
+        //   0xE r    = run: repeat the previous pixel r+3 times (3..18)
+        //   0xF h l  = absolute pixel value h*16 + l
+        //
+        // We only write a code if it fits entirely in the report.  The 
+        // remaining space is filled with 0xF, which the host recognizes as 
+        // padding, since it's an incomplete absolute code.
+        NibbleWriter w(dst + 1, (len - 1)*2);
+        while (idx < npix)
+        {
+            // count the run of repeats of the previous pixel
+            int run = 0;
+            while (idx + run < npix && run < 18 && pix[idx + run] == prv)
+                ++run;
+            
+            // Encode as a run if we have enough repeats, otherwise as a
+            // delta or absolute value.  Note that a run leaves the previous 
+            // pixel value unchanged, since it's just more of the same.
+            int delta = pix[idx] - prv;
+            if (run >= 3)
+            {
+                if (!w.room(2))
+                    break;
+                w.put(0xE);
+                w.put(run - 3);
+                idx += run;
+            }
+            else if (delta >= -7 && delta <= 6)
+            {
+                if (!w.room(1))
+                    break;
+                w.put(delta + 7);
+                prv = pix[idx++];
+            }
+            else
+            {
+                if (!w.room(3))
+                    break;
+                prv = pix[idx++];
+                w.put(0xF);
+                w.put(prv >> 4);
+                w.put(prv & 0x0F);
+            }
+        }
+        
+        // fill out the rest of the report with padding
+        while (w.room(1))
+            w.put(0xF);
+    }
+    
+    // Is a packed report that encoded nPacked pixels worth sending, with
+    // nLeft pixels remaining in the image as of the start of the report?
+    // It's not if a plain exposure report, with len bytes of pixels, would
+    // have carried more.
+    static bool beatsPlain(int nPacked, int nLeft, int len)
+    {
+        return nPacked >= len || nPacked >= nLeft;
+    }
+    
+protected:
+    // nibble output stream
+    struct NibbleWriter
+    {
+        NibbleWriter(uint8_t *dst, int maxNibbles) : dst(dst), nib(0), maxNibbles(maxNibbles) { }
+        
+        // is there room for n more nibbles?
+        bool room(int n) const { return nib + n <= maxNibbles; }
+        
+        // write a nibble
+        void put(int v)
+        {
+            if ((nib & 1) != 0)
+                dst[nib >> 1] |= v;
+            else
+                dst[nib >> 1] = v << 4;
+            ++nib;
+        }
+        
+        uint8_t *dst;
+        int nib;
+        int maxNibbles;
+    };
+};
+
+#endif /* _PIXPACK_H_ */
@@ -141,6 +141,10 @@
 //                   0x04 = calibration mode is active (no pixel packets
 //                          are sent for this reading)
 //                   0x08 = speed is reported in bytes 14:15
+//                   0x10 = fixed-pattern noise correction is active
+//                   0x20 = fixed-pattern noise calibration capture in progress
+//                   0x40 = multi-frame averaging is active (the plunger is at
+//                          rest, and the last reading used the averaged image)
 //    bytes 8:9:10 = average time for each sensor read, in 10us units.
 //                This is the average time it takes to complete the I/O
 //                operation to read the sensor, to obtain the raw sensor
@@ -178,6 +182,13 @@
 //                status as of this reading.
 //    bytes 9:10 = Raw sensor reading before jitter filter was applied.
 //    bytes 11:12 = Auto-exposure time in microseconds
+//    bytes 13:14 = Measured sensor noise: the standard deviation of the
+//                raw readings while the plunger is at rest, in 1/16 native
+//                sensor scale units.  0xFFFF means that the firmware hasn't
+//                collected enough readings at rest to make an estimate yet.
+//                This is measured whether or not the adaptive jitter filter
+//                is enabled, so it can serve as a guide to setting the
+//                jitter window size manually.
 //
 // An optional third message provides additional information specifically
 // for bar-code sensors:
@@ -193,6 +204,19 @@
 //    bytes 10:11 = mask of successfully read bar code bits; a '1' bit means
 //                that the bit was read successfully, '0' means the bit was
 //                unreadable
+//    bytes 12:13 = temporal filter rejection rate, in parts per 1000.  This
+//                is the fraction of valid bar code decodes that the device
+//                rejected because they were inconsistent with the recent
+//                position readings, weighted toward recent readings.
+//    byte  14  = temporal filter flags for this reading:
+//                  0x01 = the decode was rejected as implausible
+//                  0x02 = the decode was implausible at the detected bit
+//                         phase, but a decode with the phase shifted by a
+//                         pixel or two fit; the pixel offset and raw bits
+//                         above are for the shifted decode
+//                  0x04 = the decode was implausible, but we'd already
+//                         rejected too many readings in a row, so we took
+//                         it and reset the filter history
 //
 // Another optional third message provides additional information
 // specifically for digital quadrature sensors:
@@ -201,6 +225,40 @@
 //    byte  2   = 3 -> digital quadrature sensor extra status report
 //    byte  3   = "A" channel reading (0 or 1)
 //    byte  4   = "B" channel reading (0 or 1)
+//    bytes 5:6 = illegal transition count (16-bit, little-endian, wraps at 
+//                65535).  This counts the channel transitions that skipped
+//                a quadrature state, or repeated the current state, either
+//                of which means that the device missed an edge interrupt.
+//                Each missed edge can leave the position count off by one,
+//                so this is a good test of whether the sensor's pulse rate 
+//                is within the device's interrupt handling capacity.
+//    bytes 7:10 = instantaneous speed (32-bit signed, little-endian), in
+//                sensor pulses per second, positive in the direction of
+//                increasing count.  The device measures this by timing the 
+//                pulses, which is much more precise than differencing the
+//                position readings, especially at low speeds.  The speed
+//                axis in the joystick reports uses this measurement when
+//                the quadrature sensor is in use.
+//    bytes 11:14 = number of channel edges counted since startup (32-bit, 
+//                little-endian)
+//    bytes 15:17 = shortest time observed between consecutive edges, in CPU 
+//                clock cycles (48 per microsecond), as a 24-bit little-endian
+//                value.  0 if fewer than two edges have been counted.  This
+//                and the handler times below are only collected when the
+//                firmware is built with ENABLE_DIAGNOSTICS, and read as 0
+//                otherwise, since they add work to every edge interrupt.
+//    bytes 18:19 = average time spent in the edge interrupt handler, in CPU
+//                clock cycles (16-bit, little-endian, limited to 65535).
+//                This doesn't include the fixed interrupt entry and dispatch
+//                overhead (about 6.5us).
+//    bytes 20:21 = longest time spent in the edge interrupt handler, in CPU
+//                clock cycles (16-bit, little-endian, limited to 65535).
+//
+//                The edge statistics show whether the interrupt handler can
+//                keep up with the encoder: the maximum sustainable edge rate
+//                is roughly one per (6.5us + maximum handler time), and the
+//                shortest edge period shows how close the plunger has come
+//                to that limit.
 //
 // Yet another optional third message provides additional information for
 // VCNL4010 sensors:
@@ -210,6 +268,57 @@
 //    bytes 3:4 = last proximity count reading (16-bit, little-endian), jitter filtered
 //    bytes 5:6 = last proximity count reading, original unfiltered value
 //
+// For an imaging sensor, when the host requests a raw frame capture (flag
+// 0x02 in the pixel dump request, message 65 3), the status reports are
+// followed by a frame header message just before the pixel reports:
+//
+//    bytes 0:1 = 0x87FF
+//    byte  2   = 5 -> frame capture header
+//    bytes 3:6 = frame timestamp, in microseconds on the device clock (32-bit,
+//                little-endian).  This is the time the sensor captured the
+//                frame, so the difference between two headers gives the 
+//                actual time between the frames.
+//    bytes 7:10 = frame sequence number (32-bit, little-endian).  The device
+//                counts every frame it reads from the sensor, so any gap in
+//                the numbering between two captured frames indicates frames
+//                that the device processed but didn't send.
+//    byte  11  = flags:
+//                  0x01 = negative image.  The sensor reports brighter pixels
+//                         with lower values.  The pixels in a raw capture are
+//                         sent exactly as the sensor reported them, so the host
+//                         has to apply the inversion itself if it wants to
+//                         display the image.
+//
+// For an imaging sensor that collects frame capture statistics (currently 
+// the TSL14xx and TCD1103 sensors), the second status report is followed
+// by two frame statistics reports.  These show how many frames the sensor
+// captured that the device never got to use, because the main loop was
+// still busy with the previous frame when the next one arrived, and how
+// old the frames were by the time the device processed them.
+//
+//    bytes 0:1 = 0x87FF
+//    byte  2   = 6 -> frame capture counters
+//    bytes 3:6 = number of frames the sensor has captured since startup
+//                (32-bit, little-endian)
+//    bytes 7:10 = number of captured frames that the device has taken for
+//                processing
+//    bytes 11:14 = number of captured frames that were overwritten because
+//                the device was still processing the previous frame when 
+//                the new frame arrived
+//
+//    bytes 0:1 = 0x87FF
+//    byte  2   = 7 -> frame age histogram
+//    bytes 3:18 = eight 16-bit little-endian counters, giving the number of
+//                processed frames by age at the time the device took them
+//                for processing.  The age is measured from the midpoint of
+//                the frame's integration period.  The first counter covers
+//                frames under 1ms old, the second 1-2ms, the third 2-4ms,
+//                and so on, doubling the range for each counter, through the
+//                eighth, which counts everything 64ms and older.  Each 
+//                counter wraps at 65535, so the host should take differences
+//                between successive reports to get the distribution over an
+//                interval.
+//
 // If the sensor is an imaging sensor type, the first and second sensor
 // reports will be followed by a series of pixel reports giving the live
 // image view on the sensor.  The imaging sensor types have too many pixels
@@ -239,6 +348,41 @@
 // anyway, so it's unlikely that we'd be able to make 2D sensors work at
 // all, but if we ever add such a thing we'll have to upgrade the report 
 // format here accordingly.
+//
+// If the host requests compressed pixel reports (flag 0x08 in the pixel
+// dump request, message 65 3), the device sends the pixels in compressed
+// packets instead, which typically carry about twice as many pixels per
+// packet for an image with normal sensor noise, and much more for a clean
+// one.  The device can still send any given 
+// stretch of the image as a regular pixel packet, in the format above, if
+// that would hold more pixels (which only happens with very noisy images),
+// so the host must accept both types, distinguishing them by the high 5
+// bits of the first two bytes.  The compressed packet format is:
+//
+//    bytes 0:1 = 11-bit index, with high 5 bits set to 10101 (0xA800 plus 
+//                the index).  This is the starting pixel number in the 
+//                report, as in a regular pixel packet.
+//    byte  2   = 8-bit brightness of the pixel at index
+//    bytes 3:21 = the following pixels, encoded as a string of 4-bit codes, 
+//                packed two per byte, high nibble first.  Each code gives 
+//                one or more pixels in terms of the previous pixel:
+//
+//                  0x0..0xD = one pixel, equal to the previous pixel plus
+//                             (code - 7), for a delta from -7 to +6
+//                  0xE r    = r + 3 pixels (3..18), all equal to the previous 
+//                             pixel, where r is the next nibble
+//                  0xF h l  = one pixel with brightness h*16 + l, where h and 
+//                             l are the next two nibbles
+//
+//                Stop decoding when you reach the end of the image, or when
+//                a code doesn't fit in the packet (an 0xE with no nibble 
+//                after it, or an 0xF with fewer than two nibbles after it).
+//                The unused space at the end of the packet is filled with
+//                0xF nibbles.  The next packet's index field always gives
+//                the pixel following the last one decoded from this packet.
+//
+// Each compressed packet starts over with an absolute pixel value, so the
+// host can decode every packet independently, even if it misses one.
 // 
 //
 // 2B. Configuration report.
@@ -422,6 +566,52 @@
 //  ...
 // byte 20:21 = 10th reading (oldest)
 //
+// 2I. Plunger sample batch report
+// This is sent when the host enables sample batch mode with custom protocol
+// message 65 20 (see below).  The sensors can take samples much faster than
+// the joystick report rate (every 1ms or so for quadrature sensors, for
+// example), so the joystick reports only show the host a fraction of the
+// plunger motion.  In batch mode, the device passes back the processed 
+// plunger samples, packing several into each report, so that the host can
+// see the full trajectory of the plunger, such as the whole shape of a 
+// release stroke.  The device sends one batch report just after each 
+// joystick report, with up to four of the oldest samples collected since
+// the last one.  At the default joystick report interval (8.33ms), that
+// keeps up with sensors that take a sample every 2ms or so.  With faster
+// sensors, or a longer report interval, the device drops the oldest 
+// samples, which shows up as a gap in the sequence numbers.  Unlike the 
+// diagnostic reports (2H), these don't replace the joystick reports, so 
+// the host will need to filter them out of the joystick stream.
+//
+//   bytes 0:1 = 0xA3.  This has bit pattern 10100 in the high 5 bits (and
+//               10100011 in the high 8 bits) to distinguish it from other
+//               report types.
+//   byte 2    = number of samples in the report, 0-4
+//   byte 3    = sequence number of the first sample in the report.  The 
+//               device numbers the samples consecutively (wrapping at 255),
+//               so a gap in the numbering means that samples were lost.  That
+//               can happen if the device collects samples faster than it can
+//               send reports, in which case it discards the oldest samples.
+//   bytes 4:5 = timestamp of the first sample, in units of 10us, on the
+//               device's clock, wrapping at 65535
+//   bytes 6:9 = first sample, as a 32-bit little-endian value containing
+//               bit fields:
+//                 bits 0-12  = position, in joystick units, as a 13-bit
+//                              signed value (-4096..4095).  This is the
+//                              calibrated position before the firing event
+//                              processing, like the Z0 axis in the joystick
+//                              report, except that the maximum retraction
+//                              point (+4096) is reported as +4095 to fit
+//                              the field.
+//                 bits 13-25 = speed, in joystick speed units (normalized
+//                              distance units per 10ms), as a 13-bit signed
+//                              value, limited to -4096..4095
+//                 bits 26-31 = time since the previous sample, in units of
+//                              100us, from 0 to 62; 63 means 6.3ms or more
+//   bytes 10:13 = second sample
+//   bytes 14:17 = third sample
+//   bytes 18:21 = fourth sample
+//
 // WHY WE USE A HACKY APPROACH TO DIFFERENT REPORT TYPES
 //
 // The HID report system was specifically designed to provide a clean,
@@ -570,6 +760,21 @@
 //                         no effect on the sensor operation; it merely reduces the
 //                         USB transmission time to allow for a faster frame rate for
 //                         viewing in the config tool.
+//                  0x02 = raw frame capture.  The device sends a frame header (see
+//                         "frame capture header" in section 2A above) ahead of the
+//                         pixels, and sends the pixels exactly as captured: the low
+//                         res flag is ignored, and negative images aren't inverted.
+//                         This is for recording frames for later playback through
+//                         the image processors (see Plunger/frameReplay.h).
+//                  0x04 = continuous streaming.  Rather than sending one snapshot,
+//                         the device sends every frame it can, until it receives a
+//                         new pixel dump request without this flag, or until one
+//                         second passes without a new request.  The host should
+//                         re-send the request periodically to keep the stream
+//                         going.
+//                  0x08 = compressed pixel packets.  The device sends the pixels
+//                         using the compressed packet format described in section
+//                         2A, to reduce the number of packets per frame.
 //
 //               fourth byte = extra exposure time in 100us (.1ms) increments.  For
 //                  imaging sensors, we'll add this delay to the minimum exposure 
@@ -697,6 +902,43 @@
 //                       plunger sensor reports that pass back all plunger
 //                       sensor readings as long as the mode is engaged.
 //               
+//       19 -> Plunger sensor fixed-pattern noise calibration.  This applies
+//             only to the TCD1103 sensor; other sensors ignore it.  The 
+//             calibration measures each pixel's individual dark level and
+//             sensitivity, so that the firmware can correct for the small
+//             pixel-to-pixel variations in the sensor (see variable 24, flag
+//             0x04).  Byte 3 selects the step:
+//
+//               0x00 -> erase the saved calibration data
+//
+//               0x01 -> capture the dark frame.  The light source must be off
+//                       (or the lens covered) during the capture.
+//
+//               0x02 -> capture the flat field.  The sensor must be looking at
+//                       a uniformly lit white target during the capture.  This
+//                       requires a dark frame captured in the same session.
+//                       The device saves the calibration data to flash when
+//                       the capture finishes.
+//
+//             Each capture averages 32 frames, which takes a fraction of a
+//             second.  Status report flag 0x20 (byte 7 of the plunger status
+//             report) is set while a capture is in progress.  The calibration
+//             data is stored in its own flash area, separate from the config
+//             variables, so it's preserved when the configuration is reset.
+//
+//             The capture needs a working buffer (2 bytes per pixel), which
+//             the device allocates at startup, and only if variable 24 flag
+//             0x04 is set.  So the flag has to be set and saved, and the 
+//             device reset, before running the calibration.  The device
+//             ignores this command if the buffer wasn't allocated.
+//
+//       20 -> Plunger sample batch reports.  Byte 3 turns the mode on (0x01)
+//             or off (0x00).  While the mode is on, the device sends plunger
+//             sample batch reports (see section 2I above) along with the
+//             regular joystick reports, passing back the processed plunger
+//             samples with their timestamps and speeds.  The mode is off at
+//             reset.
+//
 //
 // 66  -> Set configuration variable.  The second byte of the message is the config
 //        variable number, and the remaining bytes give the new value for the variable.
@@ -927,6 +1169,16 @@
 //          TSL141xx - scan mode (edge-sensing algorithm) selection; see 
 //                     edgeSensor.h for a list of the available modes
 //          VCNL4010 - IRED current, in units of 10mA, valid range 1..20
+//          AEAT-6012 - flags: 0x01 = read the sensor with the hardware SPI
+//                     unit instead of bit-banging.  This requires CLK to be
+//                     wired to an SPI SCK pin and DO to an SPI MISO pin, on
+//                     the same SPI unit (SPI0: SCK = PTA15, PTC5, PTD1;
+//                     MISO = PTA16, PTA17, PTC6, PTC7, PTD2, PTD3.  SPI1: SCK
+//                     = PTB11, PTD5, PTE2; MISO = PTB16, PTB17, PTD6, PTD7,
+//                     PTE1, PTE3).  If the pins don't qualify, the device 
+//                     uses bit-banging as usual.  SPI mode reduces the time
+//                     per reading, reported as the scan time in the plunger
+//                     status report.
 //
 //       * The sensor types marked with asterisks (*) are reserved for types
 //       that aren't currently implemented but could be added in the future.  
@@ -962,11 +1214,18 @@
 //         Potentiometer             AO (AnalogIn)    NC                NC              NC
 //         AEDR8300                  A (InterruptIn)  B (InterruptIn)   NC              NC
 //         AS5304                    A (InterruptIn)  B (InterruptIn)   NC              NC
-//         VL6180X                   SDA (GPIO)       SCL (GPIO)        GPIO0/CE (GPIO) NC
+//         VL6180X                   SDA (GPIO)       SCL (GPIO)        GPIO0/CE (GPIO) GPIO1 (InterruptIn)*
 //         AEAT-6012-A06             CS (GPIO)        CLK (GPIO)        DO (GPIO)       NC
 //         TCD1103GFG                fM (PWM)         OS (AnalogIn)     ICG (GPIO)      SH (GPIO)
 //         VCNL4010                  SDA (GPIO)       SCL (GPIO)        NC              NC
 //
+//       * The VL6180X GPIO1 connection is optional.  If it's connected, the
+//       device runs the sensor in continuous ranging mode and uses GPIO1 as a
+//       data-ready interrupt, which eliminates the I2C polling and gives the
+//       readings evenly spaced timestamps.  Set it to NC to use the original
+//       single-shot polling mode.  Like all InterruptIn pins, this must be
+//       one of the PTAxx or PTDxx pins.
+//
 // 7  -> Plunger calibration button pin assignments.
 //
 //         byte 3 -> features enabled/disabled: bit mask consisting of:
@@ -1200,6 +1459,13 @@
 //       the sensor's native units, so the effect of a given window size 
 //       depends on the sensor type.  A value of zero disables the filter.
 //
+//       In adaptive mode, the firmware measures the sensor noise while the
+//       plunger is at rest, and sets the window size automatically to cover
+//       the random variation.  The window closes while the plunger is 
+//       moving, so that the filter doesn't add any lag to fast motion.  The
+//       window size setting acts as an upper limit in this mode; zero means
+//       a default limit of 1/64 of the sensor's native range.
+//
 //       - Reversed orientation.  If set, this inverts the sensor readings, as
 //       though the sensor were physically flipped to the opposite direction.
 //       This allows for correcting a reversed physical sensor installation in
@@ -1208,6 +1474,9 @@
 //       byte 3:4 = jitter window size in native sensor units, little-endian
 //       byte 5   = bit mask:
 //                  0x01  -> set if reversed orientation, clear if normal
+//                  0x02  -> set if adaptive jitter filter mode is enabled
+//                  0x20  -> Read-only: this bit is set if the adaptive 
+//                           jitter filter mode is supported
 //                  0x40  -> Read-only: this bit is set if the TSL14xx Scan
 //                           Mode setting is supported (via config var 5)
 //                  0x80  -> Read-only: this bit is set if the reverse 
@@ -1217,6 +1486,13 @@
 //       sensor types.
 //
 //       bytes 3:4 = Starting pixel offset of bar code (margin width)
+//       byte  5   = flags:
+//                    0x01 -> temporal filter enabled.  The device rejects
+//                            decodes that are inconsistent with the recent
+//                            position readings, which usually means a 
+//                            misread (see the bar code status report in
+//                            section 2A).  Frames processed for status
+//                            reports aren't filtered.
 //
 // 21 -> TLC59116 setup.  This chip is an external PWM controller with 16
 //       outputs per chip and an I2C bus interface.  Up to 14 of the chips
@@ -1259,6 +1535,93 @@
 //          bytes 5:6 = raw data 1
 //          bytes 7:8 = raw data 2
 //
+// 24 -> Plunger image sensor options.  These apply to the imaging sensor
+//       types (TSL14xx edge sensors, TCD1103); other sensor types ignore
+//       them.
+//
+//          byte 3 = option flags, a combination of these bits:
+//
+//             0x01 = sub-pixel edge interpolation.  The edge detectors
+//                    refine the edge position to a fraction of a pixel,
+//                    and the native scale reported in the plunger status
+//                    report is multiplied by 16, so that the position
+//                    readings are in units of 1/16 pixel.  The jitter
+//                    filter window (variable 19) is in the native units,
+//                    so it should be scaled up to match.
+//
+//             0x02 = automatic exposure control.  The edge detectors lengthen
+//                    or shorten the integration time to keep the contrast
+//                    between the bright and dark ends of the image near the
+//                    target in byte 4.  Well-lit installations can then run
+//                    at the sensor's minimum frame time.  The current extra 
+//                    exposure time is reported in the plunger status report.
+//                    The bar code sensor ignores this, since it always uses
+//                    its own exposure control.
+//
+//             0x04 = fixed-pattern noise correction.  The sensor applies the
+//                    per-pixel dark level and gain corrections captured with
+//                    the 65 19 calibration command.  This has no effect until
+//                    the calibration has been captured.  Currently only 
+//                    supported for the TCD1103.
+//
+//             0x08 = multi-frame averaging.  The sensor averages consecutive
+//                    frames while the image is stable (the plunger is at rest),
+//                    which reduces pixel noise and steadies the parked reading.
+//                    Any significant change in the image resets the average,
+//                    so there's no added latency while the plunger is moving.
+//                    The averaging buffers take 3 bytes per pixel, allocated
+//                    at startup when this flag is set, so turning the flag on
+//                    takes effect after the next reset.  Averaging stays off
+//                    if there isn't enough free memory for the buffers.
+//
+//          byte 4 = auto-exposure target contrast, as the difference between
+//                   the average brightness levels at the bright and dark ends
+//                   of the image, on the 0-255 pixel scale.  0 selects the 
+//                   default (128).
+//
+//          byte 5 = number of frames for multi-frame averaging.  This is
+//                   rounded down to a power of 2 from 2 to 16.  0 selects
+//                   the default (8).
+//
+// 25 -> Plunger motion estimation options.  These select how the firmware
+//       derives the reported position and speed from the sensor samples.
+//
+//          byte 3 = speed estimator mode:
+//
+//             0 = three-point slope (default).  The speed is the slope
+//                 between the samples before and after the current one,
+//                 so the reported position lags one sample behind.
+//
+//             1 = alpha-beta filter.  A fixed-point position/velocity
+//                 tracking filter is updated on every sample, and provides
+//                 both the reported position (including for firing event
+//                 detection) and the speed.  This gives steadier speed
+//                 readings at low speeds, without the one-sample lag of
+//                 the three-point calculation.  Sensors that measure the
+//                 speed directly (quadrature) still report their own
+//                 speed measurement.
+//
+//          byte 4 = alpha-beta filter time constant, in units of 100us.
+//                   Shorter times track the raw readings more tightly;
+//                   longer times filter more heavily.  0 selects the 
+//                   default (20 = 2ms).
+//
+//          byte 5 = option flags, a combination of these bits:
+//
+//             0x01 = predictive latency compensation.  The plunger position
+//                    in each joystick report is extrapolated from the latest
+//                    sample, using the estimated speed, to the time the 
+//                    report is sent, plus the lookahead time in byte 6.  This
+//                    reduces the apparent lag in the simulator.  It doesn't
+//                    apply while a firing event is in progress, or to 
+//                    forward motion from the retracted position, since 
+//                    that might be the start of a release.  The firing 
+//                    event detection always uses the sampled positions, so
+//                    this setting doesn't affect it.
+//
+//          byte 6 = prediction lookahead time, in milliseconds (0 to 50), to
+//                   cover known latency on the host side
+//
 //
 // SPECIAL DIAGNOSTICS VARIABLES:  These work like the array variables below,
 // the only difference being that we don't report these in the number of array
@@ -1301,6 +1664,77 @@
 //               Retrieves the average time, as a uint32 in microseconds,
 //               units, spent in the LedWiz flash cycle update routine.
 //
+//          30 -> Plunger sensor scan time [read only, diagnostic only]
+//               Retrieves the average time, as a uint32 in microseconds,
+//               for the plunger sensor to take one reading.  For image
+//               sensors, this is the time to transfer one frame from the
+//               sensor.
+//
+//          31 -> Plunger image processing time [read only, diagnostic only]
+//               Retrieves the average time, as a uint32 in microseconds,
+//               spent analyzing each plunger sensor image frame to find
+//               the plunger position (edge detection or bar code decoding).
+//               This is zero for non-imaging sensors.  This is useful for
+//               comparing the speed of the different edge detection scan
+//               modes (see variable 5) on live images.  The average starts
+//               over whenever variable 5 changes, so it always reflects
+//               the current scan mode.
+//
+//          32 -> Plunger frames captured [read only, diagnostic only]
+//               Retrieves the number of frames the image sensor has captured
+//               since startup, as a uint32.  Zero for non-imaging sensors.
+//               This and the other frame statistics below (33, 34, 40-47)
+//               are also sent with the plunger status report in all builds
+//               (see report 2A, subtypes 6 and 7).
+//
+//          33 -> Plunger frames processed [read only, diagnostic only]
+//               Retrieves the number of captured frames that the firmware 
+//               has taken for processing, as a uint32.
+//
+//          34 -> Plunger frames overwritten [read only, diagnostic only]
+//               Retrieves the number of captured frames that were discarded
+//               because the firmware was still working on the previous frame
+//               when the new one arrived, as a uint32.  The sensor captures
+//               frames continuously, so this is how we can tell how much
+//               main loop stalls cost in plunger sampling.
+//
+//          35 -> Quadrature edges [read only, diagnostic only]
+//               Retrieves the number of channel edges the quadrature sensor
+//               has counted since startup, as a uint32.  Zero for other
+//               sensor types.  This and the next few variables are meant for
+//               checking that the edge interrupt handler can keep up with a
+//               given encoder's peak pulse rate.  The same statistics are
+//               also sent in the quadrature sensor status report (see 
+//               report 2A).
+//
+//          36 -> Quadrature illegal transitions [read only, diagnostic only]
+//               Retrieves the number of illegal quadrature transitions since
+//               startup, as a uint32.  An illegal transition means that we 
+//               missed an edge, so this should stay at zero if the interrupt
+//               handler is keeping up.
+//
+//          37 -> Quadrature minimum edge period [read only, diagnostic only]
+//               Retrieves the shortest time observed between consecutive 
+//               edges, as a uint32 in CPU clock cycles (48 per microsecond).
+//
+//          38 -> Quadrature average handler time [read only, diagnostic only]
+//               Retrieves the average time spent in the edge handler, as a
+//               uint32 in CPU clock cycles.  This doesn't include the fixed 
+//               interrupt entry and dispatch overhead (about 6.5us).
+//
+//          39 -> Quadrature maximum handler time [read only, diagnostic only]
+//               Retrieves the longest time spent in the edge handler, as a
+//               uint32 in CPU clock cycles.
+//
+//          40-47 -> Plunger frame age histogram [read only, diagnostic only]
+//               Retrieves one bucket of the histogram of frame ages at the
+//               time the firmware took each frame for processing, as a uint32
+//               count of frames.  The age is measured from the midpoint of the
+//               frame's integration period.  Index 40 counts frames under 1ms
+//               old, 41 counts 1-2ms, 42 counts 2-4ms, and so on, doubling the
+//               range for each bucket, through 47, which counts everything 
+//               64ms and older.
+//
 //
 // ARRAY VARIABLES:  Each variable below is an array.  For each get/set message,
 // byte 3 gives the array index.  These are grouped at the top end of the variable 
@@ -1,7 +1,6 @@
 // VCNL4010 IR proximity sensor
 
 #include "mbed.h"
-#include "math.h"
 #include "VCNL4010.h"
 
 
@@ -21,7 +20,6 @@ VCNL4010::VCNL4010(PinName sda, PinName scl, bool internalPullups, int iredCurre
     minProxCount = 100;
     maxProxCount = 65535;
     parkProxCount = 20000;
-    dcOffset = 0;
     lastProxCount = 0;
     calcScalingFactor();
     
@@ -192,8 +190,8 @@ int VCNL4010::getProx(int &proxCount,
     lastProxCount = N;
     
     // start a new reading, so that the sensor is collecting the next
-    // reading concurrently with the time-consuming floating-point math
-    // we're about to do
+    // reading concurrently with the distance conversion math we're
+    // about to do
     startProxReading();
     
     // if calibration is in progress, note the new min/max proximity
@@ -303,29 +301,14 @@ void VCNL4010::endCalibration(Config &config)
 // then do a best-fit calculation to determine the best exponent
 // (which would still assume that there's *some* 1/R^x relationship
 // for some exponent x, but it wouldn't assume it's necessarily R^2.)
-// 
-static inline float power(int x)
-{
-    return sqrtf(static_cast<float>(x)); 
-}
+//
+// The conversion math itself is in proxDistance.h.
 
 // convert from a raw sensor count value to distance units, using our
 // current calibration data
 int VCNL4010::countToDistance(int count)
 {
-    // remove the DC offset from teh signal
-    count -= dcOffset;
-    
-    // if the adjusted count (excess of DC offset) is zero or negative,
-    // peg it to the minimum end = maximum retraction point
-    if (count <= 0)
-        return 65535;
-
-    // figure the distance based on our inverse power curve
-    float d = scalingFactor/power(count) + scalingOffset;
-    
-    // constrain it to the valid range and convert to int for return
-    return d < 0.0f ? 0 : d > 65535.0f ? 65535 : static_cast<int>(d);
+    return dist.toDistance(count);
 }
 
 // Calculate the scaling factors for our power-law formula for
@@ -353,25 +336,7 @@ void VCNL4010::calcScalingFactor()
     // Figure the scaling factor and offset over the range from the park
     // position to the maximum retracted position, which corresponds to
     // the minimum count (lowest intensity reflection) we've observed.
-    //
-    // Do all calculations with the counts *after* subtracting out the
-    // signal's DC offset, which is the brightness level registered on the
-    // sensor when there's no reflective target in range.  We can't directly
-    // measure the DC offset in a plunger setup, since that would require
-    // removing the plunger entirely, but we can guess that the minimum
-    // reading observed during calibration is approximately equal to the
-    // DC offset.  The minimum brightness occurs when the plunger is at the
-    // most distance point in its travel range from the sensor, which is
-    // when it's pulled all the way back.  The plunger travel distance is
-    // just about at the limit of the VCNL4010's sensitivity, so the inverse
-    // curve should be very nearly flat at this point, thus this is a very
-    // close approximation of the true DC offset.
-    const int dcOffsetDelta = 50;
-    dcOffset = minProxCount > dcOffsetDelta ? minProxCount - dcOffsetDelta : 0;
-    int park = parkProxCount - dcOffset;
-    float parkInv = 1.0f/power(park);
-    scalingFactor = 54612.5f / (1.0f/power(minProxCount - dcOffset) - parkInv);
-    scalingOffset = 10922.5f - (scalingFactor * parkInv);
+    dist.calibrate(parkProxCount, minProxCount);
 }
 
 // Read an I2C register on the device
@@ -123,6 +123,7 @@
 #include "mbed.h"
 #include "BitBangI2C.h"
 #include "config.h"
+#include "proxDistance.h"
 
 class VCNL4010
 {
@@ -203,21 +204,9 @@ protected:
     // conversion factors.
     void calcScalingFactor();
     
-    // DC Offset for converting from count to distance.  Per the Vishay
-    // application notes, the sensor brightness signal contains a fixed
-    // component that comes from a combination of physical factors such
-    // as internal reflections, ambient light, ADC artifacts, and sensor
-    // noise.  This must be subtracted from the reported proximity count
-    // to get a measure of the actual reflected brightness level.  The
-    // DC offset is a function of the overall setup, so it has to be
-    // determined through calibration.
-    int dcOffset;
-
-    // Scaling factor and offset for converting from count to distance.
-    // We calculate these based on the counts collected at known points
-    // during calibration.
-    float scalingFactor;
-    float scalingOffset;
+    // Count to distance conversion.  We calculate the conversion factors
+    // based on the counts collected at known points during calibration.
+    ProxDistance dist;
 };
 
 #endif // _VCNL4010_H_
@@ -0,0 +1,168 @@
+// VCNL4010 proximity count to distance conversion
+//
+// This converts the VCNL4010's proximity counts (brightness readings) to 
+// distances, using the power law described in VCNL4010.cpp, with the 
+// conversion factors figured from the calibration counts.  It's separate
+// from the device interface so that the math can be built and tested on
+// its own, off the device (see HostTest/).
+//
+// The KL25Z has no FPU, and this conversion runs on every plunger
+// reading, so we do the whole calculation in fixed-point integer math.
+// The 1/sqrt(x) term comes from invSqrt() below, which works in units
+// of 2^-24 (so it returns 2^24/sqrt(x)).  That's accurate to about
+// 2.7 parts in 100,000, which keeps the final distance within 1 unit
+// of the exact result on our 0..65535 scale - well under the sensor's
+// noise level.
+
+#ifndef _PROXDISTANCE_H_
+#define _PROXDISTANCE_H_
+
+#include <stdint.h>
+
+// Reciprocal square root table.  Entry i is 2^24/sqrt((64+i)*256),
+// covering the normalized input range 16384..65536 in steps of 256.
+// invSqrt() interpolates linearly between entries.
+static const uint32_t invSqrtTab[] = {
+    131072, 130060, 129071, 128104, 127159, 126234, 125329, 124443,    // 16384-18176
+    123576, 122727, 121894, 121079, 120280, 119496, 118728, 117974,    // 18432-20224
+    117234, 116508, 115796, 115096, 114409, 113734, 113071, 112419,    // 20480-22272
+    111779, 111149, 110530, 109921, 109322, 108732, 108152, 107582,    // 22528-24320
+    107020, 106467, 105922, 105386, 104858, 104337, 103824, 103319,    // 24576-26368
+    102821, 102331, 101847, 101370, 100899, 100435,  99978,  99526,    // 26624-28416
+     99081,  98642,  98208,  97780,  97358,  96941,  96529,  96123,    // 28672-30464
+     95721,  95325,  94934,  94547,  94165,  93787,  93415,  93046,    // 30720-32512
+     92682,  92322,  91966,  91615,  91267,  90923,  90583,  90247,    // 32768-34560
+     89915,  89586,  89261,  88939,  88621,  88306,  87995,  87686,    // 34816-36608
+     87381,  87079,  86781,  86485,  86192,  85903,  85616,  85332,    // 36864-38656
+     85051,  84772,  84497,  84224,  83953,  83685,  83420,  83157,    // 38912-40704
+     82897,  82639,  82384,  82131,  81880,  81632,  81385,  81141,    // 40960-42752
+     80899,  80660,  80422,  80187,  79953,  79722,  79492,  79265,    // 43008-44800
+     79039,  78816,  78594,  78374,  78156,  77940,  77726,  77513,    // 45056-46848
+     77302,  77093,  76885,  76679,  76475,  76273,  76072,  75872,    // 47104-48896
+     75674,  75478,  75283,  75090,  74898,  74708,  74519,  74332,    // 49152-50944
+     74146,  73961,  73778,  73596,  73415,  73236,  73058,  72881,    // 51200-52992
+     72706,  72532,  72359,  72187,  72016,  71847,  71679,  71512,    // 53248-55040
+     71347,  71182,  71019,  70856,  70695,  70535,  70376,  70218,    // 55296-57088
+     70061,  69905,  69750,  69596,  69444,  69292,  69141,  68991,    // 57344-59136
+     68842,  68694,  68548,  68402,  68256,  68112,  67969,  67827,    // 59392-61184
+     67685,  67545,  67405,  67266,  67128,  66991,  66855,  66719,    // 61440-63232
+     66585,  66451,  66318,  66186,  66054,  65923,  65794,  65664,    // 63488-65280
+     65536                                                               // 65536
+};
+
+class ProxDistance
+{
+public:
+    ProxDistance() : dcOffset(0), invPark(0), distScale(0) { }
+    
+    // Figure the conversion factors from the calibration data: the 
+    // proximity count at the park position, and the minimum count 
+    // observed, which is at the maximum retraction point.  The caller
+    // is responsible for keeping the minimum count in a sensible range.
+    void calibrate(int parkCount, int minCount)
+    {
+        // Do all calculations with the counts *after* subtracting out the
+        // signal's DC offset, which is the brightness level registered on
+        // the sensor when there's no reflective target in range.  We can't
+        // directly measure the DC offset in a plunger setup, since that 
+        // would require removing the plunger entirely, but we can guess 
+        // that the minimum reading observed during calibration is 
+        // approximately equal to the DC offset.  The minimum brightness 
+        // occurs when the plunger is at the most distance point in its 
+        // travel range from the sensor, which is when it's pulled all the
+        // way back.  The plunger travel distance is just about at the limit
+        // of the VCNL4010's sensitivity, so the inverse curve should be 
+        // very nearly flat at this point, thus this is a very close 
+        // approximation of the true DC offset.
+        const int dcOffsetDelta = 50;
+        dcOffset = minCount > dcOffsetDelta ? minCount - dcOffsetDelta : 0;
+        
+        // Figure the 1/sqrt() terms at the park and maximum retraction
+        // points.  If the park count doesn't come out above the DC offset
+        // (which would only happen with bogus calibration data), peg it to
+        // the smallest valid value to keep the math in range.
+        int park = parkCount - dcOffset;
+        if (park < 1)
+            park = 1;
+        invPark = static_cast<int>(invSqrt(park));
+        int invMin = static_cast<int>(invSqrt(minCount - dcOffset));
+        
+        // Figure the scaling factor that maps the 1/sqrt() span between the
+        // park and maximum retraction points onto the 54612.5-unit distance
+        // span between them.  We keep 28 fraction bits (54612.5 << 28 ==
+        // 109225 << 27), since the span in 1/sqrt() units is typically in
+        // the millions, making the factor a small fraction.  With sensible
+        // calibration data, the span can't be smaller than about 23000 (the
+        // difference between 1/sqrt(50) and 1/sqrt(51), since the minimum
+        // count is always dcOffsetDelta above the DC offset).  Apply a floor
+        // a little below that in case the park count is bogus, to keep the
+        // factor within 32 bits.
+        int span = invMin - invPark;
+        if (span < 16384)
+            span = 16384;
+        distScale = static_cast<int>((static_cast<int64_t>(109225) << 27) / span);
+    }
+    
+    // convert from a raw sensor count value to distance units, using the
+    // current calibration
+    int toDistance(int count) const
+    {
+        // remove the DC offset from the signal
+        count -= dcOffset;
+        
+        // if the adjusted count (excess of DC offset) is zero or negative,
+        // peg it to the minimum end = maximum retraction point
+        if (count <= 0)
+            return 65535;
+    
+        // figure the distance based on our inverse power curve.  distScale
+        // has 28 fraction bits, so we add the 10922.5 park position offset
+        // in the same format, plus 1/2 for rounding (21846 << 27 == 10923.0
+        // << 28), then shift out the fraction.
+        int inv = static_cast<int>(invSqrt(count)) - invPark;
+        int d = static_cast<int>(
+            (static_cast<int64_t>(inv) * distScale + (static_cast<int64_t>(21846) << 27)) >> 28);
+        
+        // constrain it to the valid range
+        return d < 0 ? 0 : d > 65535 ? 65535 : d;
+    }
+
+    // Figure 2^24/sqrt(x) for x in 1..65535.  We normalize x into the
+    // 16384..65535 range covered by the table by shifting it left two bits
+    // at a time; each 2-bit shift of the input corresponds to a 1-bit shift
+    // of the square root, so we just shift the table result back by half
+    // the input shift to get the answer for the original value.
+    static uint32_t invSqrt(uint32_t x)
+    {
+        // normalize into the table range
+        int k = 0;
+        for ( ; x < 16384 ; x <<= 2, ++k) ;
+        
+        // interpolate between the bracketing table entries
+        uint32_t i = (x >> 8) - 64, frac = x & 0xFF;
+        uint32_t y = invSqrtTab[i] - (((invSqrtTab[i] - invSqrtTab[i+1]) * frac + 128) >> 8);
+        
+        // undo the normalization
+        return y << k;
+    }
+    
+protected:
+    // DC Offset for converting from count to distance.  Per the Vishay
+    // application notes, the sensor brightness signal contains a fixed
+    // component that comes from a combination of physical factors such
+    // as internal reflections, ambient light, ADC artifacts, and sensor
+    // noise.  This must be subtracted from the reported proximity count
+    // to get a measure of the actual reflected brightness level.  The
+    // DC offset is a function of the overall setup, so it has to be
+    // determined through calibration.
+    int dcOffset;
+
+    // Scaling factor and offset for converting from count to distance.
+    // invPark is the 1/sqrt(count) value at the park position, in the 
+    // 2^-24 units used by invSqrt(); distScale is the distance units per
+    // 1/sqrt(count) unit, with 28 fraction bits.
+    int invPark;
+    int distScale;
+};
+
+#endif // _PROXDISTANCE_H_
@@ -157,8 +157,10 @@ void VL6180X::continuousDistanceMode(bool on)
         // to zero to select single-shot mode without starting a reading.
         if (on)
         {
-            writeReg8(VL6180X_SYSTEM_INTERRUPT_CONFIG_GPIO, 4);   // Enable interrupts for ranging only
-            writeReg8(VL6180X_SYSALS_INTERMEASUREMENT_PERIOD, 0); // minimum measurement interval (10ms)
+            writeReg8(VL6180X_SYSTEM_MODE_GPIO1, 0x10);               // GPIO1 = interrupt output, active low
+            writeReg8(VL6180X_SYSTEM_INTERRUPT_CONFIG_GPIO, 4);       // Enable interrupts for ranging only
+            writeReg8(VL6180X_SYSRANGE_INTERMEASUREMENT_PERIOD, 0);   // minimum measurement interval (10ms)
+            writeReg8(VL6180X_SYSTEM_INTERRUPT_CLEAR, 0x07);          // clear any pending interrupt
             writeReg8(VL6180X_SYSRANGE_START, 0x03);
         }
         else
@@ -222,13 +224,8 @@ int VL6180X::getRange(uint8_t &distance, uint32_t &tMid, uint32_t &dt, uint32_t
     // Per the data sheet, the total execution time is the sum of the
     // fixed 3.2ms pre-calculation time, the convergence time, and the
     // readout averaging time.  We can query the convergence time for
-    // each reading from the sensor.  The averaging time is a controlled
-    // by the READOUT_AVERAGING_SAMPLE_PERIOD setting, which we set to
-    // our constant value averagingSamplePeriod.
-    dt = 
-        3200                                                // fixed 3.2ms pre-calculation period
-        + readReg32(VL6180X_RESULT_RANGE_RETURN_CONV_TIME)  // convergence time
-        + (1300 + 48*averagingSamplePeriod);                // readout averaging period
+    // each reading from the sensor; the rest is the nominal sample time.
+    dt = nominalSampleTime() + readReg32(VL6180X_RESULT_RANGE_RETURN_CONV_TIME);
         
     // figure the midpoint of the sample time - the starting time
     // plus half the collection time
@@ -241,6 +238,27 @@ int VL6180X::getRange(uint8_t &distance, uint32_t &tMid, uint32_t &dt, uint32_t
     return err;
 }
 
+int VL6180X::readRangeResult(uint8_t &distance)
+{
+    // Read the status and distance registers.  They're 21 bytes apart 
+    // in the register map, so it's cheaper to address each one 
+    // separately than to read the whole block between them: each 
+    // single-register read is 5 bytes on the bus, versus 26 for the 
+    // block.  Each read uses a repeated start between the address write
+    // and the data read, which saves the STOP/START pair.
+    uint8_t status, val;
+    if (readReg8RS(VL6180X_RESULT_RANGE_STATUS, status)
+        || readReg8RS(VL6180X_RESULT_RANGE_VAL, val))
+        return -1;
+        
+    // clear the data-ready interrupt, so that it signals the next reading
+    writeReg8(VL6180X_SYSTEM_INTERRUPT_CLEAR, 0x07);
+    
+    // pass back the distance, and return the error code
+    distance = val;
+    return (status >> 4) & 0x0F;
+}
+
 void VL6180X::getRangeStats(VL6180X_RangeStats &stats)
 {
     stats.returnRate = readReg16(VL6180X_RESULT_RANGE_RETURN_RATE);
@@ -271,6 +289,23 @@ uint8_t VL6180X::readReg8(uint16_t registerAddr)
     return data_read[0];
 }
  
+int VL6180X::readReg8RS(uint16_t registerAddr, uint8_t &data)
+{
+    // write the register address, MSB+LSB, without a STOP
+    uint8_t data_write[2];
+    data_write[0] = (registerAddr >> 8) & 0xFF;
+    data_write[1] = registerAddr & 0xFF;
+    if (i2c.write(addr << 1, data_write, 2, true))
+    {
+        // the write failed partway, so close out the transaction
+        i2c.stop();
+        return -1;
+    }
+
+    // read the result, starting with a repeated start
+    return i2c.read(addr << 1, &data, 1);
+}
+ 
 uint16_t VL6180X::readReg16(uint16_t registerAddr)
 {
     // write the request - MSB+LSB of register address
@@ -165,9 +165,24 @@ public:
     // get range statistics
     void getRangeStats(VL6180X_RangeStats &stats);
 
-    // set continuous distance mode
+    // Set continuous distance mode.  In continuous mode, the sensor takes
+    // readings continuously at its minimum inter-measurement period (10ms),
+    // and signals each new reading on its GPIO1 pin (active low), so the
+    // host can use GPIO1 as a data-ready interrupt instead of polling.
     void continuousDistanceMode(bool on);
     
+    // Read the latest range result in continuous mode.  This reads the
+    // status and distance registers, and clears the data-ready interrupt.
+    // Returns 0 on success, a device "range error code" (>0) on failure,
+    // as with getRange(), or -1 if the I2C reads fail.
+    int readRangeResult(uint8_t &distance);
+    
+    // Nominal sample collection time in microseconds, not counting the
+    // convergence time (which varies by reading).  This is the fixed 3.2ms 
+    // pre-calculation period plus the readout averaging period, which 
+    // depends on the READOUT_AVERAGING_SAMPLE_PERIOD setting.
+    static uint32_t nominalSampleTime() { return 3200 + (1300 + 48*averagingSamplePeriod); }
+    
     // is a sample ready?
     bool rangeReady();
 
@@ -205,6 +220,10 @@ protected:
     uint8_t readReg8(uint16_t regAddr);
     uint16_t readReg16(uint16_t regAddr);
     uint32_t readReg32(uint16_t regAddr);
+    
+    // read an 8-bit register, using a repeated start between the address
+    // write and the data read; returns 0 on success, non-zero on failure
+    int readReg8RS(uint16_t regAddr, uint8_t &data);
 
     // write registers
     void writeReg8(uint16_t regAddr, uint8_t data);
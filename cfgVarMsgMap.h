@@ -48,7 +48,7 @@ void v_func
         
         // ********** DESCRIBE CONFIGURATION VARIABLES **********
     case 0:
-        v_byte_ro(23, 2);       // number of SCALAR variables
+        v_byte_ro(25, 2);       // number of SCALAR variables
         v_byte_ro(6, 3);        // number of ARRAY variables
         break;
         
@@ -94,6 +94,7 @@ void v_func
         // param1 usages (see the sensor-specific code for details):
         //    TSL14xx   - scan mode
         //    TCNL4010  - IRED current
+        //    AEAT601X  - flags (0x01 = SPI readout)
         //
         v_byte(plunger.sensorType, 2);
         v_byte(plunger.param1, 3);
@@ -205,16 +206,18 @@ void v_func
         //
         //    0x80   = reverse orientation is supported
         //    0x40   = TSL14xx scan mode settings enabled (config var 5)
+        //    0x20   = adaptive jitter filter is supported
         // The reversed orientation byte always has bit 0x80 set to indicate
         // that the feature is supported in this version.
         v_ui16(plunger.jitterWindow, 2);
-        v_byte_ro(cfg.plunger.reverseOrientation | 0x80 | 0x40, 4);
+        v_byte_ro(cfg.plunger.reverseOrientation | 0x80 | 0x40 | 0x20, 4);
         v_byte_wo(plunger.reverseOrientation, 4);
         break;
         
     case 20:
         // bar-code plunger setup
         v_ui16(plunger.barCode.startPix, 2);
+        v_byte(plunger.barCode.flags, 4);
         break;
         
     case 21:
@@ -237,6 +240,21 @@ void v_func
         v_ui16(gpioPwmFreq, 2);
         break;
         
+    case 24:
+        // plunger image sensor processing options
+        v_byte(plunger.image.flags, 2);
+        v_byte(plunger.image.aeTarget, 3);
+        v_byte(plunger.image.avgFrames, 4);
+        break;
+        
+    case 25:
+        // plunger motion estimation options
+        v_byte(plunger.motion.mode, 2);
+        v_byte(plunger.motion.tau, 3);
+        v_byte(plunger.motion.flags, 4);
+        v_byte(plunger.motion.lookahead, 5);
+        break;
+        
     // case N: // new scalar variable
     //
     // !!! ATTENTION !!!
@@ -301,6 +319,65 @@ void v_func
                     a = (plungerSensor != 0 ? plungerSensor->getAvgScanTime() : 0);
                     v_ui32_ro(a, 3);
                     break;                    
+                    
+                case 31:
+                    // plunger image processing time per frame, in us
+                    a = (plungerSensor != 0 ? plungerSensor->getAvgProcessTime() : 0);
+                    v_ui32_ro(a, 3);
+                    break;
+                    
+                case 32:
+                case 33:
+                case 34:
+                case 40:
+                case 41:
+                case 42:
+                case 43:
+                case 44:
+                case 45:
+                case 46:
+                case 47:
+                    // plunger image sensor frame statistics
+                    {
+                        const FrameStats *fs = (plungerSensor != 0 ? plungerSensor->getFrameStats() : 0);
+                        a = 0;
+                        if (fs != 0)
+                        {
+                            switch (data[2])
+                            {
+                            case 32: a = fs->nCaptured; break;
+                            case 33: a = fs->nProcessed; break;
+                            case 34: a = fs->nOverwritten; break;
+                            default: a = fs->ageHist[data[2] - 40]; break;
+                            }
+                        }
+                        v_ui32_ro(a, 3);
+                    }
+                    break;
+                    
+                case 35:
+                case 36:
+                case 37:
+                case 38:
+                case 39:
+                    // quadrature sensor edge statistics
+                    {
+                        const EdgeStats *es = (plungerSensor != 0 ? plungerSensor->getEdgeStats() : 0);
+                        a = 0;
+                        if (es != 0)
+                        {
+                            switch (data[2])
+                            {
+                            case 35: a = es->nEdges; break;
+                            case 36: a = es->nIllegal; break;
+                            case 37: a = es->nEdges > 1 ? es->minPeriod : 0; break;
+                            case 38: a = es->avgHandlerTime(); break;
+                            case 39: a = es->handlerMax; break;
+                            }
+                        }
+                        v_ui32_ro(a, 3);
+                    }
+                    break;
             }
         }
 #endif
@@ -301,6 +301,22 @@ struct Config
         // normal orientation
         plunger.reverseOrientation = false;
         
+        // no bar code sensor options
+        plunger.barCode.flags = 0;
+        
+        // no special image processing options
+        plunger.image.flags = 0;
+        plunger.image.aeTarget = 0;
+        plunger.image.avgFrames = 0;
+        
+        // use the basic three-point speed calculation
+        plunger.motion.mode = 0;
+        plunger.motion.tau = 0;
+        
+        // no position prediction
+        plunger.motion.flags = 0;
+        plunger.motion.lookahead = 0;
+        
 #if TEST_CONFIG_EXPAN || STANDARD_CONFIG
         plunger.enabled = 0x01;
         plunger.sensorType = PlungerType_TSL1410R;
@@ -702,6 +718,7 @@ struct Config
         //  Sensor       Param1
         //  TSL14xx      Edge scan mode
         //  VCNL4010     IRED current
+        //  AEAT-601x    Flags: 0x01 = hardware SPI readout
         //
         uint8_t param1;
     
@@ -721,8 +738,8 @@ struct Config
         // Potentiometer:             AO (AnalogIn),   NC,               NC,              NC
         // AEDR8300:                  A (InterruptIn), B (InterruptIn),  NC,              NC
         // AS5304:                    A (InterruptIn), B (InterruptIn),  NC,              NC
-        // VL6180X:                   SDA (GPIO),      SCL (GPIO),       GPIO0/CE (GPIO), NC
-        // AEAT-6012-A06:             CS (GPIO),       CLK (GPIO),       DO (GPIO),       NC
+        // VL6180X:                   SDA (GPIO),      SCL (GPIO),       GPIO0/CE (GPIO), GPIO1 (InterruptIn, optional)
+        // AEAT-6012-A06:             CS (GPIO),       CLK (GPIO/SCK),   DO (GPIO/MISO),  NC
         // TCD1103GFG:                fM (PWM),        OS (AnalogIn),    ICG (GPIO),      SH (GPIO)
         // VCNL4010:                  SDA (GPIO),      SCL (GPIO),       NC,              NC
         //
@@ -754,6 +771,16 @@ struct Config
         //         around.  This can be used to correct for installing the
         //         sensor backwards without having to change the hardware.
         //
+        //  0x02 = Adaptive jitter filter.  We measure the sensor noise while
+        //         the plunger is at rest and size the jitter window to match,
+        //         closing the window while the plunger is moving.  The
+        //         jitterWindow setting is the maximum window size in this
+        //         mode, with zero selecting a default maximum of 1/64 of
+        //         the sensor's native range.
+        //
+        //  0x20 = READ-ONLY feature flag.  This always reads as set if the
+        //         firmware supports the adaptive jitter filter.
+        //
         //  0x40 = READ-ONLY feature flag.  This always reads as set if the
         //         firmware supports the TSL14xx scan mode settings
         //
@@ -768,8 +795,95 @@ struct Config
         struct
         {
             uint16_t startPix;  // starting pixel offset
+            
+            // Option flags:
+            //
+            //  0x01 = temporal filter.  Reject decodes that are too far
+            //         from the position predicted from the last two 
+            //         readings to be real plunger motion.
+            //
+            uint8_t flags;
         } barCode;
         
+        // Image sensor processing options.  These apply to the imaging
+        // sensor types (TSL14xx, TCD1103); other sensor types ignore them.
+        struct
+        {
+            // Option flags.  This is a combination of bits:
+            //
+            //  0x01 = sub-pixel edge interpolation.  The edge detectors
+            //         interpolate the edge position to a fraction of a
+            //         pixel, and the native scale is multiplied by 16 to
+            //         report the fractional positions.  Not applicable to
+            //         bar code sensors.
+            //
+            //  0x02 = automatic exposure control.  The edge detectors
+            //         adjust the integration time to keep the contrast
+            //         between the bright and dark parts of the image
+            //         near the target level (aeTarget).  Not applicable
+            //         to bar code sensors, which always use their own
+            //         exposure control.
+            //
+            //  0x04 = fixed-pattern noise correction, using the per-pixel
+            //         calibration data captured with the 65 19 command.
+            //         TCD1103 only.
+            //
+            //  0x08 = multi-frame averaging.  Consecutive frames are
+            //         averaged while the plunger is at rest, to reduce
+            //         noise in the parked position.  Averaging stops as
+            //         soon as the image changes, so it doesn't add any
+            //         latency while the plunger is moving.
+            //
+            uint8_t flags;
+            
+            // Auto-exposure target contrast, as the difference between
+            // the average brightness at the bright and dark ends of the
+            // image on the 0-255 pixel scale.  0 selects the default.
+            uint8_t aeTarget;
+            
+            // Number of frames to average with multi-frame averaging.
+            // This is rounded down to a power of 2, from 2 to 16.  0
+            // selects the default (8).
+            uint8_t avgFrames;
+        } image;
+        
+        // Plunger motion estimation options
+        struct
+        {
+            // Speed estimator mode:
+            //
+            //  0 = three-point slope.  The speed is the slope between the
+            //      readings before and after the current one, so the 
+            //      reported position lags the sensor by one sample.
+            //
+            //  1 = alpha-beta filter.  The position and speed come from a
+            //      fixed-point position/velocity tracking filter updated
+            //      on every sample (see Plunger/alphaBeta.h).  This gives smoother
+            //      speed readings at low speeds, and removes the one-sample
+            //      lag of the three-point calculation.
+            //
+            uint8_t mode;
+            
+            // Alpha-beta filter time constant, in units of 100us.  Shorter
+            // times track the raw readings more closely; longer times 
+            // filter more heavily.  0 selects the default (2ms).
+            uint8_t tau;
+            
+            // Option flags.  This is a combination of bits:
+            //
+            //  0x01 = predictive latency compensation.  The reported
+            //         position is extrapolated from the latest sample,
+            //         using the estimated speed, to the time the joystick
+            //         report is sent, plus the lookahead time below.
+            //
+            uint8_t flags;
+            
+            // Prediction lookahead time, in milliseconds, to cover known
+            // latency on the host side.  This is added to the time between
+            // the sample and the report when predicting the position.
+            uint8_t lookahead;
+        } motion;
+        
         // ZB LAUNCH BALL button setup.
         //
         // This configures the "ZB Launch Ball" feature in DOF, based on Zeb's (of 
@@ -0,0 +1,88 @@
+// Quadrature sensor edge statistics
+//
+// The quadrature sensors generate an interrupt on every edge of either
+// channel, and the interrupt handler has to keep up with the fastest
+// pulse rate the sensor produces, or else we miss edges and the position
+// count goes out of sync.  The margin depends on the encoder resolution
+// and the plunger speed, so it's worth checking whenever we change to a
+// new encoder type.
+//
+// This class collects counters to measure that margin on the live system:
+// the number of edges, the number of illegal transitions (which can only
+// happen when we miss an edge), the shortest time between edges, and the
+// time spent in the edge handler.  The times are in CPU clock cycles, 
+// from the SysTick counter.  Note that the handler time only covers our
+// own handler code; the interrupt entry and dispatch overhead in 
+// FastInterruptIn (about 6.5us) comes on top of that.  So the maximum
+// sustainable edge rate is roughly 1/(6.5us + maximum handler time), 
+// and the shortest edge period shows how close we've come to it.
+//
+// The counters are all updated in the edge interrupt handler, so each
+// has a single writer.  The illegal transition count is kept in all 
+// builds, since it's just an increment on a path that should never run.
+// The rest is collected only when diagnostics are enabled (see diags.h),
+// since it adds work to every edge, in the one interrupt handler in the
+// system where every cycle counts.
+
+#ifndef _EDGESTATS_H_
+#define _EDGESTATS_H_
+
+#include "mbed.h"
+
+class EdgeStats
+{
+public:
+    EdgeStats()
+    {
+        nEdges = nIllegal = 0;
+        minPeriod = 0xFFFFFFFF;
+        prvTicks = 0;
+        handlerTotal = 0;
+        handlerMax = 0;
+    }
+    
+    // Count an edge (interrupt context).  tEntry and tExit are the SysTick
+    // counter values on entry to and exit from the handler.  'gap' is true
+    // if the period since the prior edge is unknown, because the SysTick
+    // counter might have wrapped more than once.  Note that SysTick counts
+    // down, so elapsed times are the earlier value minus the later one.
+    void onEdge(uint32_t tEntry, uint32_t tExit, bool gap)
+    {
+        tEntry &= 0xFFFFFF;
+        if (nEdges != 0 && !gap)
+        {
+            uint32_t period = (prvTicks - tEntry) & 0xFFFFFF;
+            if (period < minPeriod)
+                minPeriod = period;
+        }
+        prvTicks = tEntry;
+        ++nEdges;
+        
+        uint32_t handler = (tEntry - tExit) & 0xFFFFFF;
+        handlerTotal += handler;
+        if (handler > handlerMax)
+            handlerMax = handler;
+    }
+    
+    // count an illegal transition (interrupt context)
+    void onIllegal() { ++nIllegal; }
+    
+    // get the average handler time, in clock cycles
+    uint32_t avgHandlerTime() const
+    {
+        return nEdges != 0 ? uint32_t(handlerTotal / nEdges) : 0;
+    }
+    
+    // counters
+    volatile uint32_t nEdges;           // edges counted
+    volatile uint32_t nIllegal;         // illegal transitions
+    volatile uint32_t minPeriod;        // shortest time between edges, in clocks
+    volatile uint64_t handlerTotal;     // total time in the handler, in clocks
+    volatile uint32_t handlerMax;       // longest time in the handler, in clocks
+    
+protected:
+    // SysTick time of the previous edge
+    uint32_t prvTicks;
+};
+
+#endif /* _EDGESTATS_H_ */
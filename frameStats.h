@@ -0,0 +1,67 @@
+// Image sensor frame statistics
+//
+// The image sensors (TSL14xx, TCD1103) capture frames continuously via
+// DMA, into a pair of buffers that they trade back and forth with the
+// client.  If the client is still holding the previous frame when a new
+// frame finishes, the sensor has nowhere to put the new frame except
+// over the top of the one it just captured, so that frame is lost.  This
+// happens whenever the main loop stalls for longer than a frame time,
+// such as during a burst of LedWiz messages or a flash save.
+//
+// This class collects counters to measure how often that happens: the
+// number of frames captured, the number overwritten before the client
+// could take them, and the number the client actually processed, plus a
+// histogram of the age of each frame at the time the client took it.
+// The age is measured from the frame's timestamp (the midpoint of its
+// integration period), so it shows how stale the plunger readings are.
+//
+// The capture and overwrite counters are updated in the DMA interrupt
+// handlers, and the processing counters in application context, so each
+// counter has a single writer.
+
+#ifndef _FRAMESTATS_H_
+#define _FRAMESTATS_H_
+
+#include "mbed.h"
+
+class FrameStats
+{
+public:
+    FrameStats() 
+    { 
+        nCaptured = nOverwritten = nProcessed = 0;
+        memset(ageHist, 0, sizeof(ageHist));
+    }
+    
+    // Number of buckets in the age histogram.  Bucket 0 counts frames 
+    // under 1ms old, bucket 1 counts 1-2ms, and each bucket after that
+    // doubles the range (2-4ms, 4-8ms, etc).  The last bucket counts
+    // everything from 64ms up.
+    static const int nAgeBuckets = 8;
+    
+    // count a frame captured (DMA interrupt context)
+    void onCapture() { ++nCaptured; }
+    
+    // count a captured frame discarded because the client still held
+    // the stable buffer (DMA interrupt context)
+    void onOverwrite() { ++nOverwritten; }
+    
+    // count a frame taken by the client, with its age in microseconds
+    // (application context)
+    void onProcess(uint32_t age)
+    {
+        ++nProcessed;
+        int b = 0;
+        for (uint32_t ms = age / 1000 ; ms != 0 && b < nAgeBuckets - 1 ; ms >>= 1)
+            ++b;
+        ++ageHist[b];
+    }
+    
+    // counters
+    volatile uint32_t nCaptured;        // frames captured
+    volatile uint32_t nOverwritten;     // frames overwritten before the client took them
+    uint32_t nProcessed;                // frames taken by the client
+    uint32_t ageHist[nAgeBuckets];      // frame age histogram at processing time
+};
+
+#endif /* _FRAMESTATS_H_ */